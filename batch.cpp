@@ -0,0 +1,133 @@
+#include "batch.hpp"
+#include "vm.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+
+namespace {
+    struct Result {
+        std::string output;
+        std::string error;
+        std::atomic<bool> done{false};
+    };
+}
+
+
+BatchRunner::BatchRunner(const Poliz &poliz, std::function<void(VM &)> configure)
+    : poliz(poliz), configure(std::move(configure)) {
+}
+
+std::vector<std::string> BatchRunner::collectInputs(const std::string &path) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> inputs;
+
+    std::error_code ec;
+    if (fs::is_directory(path, ec)) {
+        for (const auto &entry : fs::directory_iterator(path))
+            if (entry.is_regular_file())
+                inputs.push_back(entry.path().string());
+        std::sort(inputs.begin(), inputs.end());
+        return inputs;
+    }
+
+    std::ifstream list(path);
+    if (!list)
+        throw std::runtime_error("Batch: cannot open " + path);
+    std::string line;
+    while (std::getline(list, line))
+        if (!line.empty())
+            inputs.push_back(line);
+    return inputs;
+}
+
+int BatchRunner::run(const std::vector<std::string> &inputs, unsigned jobs, int outFd, std::ostream &err) {
+    if (jobs == 0)
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    jobs = static_cast<unsigned>(std::min<std::size_t>(jobs, inputs.size()));
+
+    std::unique_ptr<Result[]> results(new Result[inputs.size()]);
+    std::atomic<std::size_t> nextInput{0};
+
+    // The VM is built on the worker's first input, since an InputBuffer
+    // needs something to read from.
+    auto worker = [&] {
+        OutputSink output;
+        std::unique_ptr<InputBuffer> input;
+        std::unique_ptr<VM> vm;
+
+        for (;;) {
+            std::size_t i = nextInput.fetch_add(1, std::memory_order_relaxed);
+            if (i >= inputs.size())
+                break;
+            Result &r = results[i];
+
+            int fd = ::open(inputs[i].c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                r.error = std::string("cannot open: ") + std::strerror(errno);
+            } else {
+                try {
+                    if (!vm) {
+                        input = std::make_unique<InputBuffer>(fd);
+                        vm = std::make_unique<VM>(poliz, *input, output);
+                        configure(*vm);
+                    } else {
+                        input->reset(fd);
+                    }
+                    vm->run();
+                } catch (const std::exception &e) {
+                    r.error = e.what();
+                }
+                r.output = output.take();
+                if (input)
+                    input->reset(-1);
+                ::close(fd);
+            }
+
+            r.done.store(true, std::memory_order_release);
+            r.done.notify_one();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned j = 0; j < jobs; ++j)
+        pool.emplace_back(worker);
+
+    // Stops handing out inputs and waits for the runs already started, so
+    // a failed write to `outFd` does not leave threads running.
+    auto stop = [&] {
+        nextInput.store(inputs.size(), std::memory_order_relaxed);
+        for (std::thread &t : pool)
+            t.join();
+    };
+
+    int failed = 0;
+    try {
+        OutputSink out(outFd);
+        for (std::size_t i = 0; i < inputs.size(); ++i) {
+            Result &r = results[i];
+            r.done.wait(false, std::memory_order_acquire);
+            out.write(r.output);
+            std::string().swap(r.output);
+            if (!r.error.empty()) {
+                out.flush();
+                err << inputs[i] << ": " << r.error << "\n";
+                ++failed;
+            }
+        }
+        out.flush();
+    } catch (...) {
+        stop();
+        throw;
+    }
+    stop();
+    return failed;
+}
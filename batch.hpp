@@ -0,0 +1,34 @@
+#pragma once
+#include "poliz.hpp"
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+class VM;
+
+// Runs one compiled program against many input files. Each worker thread
+// owns one VM, reused for every input it picks up; a run reads its file
+// through the worker's InputBuffer and prints into the worker's in-memory
+// OutputSink. Results are written out in input order, each as soon as it
+// and every run before it have finished.
+class BatchRunner {
+public:
+    // `configure` is applied to each worker's VM once, before its first
+    // run (enableJit, enableTiering, ...); the Poliz must outlive run().
+    BatchRunner(const Poliz &poliz, std::function<void(VM &)> configure);
+
+    // The regular files in a directory, sorted by name, or the non-empty
+    // lines of a list file.
+    static std::vector<std::string> collectInputs(const std::string &path);
+
+    // Runs every input on `jobs` threads (0: one per core). Output goes to
+    // `outFd`; a run that fails has "<input>: <error>" written to `err`
+    // after its output. Returns the number of failed runs.
+    int run(const std::vector<std::string> &inputs, unsigned jobs, int outFd, std::ostream &err);
+
+private:
+    const Poliz &poliz;
+    std::function<void(VM &)> configure;
+};
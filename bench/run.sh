@@ -0,0 +1,72 @@
+#!/bin/sh
+# Usage: bench/run.sh [path/to/TranslatorLexer] [driver flags, e.g. --no-jit --engine=closure]
+# Run from the repository root so keywords.txt is found. The binary defaults
+# to build/TranslatorLexer, as built by
+#   cmake -S . -B build -DCMAKE_BUILD_TYPE=Release && cmake --build build
+# and numbers are only meaningful for such a Release build. Program output
+# is discarded; only the --time lines on stderr are shown.
+BIN=${1:-build/TranslatorLexer}
+[ $# -gt 0 ] && shift
+DIR=$(dirname "$0")
+
+if [ ! -x "$BIN" ]; then
+    echo "usage: $0 [path/to/TranslatorLexer] [driver flags] (no $BIN)" >&2
+    exit 2
+fi
+
+for prog in sum_loop sum_builtin dot_loop dot_builtin map_loop fib_calls fact_calls print_ints; do
+    "$BIN" --quiet --time "$@" "$DIR/$prog.txt" </dev/null >/dev/null
+done
+
+# read_ints and read_array sum a count followed by that many numbers from
+# stdin, one read at a time and with one bulk read(arr, n); then read_ints
+# again from a pipe, which the file-mapping reader cannot take, with and
+# without the --prefetch-input reader thread.
+INPUT=$(mktemp)
+{ echo 2000000; seq 1 2000000; } >"$INPUT"
+for prog in read_ints read_array; do
+    "$BIN" --quiet --time "$@" "$DIR/$prog.txt" <"$INPUT" >/dev/null
+done
+for flag in "" --prefetch-input; do
+    cat "$INPUT" | "$BIN" --quiet --time $flag "$@" "$DIR/read_ints.txt" >/dev/null
+done
+rm -f "$INPUT"
+
+# The same program over 200 small inputs in one --batch run: compiled once,
+# one VM per worker thread.
+BATCH=$(mktemp -d)
+for i in $(seq 1 200); do
+    { echo 1000; seq 1 1000; } >"$BATCH/$i.txt"
+done
+"$BIN" --quiet --time --batch="$BATCH" "$@" "$DIR/read_ints.txt" >/dev/null
+rm -rf "$BATCH"
+
+# Compile time for 2000 small functions: bodies parsed in order, on
+# --compile-jobs worker threads, with the lexer on its own thread, and
+# with the source lexed in chunks up front (program output is not timed).
+MANY=$(mktemp)
+{
+    echo "declare void main();"
+    for i in $(seq 1 2000); do echo "declare int f$i(int);"; done
+    for i in $(seq 1 2000); do
+        echo "int f$i(int x) { int a[16]; int i; int s; s = 0;"
+        echo "    for (i = 0; i < 16; i = i + 1) a[i] = x * $i;"
+        echo "    for (i = 0; i < 16; i = i + 1) s = s + a[i];"
+        echo "    return s; }"
+    done
+    echo "main { print(f1(2)); }"
+} >"$MANY"
+for flag in --compile-jobs=1 --compile-jobs=0 --pipeline-lexer --lex-jobs=0; do
+    echo "compile $flag:"
+    ( time "$BIN" --quiet $flag --emit-cpp=/dev/null "$@" "$MANY" ) 2>&1 | grep real
+done
+
+# The same source compiled once and then kept up to date through 200
+# edits, each inside one body (last first, so the offsets stay put).
+EDITS=$(mktemp)
+grep -bo 'x \* [0-9]*;' "$MANY" | head -200 | sort -rn | while IFS=: read -r at _; do
+    echo "$at 0 1 + "
+done >"$EDITS"
+echo "compile --edits (200):"
+( time "$BIN" --quiet --edits="$EDITS" --emit-cpp=/dev/null "$@" "$MANY" ) 2>&1 | grep real
+rm -f "$MANY" "$EDITS"
@@ -0,0 +1,43 @@
+#pragma once
+#include <array>
+#include <string_view>
+
+
+enum class Builtin {
+    Sum,
+    Fill,
+    Copy,
+    Dot,
+    MinOf,
+    MaxOf,
+    Scale,
+    Read,
+    Print,
+};
+
+struct BuiltinInfo {
+    std::string_view name;
+    Builtin id;
+    int paramCount;
+    bool secondIsArray;
+    bool returnsValue;
+    bool secondIsCount = false;
+};
+
+// read(arr, n) and print(arr) are statements that compile to the last two
+// entries; they are not callable by name.
+inline constexpr std::array<BuiltinInfo, 9> builtinTable{{
+    {"sum",   Builtin::Sum,   1, false, true},
+    {"fill",  Builtin::Fill,  2, false, false},
+    {"copy",  Builtin::Copy,  2, true,  false},
+    {"dot",   Builtin::Dot,   2, true,  true},
+    {"minOf", Builtin::MinOf, 1, false, true},
+    {"maxOf", Builtin::MaxOf, 1, false, true},
+    {"scale", Builtin::Scale, 2, false, false},
+    {"read",  Builtin::Read,  2, false, false, true},
+    {"print", Builtin::Print, 1, false, false},
+}};
+
+inline const BuiltinInfo &builtinInfo(Builtin id) {
+    return builtinTable[static_cast<int>(id)];
+}
@@ -0,0 +1,544 @@
+#include "closures.hpp"
+#include "verifier.hpp"
+
+
+namespace {
+    using Op = Poliz::Op;
+    using KindMask = Verifier::KindMask;
+
+    bool isIntLike(KindMask m) {
+        return m && !(m & ~(Verifier::KInt | Verifier::KChar | Verifier::KBool));
+    }
+
+    bool isArith(Op op) {
+        return op == Op::ADD || op == Op::SUB || op == Op::MUL;
+    }
+
+    bool isCompare(Op op) {
+        return op >= Op::CMP_EQ && op <= Op::CMP_GE;
+    }
+
+    // Integer results of binaryNumOp and the int-only ops, op for op.
+    template<Op O>
+    int32_t intOp(int32_t a, int32_t b) {
+        if constexpr (O == Op::ADD) return static_cast<int32_t>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b));
+        else if constexpr (O == Op::SUB) return static_cast<int32_t>(static_cast<uint32_t>(a) - static_cast<uint32_t>(b));
+        else if constexpr (O == Op::MUL) return static_cast<int32_t>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b));
+        else if constexpr (O == Op::DIV) {
+            if (b == 0) throw std::runtime_error("VM: division by zero");
+            return a / b;
+        } else if constexpr (O == Op::MOD) {
+            if (b == 0) throw std::runtime_error("VM: modulo by zero");
+            return a % b;
+        }
+        else if constexpr (O == Op::AND) return a & b;
+        else if constexpr (O == Op::OR) return a | b;
+        else if constexpr (O == Op::XOR) return a ^ b;
+        else if constexpr (O == Op::SHL) return a << b;
+        else return a >> b;
+    }
+
+    template<Op O>
+    float floatOp(float a, float b) {
+        if constexpr (O == Op::ADD) return a + b;
+        else if constexpr (O == Op::SUB) return a - b;
+        else if constexpr (O == Op::MUL) return a * b;
+        else {
+            if (b == 0) throw std::runtime_error("VM: division by zero");
+            return a / b;
+        }
+    }
+
+    // binaryCmpOp compares everything as float, ints included.
+    template<Op O>
+    bool compare(float a, float b) {
+        if constexpr (O == Op::CMP_EQ) return a == b;
+        else if constexpr (O == Op::CMP_NE) return a != b;
+        else if constexpr (O == Op::CMP_LT) return a < b;
+        else if constexpr (O == Op::CMP_LE) return a <= b;
+        else if constexpr (O == Op::CMP_GT) return a > b;
+        else return a >= b;
+    }
+
+    template<class Make>
+    auto forArith(Op op, Make make) {
+        switch (op) {
+            case Op::ADD: return make.template operator()<Op::ADD>();
+            case Op::SUB: return make.template operator()<Op::SUB>();
+            default:      return make.template operator()<Op::MUL>();
+        }
+    }
+
+    template<class Make>
+    auto forInt(Op op, Make make) {
+        switch (op) {
+            case Op::DIV: return make.template operator()<Op::DIV>();
+            case Op::MOD: return make.template operator()<Op::MOD>();
+            case Op::AND: return make.template operator()<Op::AND>();
+            case Op::OR:  return make.template operator()<Op::OR>();
+            case Op::XOR: return make.template operator()<Op::XOR>();
+            case Op::SHL: return make.template operator()<Op::SHL>();
+            case Op::SHR: return make.template operator()<Op::SHR>();
+            default:      return forArith(op, make);
+        }
+    }
+
+    template<class Make>
+    auto forCompare(Op op, Make make) {
+        switch (op) {
+            case Op::CMP_EQ: return make.template operator()<Op::CMP_EQ>();
+            case Op::CMP_NE: return make.template operator()<Op::CMP_NE>();
+            case Op::CMP_LT: return make.template operator()<Op::CMP_LT>();
+            case Op::CMP_LE: return make.template operator()<Op::CMP_LE>();
+            case Op::CMP_GT: return make.template operator()<Op::CMP_GT>();
+            default:         return make.template operator()<Op::CMP_GE>();
+        }
+    }
+}
+
+
+struct ClosureEngine::Ops {
+    using Value = VM::Value;
+
+    static float asFloat(const Value &v) {
+        return v.kind == Value::Kind::Float ? v.f : static_cast<float>(v.i);
+    }
+
+    static const Step *leave(ClosureEngine &e, int ip) {
+        if (e.vm.callStack.size() >= e.stopDepth)
+            return &e.steps[ip];
+        e.resumeIp = ip;
+        return nullptr;
+    }
+
+    static const Step *end(const Step *, ClosureEngine &e) {
+        e.resumeIp = static_cast<int>(e.poliz.size());
+        return nullptr;
+    }
+
+    static const Step *nop(const Step *s, ClosureEngine &) {
+        return s + 1;
+    }
+
+    static const Step *pushConst(const Step *s, ClosureEngine &e) {
+        e.vm.stack[e.vm.sp++] = s->imm;
+        return s + 1;
+    }
+
+    static const Step *loadVar(const Step *s, ClosureEngine &e) {
+        VM &vm = e.vm;
+        vm.stack[vm.sp++] = vm.stack[vm.base + s->a];
+        return s + 1;
+    }
+
+    static const Step *storeVar(const Step *s, ClosureEngine &e) {
+        VM &vm = e.vm;
+        vm.stack[vm.base + s->a] = vm.stack[--vm.sp];
+        return s + 1;
+    }
+
+    template<Op O>
+    static const Step *intBinary(const Step *s, ClosureEngine &e) {
+        VM &vm = e.vm;
+        Value *t = &vm.stack[vm.sp - 2];
+        t[0] = Value::makeInt(intOp<O>(t[0].i, t[1].i));
+        --vm.sp;
+        return s + 1;
+    }
+
+    template<Op O>
+    static const Step *numBinary(const Step *s, ClosureEngine &e) {
+        VM &vm = e.vm;
+        Value *t = &vm.stack[vm.sp - 2];
+        if (t[0].kind != Value::Kind::Float && t[1].kind != Value::Kind::Float)
+            t[0] = Value::makeInt(intOp<O>(t[0].i, t[1].i));
+        else
+            t[0] = Value::makeFloat(floatOp<O>(asFloat(t[0]), asFloat(t[1])));
+        --vm.sp;
+        return s + 1;
+    }
+
+    template<Op O, bool Ints>
+    static bool popCompare(VM &vm) {
+        Value *t = &vm.stack[vm.sp -= 2];
+        if constexpr (Ints)
+            return compare<O>(static_cast<float>(t[0].i), static_cast<float>(t[1].i));
+        else
+            return compare<O>(asFloat(t[0]), asFloat(t[1]));
+    }
+
+    template<Op O, bool Ints>
+    static const Step *cmp(const Step *s, ClosureEngine &e) {
+        VM &vm = e.vm;
+        bool r = popCompare<O, Ints>(vm);
+        vm.stack[vm.sp++] = Value::makeBool(r);
+        return s + 1;
+    }
+
+    // CMP_xx; JUMP_IF_FALSE
+    template<Op O, bool Ints>
+    static const Step *cmpBranch(const Step *s, ClosureEngine &e) {
+        return popCompare<O, Ints>(e.vm) ? s + 2 : s->target;
+    }
+
+    template<bool RhsVar>
+    static int32_t rhs(const Step *s, const VM &vm) {
+        if constexpr (RhsVar)
+            return vm.stack[vm.base + s->b].i;
+        else
+            return s->imm.i;
+    }
+
+    // LOAD_VAR a; (LOAD_VAR b | PUSH_INT k); op [; STORE_VAR c]
+    template<Op O, bool RhsVar, bool Store>
+    static const Step *varOp(const Step *s, ClosureEngine &e) {
+        VM &vm = e.vm;
+        Value r = Value::makeInt(intOp<O>(vm.stack[vm.base + s->a].i, rhs<RhsVar>(s, vm)));
+        if constexpr (Store) {
+            vm.stack[vm.base + s->c] = r;
+            return s + 4;
+        } else {
+            vm.stack[vm.sp++] = r;
+            return s + 3;
+        }
+    }
+
+    // LOAD_VAR a; (LOAD_VAR b | PUSH_INT k); CMP_xx; JUMP_IF_FALSE
+    template<Op O, bool RhsVar>
+    static const Step *varBranch(const Step *s, ClosureEngine &e) {
+        const VM &vm = e.vm;
+        return compare<O>(static_cast<float>(vm.stack[vm.base + s->a].i),
+                          static_cast<float>(rhs<RhsVar>(s, vm)))
+                   ? s + 4
+                   : s->target;
+    }
+
+    static const Step *neg(const Step *s, ClosureEngine &e) {
+        Value &a = e.vm.stack[e.vm.sp - 1];
+        a = a.kind == Value::Kind::Int ? Value::makeInt(-a.i) : Value::makeFloat(-a.f);
+        return s + 1;
+    }
+
+    static const Step *logicalNot(const Step *s, ClosureEngine &e) {
+        Value &a = e.vm.stack[e.vm.sp - 1];
+        a = Value::makeBool(!a.i);
+        return s + 1;
+    }
+
+    static const Step *bitNot(const Step *s, ClosureEngine &e) {
+        Value &a = e.vm.stack[e.vm.sp - 1];
+        a = Value::makeInt(~a.i);
+        return s + 1;
+    }
+
+    template<bool And>
+    static const Step *logical(const Step *s, ClosureEngine &e) {
+        VM &vm = e.vm;
+        Value *t = &vm.stack[--vm.sp - 1];
+        t[0] = Value::makeBool(And ? (t[0].i && t[1].i) : (t[0].i || t[1].i));
+        return s + 1;
+    }
+
+    static const Step *jump(const Step *s, ClosureEngine &) {
+        return s->target;
+    }
+
+    static const Step *jumpIfFalse(const Step *s, ClosureEngine &e) {
+        return e.vm.stack[--e.vm.sp].i == 0 ? s->target : s + 1;
+    }
+
+    static const Step *call(const Step *s, ClosureEngine &e) {
+        VM &vm = e.vm;
+        const VM::CallTarget &f = vm.callTargets[s->a];
+        int argBase = vm.sp - f.paramCount;
+        uint64_t calls = ++vm.profile[s->a].calls;
+        if (vm.tryNative(s->a, argBase))
+            return s + 1;
+        if (!e.compiled[s->a])
+            vm.promote(s->a, VM::Tier::Closure, -1, calls);
+        vm.pushFrame(f, argBase, s->b);
+        return s->target;
+    }
+
+    static const Step *retValue(const Step *, ClosureEngine &e) {
+        VM &vm = e.vm;
+        Value ret = vm.stack[--vm.sp];
+        int ip = vm.popFrame();
+        vm.stack[vm.sp++] = ret;
+        return leave(e, ip);
+    }
+
+    static const Step *retVoid(const Step *s, ClosureEngine &e) {
+        if (e.vm.callStack.empty())
+            return end(s, e);
+        return leave(e, e.vm.popFrame());
+    }
+
+    static const Step *print(const Step *s, ClosureEngine &e) {
+        e.vm.printValue(e.vm.stack[--e.vm.sp]);
+        return s + 1;
+    }
+
+    static const Step *read(const Step *s, ClosureEngine &e) {
+        Value v = e.vm.readInput(static_cast<Op>(s->a));
+        e.vm.stack[e.vm.sp++] = v;
+        return s + 1;
+    }
+
+    static const Step *newArray(const Step *s, ClosureEngine &e) {
+        e.vm.newArray(s->a, s->b);
+        return s + 1;
+    }
+
+    static const Step *loadElem(const Step *s, ClosureEngine &e) {
+        VM &vm = e.vm;
+        Value &idx = vm.stack[vm.sp - 1];
+        const VM::ArrayObject &arr = vm.arrayAt<false>(s->a, "LOAD_ELEM");
+        if (idx.i < 0 || idx.i >= arr.length)
+            throw std::runtime_error("LOAD_ELEM: out of range");
+        idx = arr.load(idx.i);
+        return s + 1;
+    }
+
+    static const Step *storeElem(const Step *s, ClosureEngine &e) {
+        VM &vm = e.vm;
+        vm.sp -= 2;
+        const Value &idx = vm.stack[vm.sp];
+        VM::ArrayObject &arr = vm.arrayAt<false>(s->a, "STORE_ELEM");
+        if (idx.i < 0 || idx.i >= arr.length)
+            throw std::runtime_error("STORE_ELEM: out of range");
+        arr.store(idx.i, vm.stack[vm.sp + 1]);
+        return s + 1;
+    }
+
+    static const Step *loadElemN(const Step *s, ClosureEngine &e) {
+        VM &vm = e.vm;
+        const VM::ArrayObject &arr = vm.arrayAt<false>(s->a, "LOAD_ELEM_N");
+        int flat = vm.flatIndex<false>(arr, e.poliz.getArrayType(s->b), "LOAD_ELEM_N");
+        vm.stack[vm.sp++] = arr.load(flat);
+        return s + 1;
+    }
+
+    static const Step *storeElemN(const Step *s, ClosureEngine &e) {
+        VM &vm = e.vm;
+        Value value = vm.stack[--vm.sp];
+        VM::ArrayObject &arr = vm.arrayAt<false>(s->a, "STORE_ELEM_N");
+        int flat = vm.flatIndex<false>(arr, e.poliz.getArrayType(s->b), "STORE_ELEM_N");
+        arr.store(flat, value);
+        return s + 1;
+    }
+
+    static const Step *callBuiltin(const Step *s, ClosureEngine &e) {
+        e.vm.callBuiltin<false>(static_cast<Builtin>(s->a));
+        return s + 1;
+    }
+
+    static const Step *vectorLoop(const Step *s, ClosureEngine &e) {
+        return e.vm.runVectorLoop(e.poliz.getVectorLoop(s->a)) ? s->target : s + 1;
+    }
+};
+
+
+ClosureEngine::ClosureEngine(VM &vm, const Poliz &poliz)
+    : vm(vm), poliz(poliz), compiled(poliz.functionCount(), false) {
+    steps.resize(poliz.size() + 1);
+    for (Step &s : steps)
+        s.run = &Ops::end;
+}
+
+int ClosureEngine::run(int ip) {
+    const std::size_t outer = stopDepth;
+    stopDepth = vm.callStack.size();
+
+    const Step *s = &steps[ip];
+    uint64_t executed = 0;
+    while (s) {
+        s = s->run(s, *this);
+        ++executed;
+    }
+    vm.dispatched += executed;
+
+    stopDepth = outer;
+    return resumeIp;
+}
+
+void ClosureEngine::compile(int fnIdx) {
+    if (compiled[fnIdx])
+        return;
+    compiled[fnIdx] = true;
+
+    Verifier::FunctionAnalysis a = Verifier::analyze(poliz, fnIdx);
+    if (!a.ok)
+        throw std::runtime_error("ClosureEngine: " + a.error);
+
+    const int codeSize = static_cast<int>(poliz.size());
+    auto opAt = [&](int ip) { return ip < codeSize ? poliz[ip].op : Op::HALT; };
+
+    for (const auto &[ip, st] : a.states) {
+        if (ip >= codeSize)
+            continue;
+        const auto &ins = poliz[ip];
+        Step &s = steps[ip];
+        s = Step{};
+        const int d = static_cast<int>(st.stack.size());
+        const bool intPair = d >= 2 && isIntLike(st.stack[d - 2]) && isIntLike(st.stack[d - 1]);
+        if (ins.op == Op::JUMP || ins.op == Op::JUMP_IF_FALSE)
+            s.target = &steps[*ins.arg1];
+
+        switch (ins.op) {
+            case Op::PUSH_INT:
+                s.imm = VM::Value::makeInt(*ins.arg1);
+                s.run = &Ops::pushConst;
+                break;
+            case Op::PUSH_FLOAT: {
+                int bits = *ins.arg1;
+                float v;
+                std::memcpy(&v, &bits, sizeof(float));
+                s.imm = VM::Value::makeFloat(v);
+                s.run = &Ops::pushConst;
+                break;
+            }
+            case Op::PUSH_BOOL:
+                s.imm = VM::Value::makeBool(*ins.arg1 != 0);
+                s.run = &Ops::pushConst;
+                break;
+            case Op::PUSH_CHAR:
+                s.imm = VM::Value::makeChar(static_cast<char>(*ins.arg1));
+                s.run = &Ops::pushConst;
+                break;
+            case Op::PUSH_STRING:
+                s.imm = VM::Value::makeString(*ins.arg1);
+                s.run = &Ops::pushConst;
+                break;
+
+            case Op::LOAD_VAR: {
+                s.a = *ins.arg1;
+                s.run = &Ops::loadVar;
+
+                const Op next = opAt(ip + 1), op = opAt(ip + 2);
+                const bool rhsVar = next == Op::LOAD_VAR;
+                if (!(rhsVar || next == Op::PUSH_INT) || !isIntLike(st.slots[s.a]))
+                    break;
+                if (rhsVar && !isIntLike(st.slots[*poliz[ip + 1].arg1]))
+                    break;
+                if (rhsVar)
+                    s.b = *poliz[ip + 1].arg1;
+                else
+                    s.imm = VM::Value::makeInt(*poliz[ip + 1].arg1);
+
+                if (isArith(op)) {
+                    const bool store = opAt(ip + 3) == Op::STORE_VAR;
+                    if (store)
+                        s.c = *poliz[ip + 3].arg1;
+                    s.run = forArith(op, [&]<Op O>() -> Handler {
+                        if (rhsVar)
+                            return store ? &Ops::varOp<O, true, true> : &Ops::varOp<O, true, false>;
+                        return store ? &Ops::varOp<O, false, true> : &Ops::varOp<O, false, false>;
+                    });
+                } else if (isCompare(op) && opAt(ip + 3) == Op::JUMP_IF_FALSE) {
+                    s.target = &steps[*poliz[ip + 3].arg1];
+                    s.run = forCompare(op, [&]<Op O>() -> Handler {
+                        return rhsVar ? &Ops::varBranch<O, true> : &Ops::varBranch<O, false>;
+                    });
+                }
+                break;
+            }
+            case Op::STORE_VAR:
+                s.a = *ins.arg1;
+                s.run = &Ops::storeVar;
+                break;
+
+            case Op::ADD:
+            case Op::SUB:
+            case Op::MUL:
+            case Op::DIV:
+                s.run = forInt(ins.op, [&]<Op O>() -> Handler {
+                    if constexpr (O == Op::ADD || O == Op::SUB || O == Op::MUL || O == Op::DIV)
+                        return intPair ? &Ops::intBinary<O> : &Ops::numBinary<O>;
+                    else
+                        return &Ops::intBinary<O>;
+                });
+                break;
+            case Op::MOD:
+            case Op::AND:
+            case Op::OR:
+            case Op::XOR:
+            case Op::SHL:
+            case Op::SHR:
+                s.run = forInt(ins.op, []<Op O>() -> Handler { return &Ops::intBinary<O>; });
+                break;
+
+            case Op::CMP_EQ:
+            case Op::CMP_NE:
+            case Op::CMP_LT:
+            case Op::CMP_LE:
+            case Op::CMP_GT:
+            case Op::CMP_GE: {
+                const bool branch = opAt(ip + 1) == Op::JUMP_IF_FALSE;
+                if (branch)
+                    s.target = &steps[*poliz[ip + 1].arg1];
+                s.run = forCompare(ins.op, [&]<Op O>() -> Handler {
+                    if (branch)
+                        return intPair ? &Ops::cmpBranch<O, true> : &Ops::cmpBranch<O, false>;
+                    return intPair ? &Ops::cmp<O, true> : &Ops::cmp<O, false>;
+                });
+                break;
+            }
+
+            case Op::NEG:     s.run = &Ops::neg; break;
+            case Op::NOT:     s.run = &Ops::logicalNot; break;
+            case Op::BNOT:    s.run = &Ops::bitNot; break;
+            case Op::LOG_AND: s.run = &Ops::logical<true>; break;
+            case Op::LOG_OR:  s.run = &Ops::logical<false>; break;
+
+            case Op::JUMP:          s.run = &Ops::jump; break;
+            case Op::JUMP_IF_FALSE: s.run = &Ops::jumpIfFalse; break;
+
+            case Op::CALL:
+                s.a = *ins.arg1;
+                s.b = ip + 1;
+                s.target = &steps[poliz.getFunction(s.a).entryIp];
+                s.run = &Ops::call;
+                break;
+            case Op::RET_VALUE: s.run = &Ops::retValue; break;
+            case Op::RET_VOID:  s.run = &Ops::retVoid; break;
+
+            case Op::PRINT: s.run = &Ops::print; break;
+            case Op::READ_INT:
+            case Op::READ_FLOAT:
+            case Op::READ_BOOL:
+            case Op::READ_CHAR:
+            case Op::READ_STRING:
+                s.a = static_cast<int>(ins.op);
+                s.run = &Ops::read;
+                break;
+
+            case Op::NEW_ARRAY:
+            case Op::LOAD_ELEM:
+            case Op::STORE_ELEM:
+            case Op::LOAD_ELEM_N:
+            case Op::STORE_ELEM_N:
+                s.a = *ins.arg1;
+                s.b = ins.arg2.value_or(0);
+                s.run = ins.op == Op::NEW_ARRAY     ? &Ops::newArray
+                      : ins.op == Op::LOAD_ELEM     ? &Ops::loadElem
+                      : ins.op == Op::STORE_ELEM    ? &Ops::storeElem
+                      : ins.op == Op::LOAD_ELEM_N   ? &Ops::loadElemN
+                                                    : &Ops::storeElemN;
+                break;
+
+            case Op::CALL_BUILTIN:
+                s.a = *ins.arg1;
+                s.run = &Ops::callBuiltin;
+                break;
+            case Op::VEC_LOOP:
+                s.a = *ins.arg1;
+                s.target = &steps[*ins.arg2];
+                s.run = &Ops::vectorLoop;
+                break;
+
+            case Op::NOP:  s.run = &Ops::nop; break;
+            case Op::HALT: s.run = &Ops::end; break;
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "vm.hpp"
+#include <vector>
+
+
+// Portable alternative to VM::execute for verified code. Every instruction
+// is pre-compiled into a Step: a plain function pointer with its operands
+// already decoded and, for jumps, the destination Step resolved. Where the
+// verifier proves both operands are int-like, arithmetic and compares get
+// handlers without a kind test, and the common sequences inside a basic
+// block (`x op k`, `x op y`, compare-and-branch) are fused into one Step.
+//
+// Steps are laid out parallel to the Poliz code, so a fused Step simply
+// skips ahead and a branch into the middle of a fused run still lands on
+// the plain Step for that ip. It works on the VM's own stack, heap and
+// frames, so calls can move between engines at a frame boundary.
+class ClosureEngine {
+public:
+    ClosureEngine(VM &vm, const Poliz &poliz);
+
+    // Builds the Steps for one function; calls compile their callee on
+    // first use, so only code that actually runs here gets compiled.
+    void compile(int fnIdx);
+
+    // Runs from ip, which must lie in a compiled function, until the frame
+    // that is current on entry returns. Returns the ip the caller should
+    // resume at: the return address of that frame, or the end of the code
+    // once the program has finished.
+    int run(int ip);
+
+private:
+    struct Step;
+    struct Ops;
+
+    using Handler = const Step *(*)(const Step *s, ClosureEngine &e);
+
+    struct Step {
+        Handler run = nullptr;
+        int a = 0;
+        int b = 0;
+        int c = 0;
+        VM::Value imm;
+        const Step *target = nullptr;
+    };
+
+    VM &vm;
+    const Poliz &poliz;
+    std::vector<Step> steps;
+    std::vector<bool> compiled;
+    std::size_t stopDepth = 0;
+    int resumeIp = 0;
+};
@@ -0,0 +1,196 @@
+#include "incremental.hpp"
+#include "verifier.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+
+IncrementalCompiler::IncrementalCompiler(const std::string &filename, const std::string &keywordFile) {
+    std::ifstream file(filename, std::ios::binary);
+    if (file.is_open())
+        text = std::make_shared<std::string>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    else {
+        std::cerr << "Error: cannot open " << filename << std::endl;
+        text = std::make_shared<std::string>();
+    }
+    lines = std::make_shared<LineIndex>(text->data(), text->size());
+    lexer = std::make_unique<Lexer>(text, lines, keywordFile);
+}
+
+bool IncrementalCompiler::compile() {
+    compiled = incremental = false;
+    bodies.clear();
+    sem = std::make_unique<Semanter>();
+    poliz = Poliz();
+    failedBodies = unverifiedBodies = deadCode = 0;
+
+    try {
+        lexer->reset(text, lines, 0);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return false;
+    }
+
+    std::vector<Parser::Unit> units;
+    Parser parser(*lexer, *sem, poliz);
+    parser.setVectorize(vectorize);
+    parser.setUnits(&units);
+    if (!parser.parseProgram())
+        return false;
+
+    for (Parser::Unit &u : units) {
+        bodies.push_back({std::move(u)});
+        verify(bodies.back());
+    }
+    poliz.setVerified(unverifiedBodies == 0);
+    compiled = true;
+    return true;
+}
+
+bool IncrementalCompiler::edit(std::size_t offset, std::size_t length, const std::string &insert) {
+    if (offset > text->size() || length > text->size() - offset)
+        throw std::out_of_range("edit past the end of the source");
+
+    incremental = false;
+    Body *b = compiled ? enclosing(offset, length) : nullptr;
+
+    text->replace(offset, length, insert);
+    lines->replace(static_cast<int>(offset), static_cast<int>(length), insert.data(), insert.size());
+
+    if (!b || !relex(*b, static_cast<int>(offset), static_cast<int>(length), static_cast<int>(insert.size())))
+        return compile();
+
+    int delta = static_cast<int>(insert.size()) - static_cast<int>(length);
+    for (Body *later = b + 1; later != bodies.data() + bodies.size(); ++later)
+        later->shift += delta;
+
+    incremental = true;
+    return recompile(*b);
+}
+
+// The body the bytes [offset, offset + length) lie in, strictly between
+// its braces, if any.
+IncrementalCompiler::Body *IncrementalCompiler::enclosing(std::size_t offset, std::size_t length) {
+    auto it = std::upper_bound(bodies.begin(), bodies.end(), offset, [](std::size_t at, const Body &b) {
+        return static_cast<int>(at) <= b.unit.tokens.front().offset + b.shift;
+    });
+    if (it == bodies.begin())
+        return nullptr;
+    Body &b = *(it - 1);
+    std::size_t close = static_cast<std::size_t>(b.unit.tokens.back().offset + b.shift);
+    return offset + length <= close ? &b : nullptr;
+}
+
+// Re-lexes `b` after `removed` bytes at `offset` became `added` bytes,
+// from the last token starting before the edit -- which the edit may have
+// extended -- until a token starts where an old one after the edit now
+// does; from there on the old tokens stand, moved along. False if the
+// tokens run past the body's closing brace first, no longer pair its
+// braces, or a lexical error stops them.
+bool IncrementalCompiler::relex(Body &b, int offset, int removed, int added) {
+    std::vector<Token> &old = b.unit.tokens;
+    if (b.shift) {
+        for (Token &t : old)
+            t.offset += b.shift;
+        b.shift = 0;
+    }
+
+    const int delta = added - removed;
+    auto before = [](const Token &t, int at) { return t.offset < at; };
+    std::size_t first = std::lower_bound(old.begin(), old.end(), offset, before) - old.begin() - 1;
+    std::size_t next = std::lower_bound(old.begin(), old.end(), offset + removed, before) - old.begin();
+    const int close = old.back().offset + delta;
+
+    std::vector<Token> fresh;
+    try {
+        lexer->reset(text, lines, static_cast<std::size_t>(old[first].offset));
+        for (Token t = lexer->currentLexeme();; t = lexer->nextLexem()) {
+            if (t.type == Token::Type::EndOfFile || t.offset > close)
+                return false;
+            while (next < old.size() && old[next].offset + delta < t.offset)
+                ++next;
+            if (next < old.size() && old[next].offset + delta == t.offset)
+                break;
+            fresh.push_back(std::move(t));
+        }
+    } catch (const std::exception &) {
+        return false;
+    }
+
+    for (std::size_t k = next; k < old.size(); ++k)
+        old[k].offset += delta;
+    old.erase(old.begin() + static_cast<std::ptrdiff_t>(first), old.begin() + static_cast<std::ptrdiff_t>(next));
+    old.insert(old.begin() + static_cast<std::ptrdiff_t>(first), std::make_move_iterator(fresh.begin()),
+               std::make_move_iterator(fresh.end()));
+
+    int depth = 0;
+    for (std::size_t k = 0; k < old.size(); ++k) {
+        if (old[k].type == Token::Type::LBrace)
+            ++depth;
+        else if (old[k].type == Token::Type::RBrace && --depth == 0 && k + 1 != old.size())
+            return false;
+    }
+    return depth == 0;
+}
+
+// Compiles b's tokens as parseDefinitionsParallel would and appends the
+// code, followed by a HALT for its jump over the body to land on. The
+// function's entry moves there; the old code stays, unreachable, until
+// the next full compile.
+bool IncrementalCompiler::recompile(Body &b) {
+    std::vector<Token> tokens = b.unit.tokens;
+    Token end = tokens.back();
+    end.type = Token::Type::EndOfFile;
+    end.lexeme.clear();
+    tokens.push_back(std::move(end));
+
+    Parser::FunctionDef def = b.unit.def;
+    Poliz code;
+    try {
+        Parser::compileBody(std::move(tokens), *sem, def, code, vectorize);
+    } catch (const CompileError &e) {
+        std::cerr << "Error at " << e.pos.line << ":" << e.pos.column << "\n" << e.what() << "\n";
+        if (!b.failed)
+            ++failedBodies;
+        b.failed = true;
+        return false;
+    }
+    if (b.failed)
+        --failedBodies;
+    b.failed = false;
+
+    int base = poliz.append(code);
+    poliz.emit(Poliz::Op::HALT);
+    deadCode += b.unit.codeEnd - b.unit.codeBegin;
+    b.unit.codeBegin = base;
+    b.unit.codeEnd = poliz.currentIp();
+
+    def.entryIp += base;
+    def.symbol->entryIp = def.entryIp;
+    poliz.setFunctionEntry(def.symbol->polizIndex, def.entryIp);
+    poliz.setFunctionFrame(def.symbol->polizIndex, def.frameSize);
+    if (&b == &bodies.back())
+        poliz.patchJump(0, def.entryIp);
+    b.unit.def = std::move(def);
+
+    if (!b.verified)
+        --unverifiedBodies;
+    verify(b);
+    poliz.setVerified(unverifiedBodies == 0);
+
+    if (failedBodies == 0 && deadCode > poliz.currentIp() - deadCode)
+        return compile();
+    return failedBodies == 0;
+}
+
+void IncrementalCompiler::verify(Body &b) {
+    int index = b.unit.def.symbol->polizIndex;
+    Verifier::FunctionAnalysis a = Verifier::analyze(poliz, index);
+    b.verified = a.ok;
+    if (a.ok)
+        poliz.setFunctionMaxStack(index, a.maxDepth);
+    else
+        ++unverifiedBodies;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "poliz.hpp"
+#include "semanter.hpp"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// Keeps a compiled program up to date while its source is edited. The
+// full compile records every function body (Parser::Unit). An edit inside
+// one body re-lexes from the token before it until the new tokens fall
+// back in step with the old ones, re-parses that body alone, and appends
+// its code to the program, pointing the function at it. Anything else --
+// an edit reaching a header or the braces of a body, one that changes
+// which braces pair up, a lexical error -- compiles the whole source
+// again, as does the replaced code outgrowing the live code.
+class IncrementalCompiler {
+public:
+    IncrementalCompiler(const std::string &filename, const std::string &keywordFile);
+
+    IncrementalCompiler(const IncrementalCompiler &) = delete;
+    IncrementalCompiler &operator=(const IncrementalCompiler &) = delete;
+
+    void setVectorize(bool on) { vectorize = on; }
+
+    // Compiles the whole source, reporting errors as parseProgram does.
+    bool compile();
+
+    // Replaces `length` bytes at `offset` with `text` and brings the
+    // program up to date. Returns whether the source now compiles; an
+    // error in the edited body is reported at its position.
+    bool edit(std::size_t offset, std::size_t length, const std::string &text);
+
+    // Whether the last edit() recompiled only the body it was in.
+    bool lastEditIncremental() const { return incremental; }
+
+    // The program, each body in it as last compiled without errors; it is
+    // the current source's while compile() or edit() last returned true.
+    // Verified if every body passes the Verifier.
+    const Poliz &program() const { return poliz; }
+
+    const std::string &source() const { return *text; }
+
+private:
+    struct Body {
+        Parser::Unit unit;
+        int shift = 0;          // still to be added to the offsets of unit.tokens
+        bool failed = false;    // did not compile; unit.code* is its last good code
+        bool verified = false;
+    };
+
+    std::shared_ptr<std::string> text;
+    std::shared_ptr<LineIndex> lines;
+    std::unique_ptr<Lexer> lexer;
+    std::unique_ptr<Semanter> sem;
+    Poliz poliz;
+    std::vector<Body> bodies;   // in source order, main last
+    bool vectorize = true;
+    bool compiled = false;      // bodies match the source
+    bool incremental = false;
+    int failedBodies = 0;
+    int unverifiedBodies = 0;
+    int deadCode = 0;           // instructions of replaced bodies
+
+    Body *enclosing(std::size_t offset, std::size_t length);
+    bool relex(Body &b, int offset, int removed, int added);
+    bool recompile(Body &b);
+    void verify(Body &b);
+};
@@ -0,0 +1,255 @@
+#include "input.hpp"
+#include "ring.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cfloat>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+
+namespace {
+    constexpr std::size_t chunkSize = 1 << 16;
+
+    bool isSpace(char c) {
+        return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    bool isHexDigit(char c) {
+        return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+    }
+}
+
+
+// One read(2) worth of input, cut after its last whitespace so no token
+// straddles two blocks; the cut-off tail starts the next block.
+struct InputBuffer::Block {
+    std::vector<char> data;
+    std::size_t size = 0;
+    bool last = false;      // end of input (or a read error) follows
+    std::string error;
+};
+
+// Shared by the VM thread and the reader thread, which owns a reference so
+// the reader can outlive an InputBuffer it is blocked in read(2) for.
+struct InputBuffer::Prefetcher {
+    static constexpr std::size_t blockCount = 8;
+
+    int fd;
+    std::array<Block, blockCount> blocks;
+    SpscRing<Block *, blockCount> filled;   // reader -> VM
+    SpscRing<Block *, blockCount> spare;    // VM -> reader
+    std::atomic<bool> stop{false};
+
+    explicit Prefetcher(int fd) : fd(fd) {
+        for (Block &b : blocks)
+            spare.push(&b);
+    }
+
+    void run();
+};
+
+void InputBuffer::Prefetcher::run() {
+    std::vector<char> carry;
+    for (;;) {
+        Block *b = spare.pop();
+        if (stop.load(std::memory_order_relaxed))
+            return;
+
+        if (b->data.size() < carry.size() + chunkSize)
+            b->data.resize(carry.size() + chunkSize);
+        std::copy(carry.begin(), carry.end(), b->data.begin());
+
+        ssize_t n;
+        do {
+            n = ::read(fd, b->data.data() + carry.size(), chunkSize);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0)
+            b->error = std::string("Input: read failed: ") + std::strerror(errno);
+        b->size = carry.size() + std::max<ssize_t>(n, 0);
+        b->last = n <= 0;
+
+        carry.clear();
+        if (!b->last) {
+            const char *p = b->data.data(), *e = p + b->size;
+            while (e > p && !isSpace(e[-1]))
+                --e;
+            carry.assign(e, p + b->size);
+            b->size = e - p;
+        }
+        filled.push(b);
+        if (b->last)
+            return;
+    }
+}
+
+
+InputBuffer::InputBuffer(int fd, bool prefetch) : prefetch(prefetch) {
+    attach(fd);
+}
+
+InputBuffer::~InputBuffer() {
+    detach();
+}
+
+void InputBuffer::reset(int newFd) {
+    detach();
+    attach(newFd);
+}
+
+void InputBuffer::attach(int newFd) {
+    fd = newFd;
+    struct stat st;
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && offset >= 0 && st.st_size > offset) {
+        void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+            mapped = static_cast<char *>(p);
+            mappedSize = st.st_size;
+            cur = mapped + offset;
+            end = mapped + mappedSize;
+            return;
+        }
+    }
+    if (prefetch) {
+        prefetcher = std::make_shared<Prefetcher>(fd);
+        std::thread([p = prefetcher] { p->run(); }).detach();
+        return;
+    }
+    chunk.resize(chunkSize);
+    cur = end = chunk.data();
+}
+
+void InputBuffer::detach() {
+    if (mapped) {
+        munmap(mapped, mappedSize);
+        mapped = nullptr;
+        mappedSize = 0;
+    }
+    if (prefetcher) {
+        // Hand every block back so a reader waiting for one wakes up and
+        // sees `stop`; one blocked in read(2) exits after it returns.
+        prefetcher->stop.store(true, std::memory_order_relaxed);
+        Block *b;
+        while (prefetcher->filled.tryPop(b))
+            prefetcher->spare.push(b);
+        if (block)
+            prefetcher->spare.push(block);
+        prefetcher.reset();
+        block = nullptr;
+    }
+    cur = end = nullptr;
+    eof = false;
+}
+
+// Moves on to the reader's next block. Returns false at end of input.
+bool InputBuffer::nextBlock() {
+    if (block) {
+        if (block->last) {
+            if (!block->error.empty())
+                throw std::runtime_error(block->error);
+            return false;
+        }
+        prefetcher->spare.push(block);
+    }
+    block = prefetcher->filled.pop();
+    cur = block->data.data();
+    end = cur + block->size;
+    return true;
+}
+
+// Reads more input, first moving the bytes from `keep` on (a token cut by
+// the end of the chunk) to the front. Returns false at end of input.
+bool InputBuffer::refill(const char *&keep) {
+    // Prefetched blocks end between tokens, so only the outer loop of
+    // next() asks for more, and has nothing to keep.
+    if (prefetcher)
+        return nextBlock();
+    if (mapped || eof)
+        return false;
+
+    std::size_t kept = end - keep;
+    std::size_t scanned = cur - keep;
+    std::memmove(chunk.data(), keep, kept);
+    if (kept == chunk.size())
+        chunk.resize(chunk.size() * 2);
+
+    ssize_t n;
+    do {
+        n = ::read(fd, chunk.data() + kept, chunk.size() - kept);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+        throw std::runtime_error(std::string("Input: read failed: ") + std::strerror(errno));
+
+    keep = chunk.data();
+    cur = keep + scanned;
+    end = keep + kept + n;
+    eof = n == 0;
+    return !eof;
+}
+
+std::string_view InputBuffer::next() {
+    for (;;) {
+        while (cur < end && isSpace(*cur))
+            ++cur;
+        if (cur < end)
+            break;
+        const char *none = cur;
+        if (!refill(none))
+            throw std::runtime_error("Input exhausted");
+    }
+
+    const char *start = cur;
+    for (;;) {
+        while (cur < end && !isSpace(*cur))
+            ++cur;
+        if (cur < end || !refill(start))
+            break;
+    }
+    return {start, static_cast<std::size_t>(cur - start)};
+}
+
+int32_t InputBuffer::nextInt() {
+    std::string_view s = next();
+    const char *p = s.data(), *e = p + s.size();
+    if (p != e && *p == '+' && e - p > 1 && p[1] != '-')
+        ++p;
+
+    int32_t v;
+    if (std::from_chars(p, e, v).ec != std::errc())
+        throw std::runtime_error("Invalid int input: " + std::string(s));
+    return v;
+}
+
+float InputBuffer::nextFloat() {
+    std::string_view s = next();
+    const char *p = s.data(), *e = p + s.size();
+    bool negative = false;
+    if (p != e && (*p == '+' || *p == '-')) {
+        negative = *p == '-';
+        ++p;
+    }
+
+    auto format = std::chars_format::general;
+    if (e - p > 2 && p[0] == '0' && (p[1] | 0x20) == 'x' && (isHexDigit(p[2]) || p[2] == '.')) {
+        format = std::chars_format::hex;
+        p += 2;
+    }
+
+    // strtof, and so std::stof, also rejects results that underflow into
+    // the subnormal range.
+    float v;
+    if (p == e || *p == '-' || std::from_chars(p, e, v, format).ec != std::errc() ||
+        (v != 0 && std::fabs(v) < FLT_MIN))
+        throw std::runtime_error("Invalid float input: " + std::string(s));
+    return negative ? -v : v;
+}
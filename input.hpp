@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+
+// Whitespace-separated tokens for the READ_* instructions. A regular file
+// on `fd` is mapped whole; anything else (a pipe, a terminal) is read in
+// large chunks. Tokens are views into that memory, so reading one costs
+// no allocation, and numbers are parsed in place with std::from_chars.
+//
+// With `prefetch`, input that is not a regular file is read by a background
+// thread, which cuts it into blocks of whole tokens and hands them to the
+// VM thread through an SpscRing; the VM only waits when it has caught up.
+class InputBuffer {
+public:
+    explicit InputBuffer(int fd, bool prefetch = false);
+    ~InputBuffer();
+
+    InputBuffer(const InputBuffer &) = delete;
+    InputBuffer &operator=(const InputBuffer &) = delete;
+
+    // Drops what is left of the current input and reads from `fd` instead.
+    // Like the constructor, does not take ownership of `fd`.
+    void reset(int fd);
+
+    // The next token; valid until the following call.
+    std::string_view next();
+
+    // Parse the next token the way std::stoi / std::stof did: an optional
+    // sign, then the longest valid prefix; for floats also inf, nan and
+    // hex. Throws "Invalid int input: <token>" and the float equivalent.
+    int32_t nextInt();
+    float   nextFloat();
+
+private:
+    int fd = -1;
+    bool prefetch;
+    char *mapped = nullptr;
+    std::size_t mappedSize = 0;
+    std::vector<char> chunk;
+    const char *cur = nullptr;
+    const char *end = nullptr;
+    bool eof = false;
+
+    struct Block;
+    struct Prefetcher;
+    std::shared_ptr<Prefetcher> prefetcher;
+    Block *block = nullptr;
+
+    void attach(int fd);
+    void detach();
+    bool refill(const char *&keep);
+    bool nextBlock();
+};
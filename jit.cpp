@@ -0,0 +1,488 @@
+#include "jit.hpp"
+#include "verifier.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <map>
+#include <unordered_map>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define JIT_X86_64 1
+#endif
+
+
+namespace {
+    using Op = Poliz::Op;
+    using Analysis = Verifier::FunctionAnalysis;
+
+    constexpr Verifier::KindMask scalarKinds = Verifier::KInt | Verifier::KChar | Verifier::KBool;
+
+    const char *const divisionByZero = "VM: division by zero";
+    const char *const moduloByZero   = "VM: modulo by zero";
+
+    bool inSubset(Op op) {
+        switch (op) {
+            case Op::PUSH_INT: case Op::PUSH_BOOL:
+            case Op::LOAD_VAR: case Op::STORE_VAR:
+            case Op::ADD: case Op::SUB: case Op::MUL: case Op::DIV: case Op::MOD:
+            case Op::NEG: case Op::NOT: case Op::BNOT:
+            case Op::CMP_EQ: case Op::CMP_NE: case Op::CMP_LT:
+            case Op::CMP_LE: case Op::CMP_GT: case Op::CMP_GE:
+            case Op::LOG_AND: case Op::LOG_OR:
+            case Op::AND: case Op::OR: case Op::XOR: case Op::SHL: case Op::SHR:
+            case Op::JUMP: case Op::JUMP_IF_FALSE:
+            case Op::CALL: case Op::RET_VOID: case Op::RET_VALUE:
+            case Op::NOP:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    bool isIntScalar(const TypeInfo &t) {
+        return !t.isArray && t.baseType == Token::Type::KwInt;
+    }
+
+    bool signatureOk(const Poliz::FunctionInfo &f) {
+        if (f.entryIp < 0 || f.paramCount > Jit::maxParams)
+            return false;
+        for (const auto &p : f.paramTypes)
+            if (!isIntScalar(p))
+                return false;
+        return f.returnType.isVoid() || isIntScalar(f.returnType);
+    }
+
+    // Values are carried as bare int32 in native code, so every stack cell
+    // and local must be int-like. Char never materialises at run time: there
+    // is no char source in the subset and the interpreter only enters native
+    // code with Int arguments.
+    bool bodyOk(const Poliz &poliz, const Analysis &a) {
+        if (!a.ok)
+            return false;
+        for (const auto &[ip, st] : a.states) {
+            if (ip >= static_cast<int>(poliz.size()) || !inSubset(poliz[ip].op))
+                return false;
+            for (auto k : st.stack)
+                if (k & ~scalarKinds)
+                    return false;
+            for (auto k : st.slots)
+                if (k & ~scalarKinds)
+                    return false;
+            // The VM negates a Bool as if it were a float.
+            if (poliz[ip].op == Op::NEG && (st.stack.back() & Verifier::KBool))
+                return false;
+        }
+        return true;
+    }
+
+    // Gathers fnIdx and every not yet compiled function reachable from it.
+    bool collect(const Poliz &poliz, const std::vector<Jit::Entry> &entries, int fnIdx,
+                 std::vector<int> &unit, std::unordered_map<int, Analysis> &analyses) {
+        if (entries[fnIdx] || analyses.contains(fnIdx))
+            return true;
+        if (!signatureOk(poliz.getFunction(fnIdx)))
+            return false;
+
+        const Analysis &a = analyses[fnIdx] = Verifier::analyze(poliz, fnIdx);
+        if (!bodyOk(poliz, a))
+            return false;
+        unit.push_back(fnIdx);
+
+        for (const auto &[ip, st] : a.states)
+            if (poliz[ip].op == Op::CALL &&
+                !collect(poliz, entries, *poliz[ip].arg1, unit, analyses))
+                return false;
+        return true;
+    }
+
+
+    class Assembler {
+    public:
+        enum Reg { EAX = 0, ECX = 1, EDX = 2, ESI = 6 };
+
+        std::vector<uint8_t> code;
+
+        void bytes(std::initializer_list<int> bs) {
+            for (int b : bs)
+                code.push_back(static_cast<uint8_t>(b));
+        }
+
+        void imm32(int32_t v) {
+            uint8_t raw[4];
+            std::memcpy(raw, &v, 4);
+            code.insert(code.end(), raw, raw + 4);
+        }
+
+        void imm64(uint64_t v) {
+            uint8_t raw[8];
+            std::memcpy(raw, &v, 8);
+            code.insert(code.end(), raw, raw + 8);
+        }
+
+        // <opcode> reg, [rbx + disp32]
+        void rbx(std::initializer_list<int> opcode, int reg, int32_t disp) {
+            bytes(opcode);
+            bytes({0x80 | (reg << 3) | 3});
+            imm32(disp);
+        }
+
+        int label() {
+            labels.push_back(-1);
+            return static_cast<int>(labels.size()) - 1;
+        }
+
+        void bind(int l) { labels[l] = static_cast<int>(code.size()); }
+
+        // <opcode> rel32 to label l.
+        void jump(std::initializer_list<int> opcode, int l) {
+            bytes(opcode);
+            fixups.push_back({static_cast<int>(code.size()), l});
+            imm32(0);
+        }
+
+        void resolve() {
+            for (auto [at, l] : fixups) {
+                int32_t rel = labels[l] - (at + 4);
+                std::memcpy(&code[at], &rel, 4);
+            }
+            fixups.clear();
+        }
+
+    private:
+        std::vector<int> labels;
+        std::vector<std::pair<int, int>> fixups;
+    };
+
+
+    class FunctionEmitter {
+    public:
+        FunctionEmitter(Assembler &as, const Poliz &poliz, const Poliz::FunctionInfo &fn,
+                        const Analysis &a, const std::vector<Jit::Entry> &entries)
+            : as(as), poliz(poliz), fn(fn), entries(entries),
+              states(a.states.begin(), a.states.end()) {
+            frameBytes = 4 * (fn.frameSize + a.maxDepth);
+            frameBytes = std::max(16, (frameBytes + 15) & ~15);
+        }
+
+        void emit() {
+            for (const auto &[ip, st] : states)
+                labels[ip] = as.label();
+            epilogue = as.label();
+            propagate = as.label();
+            setError = as.label();
+            divZero = as.label();
+            modZero = as.label();
+            overflow = as.label();
+
+            prologue();
+            for (const auto &[ip, st] : states) {
+                as.bind(labels[ip]);
+                instruction(ip, static_cast<int>(st.stack.size()));
+            }
+            tail();
+        }
+
+    private:
+        Assembler &as;
+        const Poliz &poliz;
+        const Poliz::FunctionInfo &fn;
+        const std::vector<Jit::Entry> &entries;
+        std::map<int, Verifier::State> states;
+        std::unordered_map<int, int> labels;
+        int frameBytes;
+        int epilogue, propagate, setError, divZero, modZero, overflow;
+
+        int32_t slot(int s) const { return 4 * s; }
+        int32_t cell(int depth) const { return 4 * (fn.frameSize + depth); }
+
+        // Two-operand ALU op: [cell(d-2)] = [cell(d-2)] op [cell(d-1)].
+        void binary(std::initializer_list<int> opcode, int d) {
+            as.rbx({0x8B}, Assembler::EAX, cell(d - 2));
+            as.rbx(opcode, Assembler::EAX, cell(d - 1));
+            as.rbx({0x89}, Assembler::EAX, cell(d - 2));
+        }
+
+        // The VM compares ints by converting both sides to float.
+        void compare(int setcc, int d) {
+            as.rbx({0xF3, 0x0F, 0x2A}, 0, cell(d - 2));    // cvtsi2ss xmm0, a
+            as.rbx({0xF3, 0x0F, 0x2A}, 1, cell(d - 1));    // cvtsi2ss xmm1, b
+            as.bytes({0x0F, 0x2E, 0xC1});                  // ucomiss xmm0, xmm1
+            as.bytes({0x0F, setcc, 0xC0});                 // setcc al
+            storeAl(d - 2);
+        }
+
+        void storeAl(int depth) {
+            as.bytes({0x0F, 0xB6, 0xC0});                  // movzx eax, al
+            as.rbx({0x89}, Assembler::EAX, cell(depth));
+        }
+
+        void testCell(int reg, int depth) {
+            as.rbx({0x8B}, reg, cell(depth));
+            as.bytes({0x85, 0xC0 | (reg << 3) | reg});     // test reg, reg
+        }
+
+        void prologue() {
+            as.bytes({0x55});                              // push rbp
+            as.bytes({0x48, 0x89, 0xE5});                  // mov rbp, rsp
+            as.bytes({0x53});                              // push rbx
+            as.bytes({0x41, 0x54});                        // push r12
+            as.bytes({0x48, 0x81, 0xEC});                  // sub rsp, frame
+            as.imm32(frameBytes);
+            as.bytes({0x48, 0x89, 0xE3});                  // mov rbx, rsp
+            as.bytes({0x49, 0x89, 0xFC});                  // mov r12, rdi
+            as.bytes({0x49, 0x3B, 0x64, 0x24, 0x08});      // cmp rsp, [r12 + stackLimit]
+            as.jump({0x0F, 0x82}, overflow);               // jb
+
+            for (int p = 0; p < fn.paramCount; ++p) {
+                as.bytes({0x8B, 0x86});                    // mov eax, [rsi + 4p]
+                as.imm32(4 * p);
+                as.rbx({0x89}, Assembler::EAX, slot(p));
+            }
+            for (int s = fn.paramCount; s < fn.frameSize; ++s) {
+                as.rbx({0xC7}, 0, slot(s));                // mov dword [slot], 0
+                as.imm32(0);
+            }
+            as.jump({0xE9}, labels.at(fn.entryIp));
+        }
+
+        void tail() {
+            as.bind(epilogue);
+            as.bytes({0x48, 0x8D, 0x65, 0xF0});            // lea rsp, [rbp - 16]
+            as.bytes({0x41, 0x5C});                        // pop r12
+            as.bytes({0x5B});                              // pop rbx
+            as.bytes({0x5D});                              // pop rbp
+            as.bytes({0xC3});                              // ret
+
+            for (auto [l, msg] : {std::pair{divZero, divisionByZero},
+                                  std::pair{modZero, moduloByZero},
+                                  std::pair{overflow, Jit::stackExhausted}}) {
+                as.bind(l);
+                as.bytes({0x48, 0xB8});                    // mov rax, msg
+                as.imm64(reinterpret_cast<uint64_t>(msg));
+                as.jump({0xE9}, setError);
+            }
+
+            as.bind(setError);
+            as.bytes({0x49, 0x89, 0x04, 0x24});            // mov [r12 + error], rax
+            as.bind(propagate);
+            as.bytes({0x31, 0xC0});                        // xor eax, eax
+            as.jump({0xE9}, epilogue);
+        }
+
+        void instruction(int ip, int d) {
+            const auto &ins = poliz[ip];
+            switch (ins.op) {
+                case Op::PUSH_INT:
+                case Op::PUSH_BOOL:
+                    as.rbx({0xC7}, 0, cell(d));
+                    as.imm32(*ins.arg1);
+                    break;
+
+                case Op::LOAD_VAR:
+                    as.rbx({0x8B}, Assembler::EAX, slot(*ins.arg1));
+                    as.rbx({0x89}, Assembler::EAX, cell(d));
+                    break;
+
+                case Op::STORE_VAR:
+                    as.rbx({0x8B}, Assembler::EAX, cell(d - 1));
+                    as.rbx({0x89}, Assembler::EAX, slot(*ins.arg1));
+                    break;
+
+                case Op::ADD: binary({0x03}, d); break;
+                case Op::SUB: binary({0x2B}, d); break;
+                case Op::MUL: binary({0x0F, 0xAF}, d); break;
+                case Op::AND: binary({0x23}, d); break;
+                case Op::OR:  binary({0x0B}, d); break;
+                case Op::XOR: binary({0x33}, d); break;
+
+                case Op::SHL:
+                case Op::SHR:
+                    as.rbx({0x8B}, Assembler::ECX, cell(d - 1));
+                    as.rbx({0x8B}, Assembler::EAX, cell(d - 2));
+                    as.bytes({0xD3, ins.op == Op::SHL ? 0xE0 : 0xF8});   // shl/sar eax, cl
+                    as.rbx({0x89}, Assembler::EAX, cell(d - 2));
+                    break;
+
+                case Op::DIV:
+                case Op::MOD:
+                    testCell(Assembler::ECX, d - 1);
+                    as.jump({0x0F, 0x84}, ins.op == Op::DIV ? divZero : modZero);
+                    as.rbx({0x8B}, Assembler::EAX, cell(d - 2));
+                    as.bytes({0x99});                      // cdq
+                    as.bytes({0xF7, 0xF9});                // idiv ecx
+                    as.rbx({0x89}, ins.op == Op::DIV ? Assembler::EAX : Assembler::EDX, cell(d - 2));
+                    break;
+
+                case Op::NEG:
+                case Op::BNOT:
+                    as.rbx({0x8B}, Assembler::EAX, cell(d - 1));
+                    as.bytes({0xF7, ins.op == Op::NEG ? 0xD8 : 0xD0});   // neg/not eax
+                    as.rbx({0x89}, Assembler::EAX, cell(d - 1));
+                    break;
+
+                case Op::NOT:
+                    testCell(Assembler::EAX, d - 1);
+                    as.bytes({0x0F, 0x94, 0xC0});          // sete al
+                    storeAl(d - 1);
+                    break;
+
+                case Op::CMP_EQ: compare(0x94, d); break;  // sete
+                case Op::CMP_NE: compare(0x95, d); break;  // setne
+                case Op::CMP_LT: compare(0x92, d); break;  // setb
+                case Op::CMP_LE: compare(0x96, d); break;  // setbe
+                case Op::CMP_GT: compare(0x97, d); break;  // seta
+                case Op::CMP_GE: compare(0x93, d); break;  // setae
+
+                case Op::LOG_AND:
+                case Op::LOG_OR:
+                    testCell(Assembler::EAX, d - 2);
+                    as.bytes({0x0F, 0x95, 0xC0});          // setne al
+                    testCell(Assembler::ECX, d - 1);
+                    as.bytes({0x0F, 0x95, 0xC1});          // setne cl
+                    as.bytes({ins.op == Op::LOG_AND ? 0x20 : 0x08, 0xC8});   // and/or al, cl
+                    storeAl(d - 2);
+                    break;
+
+                case Op::JUMP:
+                    as.jump({0xE9}, labels.at(*ins.arg1));
+                    break;
+
+                case Op::JUMP_IF_FALSE:
+                    as.rbx({0x83}, 7, cell(d - 1));        // cmp dword [cell], 0
+                    as.bytes({0x00});
+                    as.jump({0x0F, 0x84}, labels.at(*ins.arg1));
+                    break;
+
+                case Op::CALL: {
+                    const auto &callee = poliz.getFunction(*ins.arg1);
+                    const int argBase = d - callee.paramCount;
+                    as.rbx({0x48, 0x8D}, Assembler::ESI, cell(argBase));   // lea rsi, args
+                    as.bytes({0x4C, 0x89, 0xE7});          // mov rdi, r12
+                    as.bytes({0x48, 0xB8});                // mov rax, &entries[callee]
+                    as.imm64(reinterpret_cast<uint64_t>(&entries[*ins.arg1]));
+                    as.bytes({0xFF, 0x10});                // call [rax]
+                    as.bytes({0x49, 0x83, 0x3C, 0x24, 0x00});   // cmp qword [r12 + error], 0
+                    as.jump({0x0F, 0x85}, propagate);
+                    if (!callee.returnType.isVoid())
+                        as.rbx({0x89}, Assembler::EAX, cell(argBase));
+                    break;
+                }
+
+                case Op::RET_VALUE:
+                    as.rbx({0x8B}, Assembler::EAX, cell(d - 1));
+                    as.jump({0xE9}, epilogue);
+                    break;
+
+                case Op::RET_VOID:
+                    as.bytes({0x31, 0xC0});
+                    as.jump({0xE9}, epilogue);
+                    break;
+
+                default:
+                    break;
+            }
+        }
+    };
+}
+
+
+const char *const Jit::stackExhausted = "JIT: native stack exhausted";
+
+Jit::Jit(const Poliz &poliz, int threshold)
+    : poliz(poliz), threshold(std::max(threshold, 1)),
+      entries(poliz.functionCount(), nullptr), counts(poliz.functionCount(), 0) {
+#ifdef JIT_X86_64
+    // Native frames live on the machine stack of the thread that builds
+    // the Jit (a batch worker's is not the main thread's). Leave headroom
+    // for the interpreter and the C++ runtime below the deepest native
+    // frame. If the stack's bounds are unknown, nothing is compiled.
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+        void *low = nullptr;
+        std::size_t size = 0;
+        if (pthread_attr_getstack(&attr, &low, &size) == 0) {
+            char probe;
+            auto here = reinterpret_cast<std::uintptr_t>(&probe);
+            auto bottom = reinterpret_cast<std::uintptr_t>(low);
+            std::size_t reserve = std::min<std::size_t>(size / 4, 1u << 20);
+            if (here > bottom + reserve && here - bottom <= size)
+                ctx.stackLimit = bottom + reserve;
+        }
+        pthread_attr_destroy(&attr);
+    }
+#endif
+}
+
+Jit::~Jit() {
+#ifdef JIT_X86_64
+    for (auto [p, n] : regions)
+        munmap(p, n);
+#endif
+}
+
+bool Jit::available() {
+#ifdef JIT_X86_64
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Jit::compile(int fnIdx) {
+#ifdef JIT_X86_64
+    if (!poliz.isVerified() || !ctx.stackLimit)
+        return;
+
+    std::vector<int> unit;
+    std::unordered_map<int, Analysis> analyses;
+    if (!collect(poliz, entries, fnIdx, unit, analyses))
+        return;
+
+    Assembler as;
+    std::vector<std::pair<int, int>> starts;
+    for (int f : unit) {
+        while (as.code.size() % 16)
+            as.bytes({0xCC});
+        starts.push_back({f, static_cast<int>(as.code.size())});
+        FunctionEmitter(as, poliz, poliz.getFunction(f), analyses.at(f), entries).emit();
+    }
+    as.resolve();
+
+    const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    const std::size_t size = (as.code.size() + page - 1) / page * page;
+    void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return;
+    std::memcpy(mem, as.code.data(), as.code.size());
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, size);
+        return;
+    }
+    regions.push_back({mem, size});
+
+    auto *codeBase = static_cast<uint8_t *>(mem);
+    for (auto [f, offset] : starts)
+        entries[f] = reinterpret_cast<Entry>(codeBase + offset);
+
+    // Lets `perf report` symbolise generated code.
+    char path[64];
+    std::snprintf(path, sizeof path, "/tmp/perf-%d.map", static_cast<int>(getpid()));
+    if (FILE *map = std::fopen(path, "a")) {
+        for (std::size_t k = 0; k < starts.size(); ++k) {
+            const int begin = starts[k].second;
+            const int end = k + 1 < starts.size() ? starts[k + 1].second
+                                                  : static_cast<int>(as.code.size());
+            std::fprintf(map, "%lx %x poliz::%s\n",
+                         static_cast<unsigned long>(reinterpret_cast<std::uintptr_t>(codeBase + begin)),
+                         static_cast<unsigned>(end - begin), poliz.getFunction(starts[k].first).name.c_str());
+        }
+        std::fclose(map);
+    }
+#else
+    (void) fnIdx;
+#endif
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "poliz.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Baseline x86-64 compiler for hot Poliz functions. A function is compiled
+// once the interpreter has called it `threshold` times, provided it and
+// everything it calls stay within the integer subset: int literals, locals,
+// integer arithmetic and bit ops, compares, jumps, CALL and RET, with int
+// parameters and an int or void result. Anything else keeps running in the
+// interpreter.
+//
+// Generated code keeps each local and each operand-stack cell at a fixed
+// offset in the native frame (the verifier gives a static depth per ip),
+// so one Poliz instruction becomes a few loads and stores.
+class Jit {
+public:
+    static constexpr int maxParams = 16;
+
+    // Reported in Context::error when native recursion runs out of machine
+    // stack. Compiled code has no side effects, so the caller can simply
+    // run the same call again in the interpreter.
+    static const char *const stackExhausted;
+
+    // Shared with generated code; layout is fixed by the emitter.
+    struct Context {
+        const char *error = nullptr;
+        std::uintptr_t stackLimit = 0;
+    };
+
+    using Entry = int32_t (*)(Context *ctx, const int32_t *args);
+
+    Jit(const Poliz &poliz, int threshold);
+    ~Jit();
+
+    Jit(const Jit &) = delete;
+    Jit &operator=(const Jit &) = delete;
+
+    // Counts a call into function fnIdx. Returns its native entry once
+    // compiled, nullptr while it should stay interpreted.
+    Entry onCall(int fnIdx) {
+        if (entries[fnIdx])
+            return entries[fnIdx];
+        if (++counts[fnIdx] == threshold)
+            compile(fnIdx);
+        return entries[fnIdx];
+    }
+
+    Context &context() { return ctx; }
+
+    static bool available();
+
+private:
+    const Poliz &poliz;
+    int threshold;
+    Context ctx;
+
+    std::vector<Entry> entries;
+    std::vector<int> counts;
+    std::vector<std::pair<void *, std::size_t>> regions;
+
+    void compile(int fnIdx);
+};
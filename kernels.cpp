@@ -0,0 +1,746 @@
+#include "kernels.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNELS_X86 1
+#endif
+
+
+namespace kernels {
+
+    static int32_t sumIntScalar(const int32_t *a, std::size_t n) {
+        uint32_t s = 0;
+        for (std::size_t i = 0; i < n; ++i)
+            s += static_cast<uint32_t>(a[i]);
+        return static_cast<int32_t>(s);
+    }
+
+    static float sumFloatScalar(const float *a, std::size_t n) {
+        float s = 0.0f;
+        for (std::size_t i = 0; i < n; ++i)
+            s += a[i];
+        return s;
+    }
+
+    static int32_t dotIntScalar(const int32_t *a, const int32_t *b, std::size_t n) {
+        uint32_t s = 0;
+        for (std::size_t i = 0; i < n; ++i)
+            s += static_cast<uint32_t>(a[i]) * static_cast<uint32_t>(b[i]);
+        return static_cast<int32_t>(s);
+    }
+
+    static float dotFloatScalar(const float *a, const float *b, std::size_t n) {
+        float s = 0.0f;
+        for (std::size_t i = 0; i < n; ++i)
+            s += a[i] * b[i];
+        return s;
+    }
+
+    static int32_t minIntScalar(const int32_t *a, std::size_t n) {
+        int32_t m = a[0];
+        for (std::size_t i = 1; i < n; ++i)
+            if (a[i] < m) m = a[i];
+        return m;
+    }
+
+    static int32_t maxIntScalar(const int32_t *a, std::size_t n) {
+        int32_t m = a[0];
+        for (std::size_t i = 1; i < n; ++i)
+            if (a[i] > m) m = a[i];
+        return m;
+    }
+
+    static float minFloatScalar(const float *a, std::size_t n) {
+        float m = a[0];
+        for (std::size_t i = 1; i < n; ++i)
+            if (a[i] < m) m = a[i];
+        return m;
+    }
+
+    static float maxFloatScalar(const float *a, std::size_t n) {
+        float m = a[0];
+        for (std::size_t i = 1; i < n; ++i)
+            if (a[i] > m) m = a[i];
+        return m;
+    }
+
+    static void fillIntScalar(int32_t *a, std::size_t n, int32_t v) {
+        for (std::size_t i = 0; i < n; ++i)
+            a[i] = v;
+    }
+
+    static void fillFloatScalar(float *a, std::size_t n, float v) {
+        for (std::size_t i = 0; i < n; ++i)
+            a[i] = v;
+    }
+
+    static void scaleIntScalar(int32_t *a, std::size_t n, int32_t k) {
+        for (std::size_t i = 0; i < n; ++i)
+            a[i] = static_cast<int32_t>(static_cast<uint32_t>(a[i]) * static_cast<uint32_t>(k));
+    }
+
+    static void scaleFloatScalar(float *a, std::size_t n, float k) {
+        for (std::size_t i = 0; i < n; ++i)
+            a[i] *= k;
+    }
+
+    static int32_t applyInt(MapOp op, int32_t x, int32_t y) {
+        uint32_t ux = static_cast<uint32_t>(x), uy = static_cast<uint32_t>(y);
+        switch (op) {
+            case MapOp::Add: return static_cast<int32_t>(ux + uy);
+            case MapOp::Sub: return static_cast<int32_t>(ux - uy);
+            case MapOp::Mul: return static_cast<int32_t>(ux * uy);
+        }
+        return 0;
+    }
+
+    static float applyFloat(MapOp op, float x, float y) {
+        switch (op) {
+            case MapOp::Add: return x + y;
+            case MapOp::Sub: return x - y;
+            case MapOp::Mul: return x * y;
+        }
+        return 0.0f;
+    }
+
+    static void mapIntScalar(MapOp op, int32_t *d, const int32_t *a, const int32_t *b, std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i)
+            d[i] = applyInt(op, a[i], b[i]);
+    }
+
+    static void mapFloatScalar(MapOp op, float *d, const float *a, const float *b, std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i)
+            d[i] = applyFloat(op, a[i], b[i]);
+    }
+
+    static void mapIntBroadcastScalar(MapOp op, int32_t *d, const int32_t *a, int32_t k, bool kFirst,
+                                      std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i)
+            d[i] = kFirst ? applyInt(op, k, a[i]) : applyInt(op, a[i], k);
+    }
+
+    static void mapFloatBroadcastScalar(MapOp op, float *d, const float *a, float k, bool kFirst,
+                                        std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i)
+            d[i] = kFirst ? applyFloat(op, k, a[i]) : applyFloat(op, a[i], k);
+    }
+
+    static bool isSpace(char c) {
+        return c == ' ' || static_cast<unsigned char>(c - '\t') <= '\r' - '\t';
+    }
+
+    static std::size_t spanSpaceScalar(const char *s, std::size_t n) {
+        std::size_t i = 0;
+        while (i < n && isSpace(s[i]))
+            ++i;
+        return i;
+    }
+
+    static std::size_t findCommentEndScalar(const char *s, std::size_t n) {
+        for (std::size_t i = 0; i + 1 < n; ++i)
+            if (s[i] == '*' && s[i + 1] == '/')
+                return i;
+        return n;
+    }
+
+
+#ifdef KERNELS_X86
+
+    __attribute__((target("sse4.1")))
+    static int32_t hsumEpi32(__m128i v) {
+        alignas(16) int32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(lanes), v);
+        uint32_t s = 0;
+        for (int32_t x : lanes)
+            s += static_cast<uint32_t>(x);
+        return static_cast<int32_t>(s);
+    }
+
+    __attribute__((target("sse4.1")))
+    static float hsumPs(__m128 v) {
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, v);
+        return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    }
+
+    __attribute__((target("sse4.1")))
+    static int32_t sumIntSse(const int32_t *a, std::size_t n) {
+        __m128i acc = _mm_setzero_si128();
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+            acc = _mm_add_epi32(acc, _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)));
+        uint32_t s = static_cast<uint32_t>(hsumEpi32(acc));
+        for (; i < n; ++i)
+            s += static_cast<uint32_t>(a[i]);
+        return static_cast<int32_t>(s);
+    }
+
+    __attribute__((target("sse4.1")))
+    static float sumFloatSse(const float *a, std::size_t n) {
+        __m128 acc = _mm_setzero_ps();
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+            acc = _mm_add_ps(acc, _mm_loadu_ps(a + i));
+        float s = hsumPs(acc);
+        for (; i < n; ++i)
+            s += a[i];
+        return s;
+    }
+
+    __attribute__((target("sse4.1")))
+    static int32_t dotIntSse(const int32_t *a, const int32_t *b, std::size_t n) {
+        __m128i acc = _mm_setzero_si128();
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+            __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+            acc = _mm_add_epi32(acc, _mm_mullo_epi32(x, y));
+        }
+        uint32_t s = static_cast<uint32_t>(hsumEpi32(acc));
+        for (; i < n; ++i)
+            s += static_cast<uint32_t>(a[i]) * static_cast<uint32_t>(b[i]);
+        return static_cast<int32_t>(s);
+    }
+
+    __attribute__((target("sse4.1")))
+    static float dotFloatSse(const float *a, const float *b, std::size_t n) {
+        __m128 acc = _mm_setzero_ps();
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        float s = hsumPs(acc);
+        for (; i < n; ++i)
+            s += a[i] * b[i];
+        return s;
+    }
+
+    __attribute__((target("sse4.1")))
+    static int32_t minIntSse(const int32_t *a, std::size_t n) {
+        if (n < 4)
+            return minIntScalar(a, n);
+        __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a));
+        std::size_t i = 4;
+        for (; i + 4 <= n; i += 4)
+            m = _mm_min_epi32(m, _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)));
+        alignas(16) int32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(lanes), m);
+        int32_t r = minIntScalar(lanes, 4);
+        for (; i < n; ++i)
+            if (a[i] < r) r = a[i];
+        return r;
+    }
+
+    __attribute__((target("sse4.1")))
+    static int32_t maxIntSse(const int32_t *a, std::size_t n) {
+        if (n < 4)
+            return maxIntScalar(a, n);
+        __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a));
+        std::size_t i = 4;
+        for (; i + 4 <= n; i += 4)
+            m = _mm_max_epi32(m, _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)));
+        alignas(16) int32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(lanes), m);
+        int32_t r = maxIntScalar(lanes, 4);
+        for (; i < n; ++i)
+            if (a[i] > r) r = a[i];
+        return r;
+    }
+
+    __attribute__((target("sse4.1")))
+    static float minFloatSse(const float *a, std::size_t n) {
+        if (n < 4)
+            return minFloatScalar(a, n);
+        __m128 m = _mm_loadu_ps(a);
+        std::size_t i = 4;
+        for (; i + 4 <= n; i += 4)
+            m = _mm_min_ps(m, _mm_loadu_ps(a + i));
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, m);
+        float r = minFloatScalar(lanes, 4);
+        for (; i < n; ++i)
+            if (a[i] < r) r = a[i];
+        return r;
+    }
+
+    __attribute__((target("sse4.1")))
+    static float maxFloatSse(const float *a, std::size_t n) {
+        if (n < 4)
+            return maxFloatScalar(a, n);
+        __m128 m = _mm_loadu_ps(a);
+        std::size_t i = 4;
+        for (; i + 4 <= n; i += 4)
+            m = _mm_max_ps(m, _mm_loadu_ps(a + i));
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, m);
+        float r = maxFloatScalar(lanes, 4);
+        for (; i < n; ++i)
+            if (a[i] > r) r = a[i];
+        return r;
+    }
+
+    __attribute__((target("sse4.1")))
+    static void fillIntSse(int32_t *a, std::size_t n, int32_t v) {
+        __m128i x = _mm_set1_epi32(v);
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(a + i), x);
+        for (; i < n; ++i)
+            a[i] = v;
+    }
+
+    __attribute__((target("sse4.1")))
+    static void fillFloatSse(float *a, std::size_t n, float v) {
+        __m128 x = _mm_set1_ps(v);
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(a + i, x);
+        for (; i < n; ++i)
+            a[i] = v;
+    }
+
+    __attribute__((target("sse4.1")))
+    static void scaleIntSse(int32_t *a, std::size_t n, int32_t k) {
+        __m128i x = _mm_set1_epi32(k);
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i *p = reinterpret_cast<__m128i *>(a + i);
+            _mm_storeu_si128(p, _mm_mullo_epi32(_mm_loadu_si128(p), x));
+        }
+        for (; i < n; ++i)
+            a[i] = static_cast<int32_t>(static_cast<uint32_t>(a[i]) * static_cast<uint32_t>(k));
+    }
+
+    __attribute__((target("sse4.1")))
+    static void scaleFloatSse(float *a, std::size_t n, float k) {
+        __m128 x = _mm_set1_ps(k);
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(a + i, _mm_mul_ps(_mm_loadu_ps(a + i), x));
+        for (; i < n; ++i)
+            a[i] *= k;
+    }
+
+    __attribute__((target("sse4.1")))
+    static __m128i applyEpi32Sse(MapOp op, __m128i x, __m128i y) {
+        switch (op) {
+            case MapOp::Add: return _mm_add_epi32(x, y);
+            case MapOp::Sub: return _mm_sub_epi32(x, y);
+            case MapOp::Mul: return _mm_mullo_epi32(x, y);
+        }
+        return x;
+    }
+
+    __attribute__((target("sse4.1")))
+    static __m128 applyPsSse(MapOp op, __m128 x, __m128 y) {
+        switch (op) {
+            case MapOp::Add: return _mm_add_ps(x, y);
+            case MapOp::Sub: return _mm_sub_ps(x, y);
+            case MapOp::Mul: return _mm_mul_ps(x, y);
+        }
+        return x;
+    }
+
+    __attribute__((target("sse4.1")))
+    static void mapIntSse(MapOp op, int32_t *d, const int32_t *a, const int32_t *b, std::size_t n) {
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+            __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(d + i), applyEpi32Sse(op, x, y));
+        }
+        for (; i < n; ++i)
+            d[i] = applyInt(op, a[i], b[i]);
+    }
+
+    __attribute__((target("sse4.1")))
+    static void mapFloatSse(MapOp op, float *d, const float *a, const float *b, std::size_t n) {
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(d + i, applyPsSse(op, _mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        for (; i < n; ++i)
+            d[i] = applyFloat(op, a[i], b[i]);
+    }
+
+    __attribute__((target("sse4.1")))
+    static void mapIntBroadcastSse(MapOp op, int32_t *d, const int32_t *a, int32_t k, bool kFirst,
+                                   std::size_t n) {
+        __m128i kv = _mm_set1_epi32(k);
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+            __m128i r = kFirst ? applyEpi32Sse(op, kv, x) : applyEpi32Sse(op, x, kv);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(d + i), r);
+        }
+        for (; i < n; ++i)
+            d[i] = kFirst ? applyInt(op, k, a[i]) : applyInt(op, a[i], k);
+    }
+
+    __attribute__((target("sse4.1")))
+    static void mapFloatBroadcastSse(MapOp op, float *d, const float *a, float k, bool kFirst,
+                                     std::size_t n) {
+        __m128 kv = _mm_set1_ps(k);
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128 x = _mm_loadu_ps(a + i);
+            _mm_storeu_ps(d + i, kFirst ? applyPsSse(op, kv, x) : applyPsSse(op, x, kv));
+        }
+        for (; i < n; ++i)
+            d[i] = kFirst ? applyFloat(op, k, a[i]) : applyFloat(op, a[i], k);
+    }
+
+    // ' ', or '\t'..'\r' (unsigned c - '\t' <= 4).
+    __attribute__((target("sse4.1")))
+    static __m128i spaceMaskSse(__m128i v) {
+        __m128i ctrl = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+        __m128i inRange = _mm_cmpeq_epi8(_mm_min_epu8(ctrl, _mm_set1_epi8('\r' - '\t')), ctrl);
+        return _mm_or_si128(inRange, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+    }
+
+    __attribute__((target("sse4.1")))
+    static std::size_t spanSpaceSse(const char *s, std::size_t n) {
+        std::size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+            unsigned other = ~static_cast<unsigned>(_mm_movemask_epi8(spaceMaskSse(v))) & 0xFFFFu;
+            if (other)
+                return i + __builtin_ctz(other);
+        }
+        return i + spanSpaceScalar(s + i, n - i);
+    }
+
+    __attribute__((target("sse4.1")))
+    static std::size_t findCommentEndSse(const char *s, std::size_t n) {
+        std::size_t i = 0;
+        for (; i + 17 <= n; i += 16) {
+            __m128i star = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i)),
+                                          _mm_set1_epi8('*'));
+            __m128i slash = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i + 1)),
+                                           _mm_set1_epi8('/'));
+            unsigned hit = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(star, slash)));
+            if (hit)
+                return i + __builtin_ctz(hit);
+        }
+        return i + findCommentEndScalar(s + i, n - i);
+    }
+
+
+    __attribute__((target("avx2")))
+    static int32_t sumIntAvx2(const int32_t *a, std::size_t n) {
+        __m256i acc = _mm256_setzero_si256();
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            acc = _mm256_add_epi32(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)));
+        __m128i half = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        uint32_t s = static_cast<uint32_t>(hsumEpi32(half));
+        for (; i < n; ++i)
+            s += static_cast<uint32_t>(a[i]);
+        return static_cast<int32_t>(s);
+    }
+
+    __attribute__((target("avx2")))
+    static float sumFloatAvx2(const float *a, std::size_t n) {
+        __m256 acc = _mm256_setzero_ps();
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            acc = _mm256_add_ps(acc, _mm256_loadu_ps(a + i));
+        float s = hsumPs(_mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1)));
+        for (; i < n; ++i)
+            s += a[i];
+        return s;
+    }
+
+    __attribute__((target("avx2")))
+    static int32_t dotIntAvx2(const int32_t *a, const int32_t *b, std::size_t n) {
+        __m256i acc = _mm256_setzero_si256();
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+            acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(x, y));
+        }
+        __m128i half = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        uint32_t s = static_cast<uint32_t>(hsumEpi32(half));
+        for (; i < n; ++i)
+            s += static_cast<uint32_t>(a[i]) * static_cast<uint32_t>(b[i]);
+        return static_cast<int32_t>(s);
+    }
+
+    __attribute__((target("avx2")))
+    static float dotFloatAvx2(const float *a, const float *b, std::size_t n) {
+        __m256 acc = _mm256_setzero_ps();
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        float s = hsumPs(_mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1)));
+        for (; i < n; ++i)
+            s += a[i] * b[i];
+        return s;
+    }
+
+    __attribute__((target("avx2")))
+    static int32_t minIntAvx2(const int32_t *a, std::size_t n) {
+        if (n < 8)
+            return minIntSse(a, n);
+        __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a));
+        std::size_t i = 8;
+        for (; i + 8 <= n; i += 8)
+            m = _mm256_min_epi32(m, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)));
+        alignas(32) int32_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), m);
+        int32_t r = minIntScalar(lanes, 8);
+        for (; i < n; ++i)
+            if (a[i] < r) r = a[i];
+        return r;
+    }
+
+    __attribute__((target("avx2")))
+    static int32_t maxIntAvx2(const int32_t *a, std::size_t n) {
+        if (n < 8)
+            return maxIntSse(a, n);
+        __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a));
+        std::size_t i = 8;
+        for (; i + 8 <= n; i += 8)
+            m = _mm256_max_epi32(m, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)));
+        alignas(32) int32_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), m);
+        int32_t r = maxIntScalar(lanes, 8);
+        for (; i < n; ++i)
+            if (a[i] > r) r = a[i];
+        return r;
+    }
+
+    __attribute__((target("avx2")))
+    static float minFloatAvx2(const float *a, std::size_t n) {
+        if (n < 8)
+            return minFloatSse(a, n);
+        __m256 m = _mm256_loadu_ps(a);
+        std::size_t i = 8;
+        for (; i + 8 <= n; i += 8)
+            m = _mm256_min_ps(m, _mm256_loadu_ps(a + i));
+        alignas(32) float lanes[8];
+        _mm256_store_ps(lanes, m);
+        float r = minFloatScalar(lanes, 8);
+        for (; i < n; ++i)
+            if (a[i] < r) r = a[i];
+        return r;
+    }
+
+    __attribute__((target("avx2")))
+    static float maxFloatAvx2(const float *a, std::size_t n) {
+        if (n < 8)
+            return maxFloatSse(a, n);
+        __m256 m = _mm256_loadu_ps(a);
+        std::size_t i = 8;
+        for (; i + 8 <= n; i += 8)
+            m = _mm256_max_ps(m, _mm256_loadu_ps(a + i));
+        alignas(32) float lanes[8];
+        _mm256_store_ps(lanes, m);
+        float r = maxFloatScalar(lanes, 8);
+        for (; i < n; ++i)
+            if (a[i] > r) r = a[i];
+        return r;
+    }
+
+    __attribute__((target("avx2")))
+    static void fillIntAvx2(int32_t *a, std::size_t n, int32_t v) {
+        __m256i x = _mm256_set1_epi32(v);
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(a + i), x);
+        for (; i < n; ++i)
+            a[i] = v;
+    }
+
+    __attribute__((target("avx2")))
+    static void fillFloatAvx2(float *a, std::size_t n, float v) {
+        __m256 x = _mm256_set1_ps(v);
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(a + i, x);
+        for (; i < n; ++i)
+            a[i] = v;
+    }
+
+    __attribute__((target("avx2")))
+    static void scaleIntAvx2(int32_t *a, std::size_t n, int32_t k) {
+        __m256i x = _mm256_set1_epi32(k);
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i *p = reinterpret_cast<__m256i *>(a + i);
+            _mm256_storeu_si256(p, _mm256_mullo_epi32(_mm256_loadu_si256(p), x));
+        }
+        for (; i < n; ++i)
+            a[i] = static_cast<int32_t>(static_cast<uint32_t>(a[i]) * static_cast<uint32_t>(k));
+    }
+
+    __attribute__((target("avx2")))
+    static void scaleFloatAvx2(float *a, std::size_t n, float k) {
+        __m256 x = _mm256_set1_ps(k);
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(a + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), x));
+        for (; i < n; ++i)
+            a[i] *= k;
+    }
+
+    __attribute__((target("avx2")))
+    static __m256i applyEpi32Avx2(MapOp op, __m256i x, __m256i y) {
+        switch (op) {
+            case MapOp::Add: return _mm256_add_epi32(x, y);
+            case MapOp::Sub: return _mm256_sub_epi32(x, y);
+            case MapOp::Mul: return _mm256_mullo_epi32(x, y);
+        }
+        return x;
+    }
+
+    __attribute__((target("avx2")))
+    static __m256 applyPsAvx2(MapOp op, __m256 x, __m256 y) {
+        switch (op) {
+            case MapOp::Add: return _mm256_add_ps(x, y);
+            case MapOp::Sub: return _mm256_sub_ps(x, y);
+            case MapOp::Mul: return _mm256_mul_ps(x, y);
+        }
+        return x;
+    }
+
+    __attribute__((target("avx2")))
+    static void mapIntAvx2(MapOp op, int32_t *d, const int32_t *a, const int32_t *b, std::size_t n) {
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(d + i), applyEpi32Avx2(op, x, y));
+        }
+        for (; i < n; ++i)
+            d[i] = applyInt(op, a[i], b[i]);
+    }
+
+    __attribute__((target("avx2")))
+    static void mapFloatAvx2(MapOp op, float *d, const float *a, const float *b, std::size_t n) {
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(d + i, applyPsAvx2(op, _mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        for (; i < n; ++i)
+            d[i] = applyFloat(op, a[i], b[i]);
+    }
+
+    __attribute__((target("avx2")))
+    static void mapIntBroadcastAvx2(MapOp op, int32_t *d, const int32_t *a, int32_t k, bool kFirst,
+                                    std::size_t n) {
+        __m256i kv = _mm256_set1_epi32(k);
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+            __m256i r = kFirst ? applyEpi32Avx2(op, kv, x) : applyEpi32Avx2(op, x, kv);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(d + i), r);
+        }
+        for (; i < n; ++i)
+            d[i] = kFirst ? applyInt(op, k, a[i]) : applyInt(op, a[i], k);
+    }
+
+    __attribute__((target("avx2")))
+    static void mapFloatBroadcastAvx2(MapOp op, float *d, const float *a, float k, bool kFirst,
+                                      std::size_t n) {
+        __m256 kv = _mm256_set1_ps(k);
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256 x = _mm256_loadu_ps(a + i);
+            _mm256_storeu_ps(d + i, kFirst ? applyPsAvx2(op, kv, x) : applyPsAvx2(op, x, kv));
+        }
+        for (; i < n; ++i)
+            d[i] = kFirst ? applyFloat(op, k, a[i]) : applyFloat(op, a[i], k);
+    }
+
+    __attribute__((target("avx2")))
+    static __m256i spaceMaskAvx2(__m256i v) {
+        __m256i ctrl = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+        __m256i inRange = _mm256_cmpeq_epi8(_mm256_min_epu8(ctrl, _mm256_set1_epi8('\r' - '\t')), ctrl);
+        return _mm256_or_si256(inRange, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+    }
+
+    __attribute__((target("avx2")))
+    static std::size_t spanSpaceAvx2(const char *s, std::size_t n) {
+        std::size_t i = 0;
+        for (; i + 32 <= n; i += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+            uint32_t other = ~static_cast<uint32_t>(_mm256_movemask_epi8(spaceMaskAvx2(v)));
+            if (other)
+                return i + __builtin_ctz(other);
+        }
+        return i + spanSpaceSse(s + i, n - i);
+    }
+
+    __attribute__((target("avx2")))
+    static std::size_t findCommentEndAvx2(const char *s, std::size_t n) {
+        std::size_t i = 0;
+        for (; i + 33 <= n; i += 32) {
+            __m256i star = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i)),
+                                             _mm256_set1_epi8('*'));
+            __m256i slash = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i + 1)),
+                                              _mm256_set1_epi8('/'));
+            uint32_t hit = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(star, slash)));
+            if (hit)
+                return i + __builtin_ctz(hit);
+        }
+        return i + findCommentEndSse(s + i, n - i);
+    }
+
+#endif
+
+
+    static const Table scalarTable{
+        "scalar",
+        sumIntScalar, sumFloatScalar,
+        dotIntScalar, dotFloatScalar,
+        minIntScalar, maxIntScalar, minFloatScalar, maxFloatScalar,
+        fillIntScalar, fillFloatScalar,
+        scaleIntScalar, scaleFloatScalar,
+        mapIntScalar, mapFloatScalar,
+        mapIntBroadcastScalar, mapFloatBroadcastScalar,
+        spanSpaceScalar, findCommentEndScalar,
+    };
+
+#ifdef KERNELS_X86
+    static const Table sseTable{
+        "sse4.1",
+        sumIntSse, sumFloatSse,
+        dotIntSse, dotFloatSse,
+        minIntSse, maxIntSse, minFloatSse, maxFloatSse,
+        fillIntSse, fillFloatSse,
+        scaleIntSse, scaleFloatSse,
+        mapIntSse, mapFloatSse,
+        mapIntBroadcastSse, mapFloatBroadcastSse,
+        spanSpaceSse, findCommentEndSse,
+    };
+
+    static const Table avx2Table{
+        "avx2",
+        sumIntAvx2, sumFloatAvx2,
+        dotIntAvx2, dotFloatAvx2,
+        minIntAvx2, maxIntAvx2, minFloatAvx2, maxFloatAvx2,
+        fillIntAvx2, fillFloatAvx2,
+        scaleIntAvx2, scaleFloatAvx2,
+        mapIntAvx2, mapFloatAvx2,
+        mapIntBroadcastAvx2, mapFloatBroadcastAvx2,
+        spanSpaceAvx2, findCommentEndAvx2,
+    };
+#endif
+
+    const Table &scalar() {
+        return scalarTable;
+    }
+
+    const Table &active() {
+        static const Table &table = []() -> const Table & {
+#ifdef KERNELS_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+                return avx2Table;
+            if (__builtin_cpu_supports("sse4.1"))
+                return sseTable;
+#endif
+            return scalarTable;
+        }();
+        return table;
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+
+namespace kernels {
+
+    enum class MapOp : uint8_t { Add, Sub, Mul };
+
+    struct Table {
+        const char *isa;
+
+        int32_t (*sumInt)(const int32_t *a, std::size_t n);
+        float   (*sumFloat)(const float *a, std::size_t n);
+
+        int32_t (*dotInt)(const int32_t *a, const int32_t *b, std::size_t n);
+        float   (*dotFloat)(const float *a, const float *b, std::size_t n);
+
+        int32_t (*minInt)(const int32_t *a, std::size_t n);
+        int32_t (*maxInt)(const int32_t *a, std::size_t n);
+        float   (*minFloat)(const float *a, std::size_t n);
+        float   (*maxFloat)(const float *a, std::size_t n);
+
+        void (*fillInt)(int32_t *a, std::size_t n, int32_t v);
+        void (*fillFloat)(float *a, std::size_t n, float v);
+
+        void (*scaleInt)(int32_t *a, std::size_t n, int32_t k);
+        void (*scaleFloat)(float *a, std::size_t n, float k);
+
+        // d[i] = a[i] op b[i]; d may alias a or b.
+        void (*mapInt)(MapOp op, int32_t *d, const int32_t *a, const int32_t *b, std::size_t n);
+        void (*mapFloat)(MapOp op, float *d, const float *a, const float *b, std::size_t n);
+
+        // d[i] = a[i] op k, or k op a[i] when kFirst is set.
+        void (*mapIntBroadcast)(MapOp op, int32_t *d, const int32_t *a, int32_t k, bool kFirst, std::size_t n);
+        void (*mapFloatBroadcast)(MapOp op, float *d, const float *a, float k, bool kFirst, std::size_t n);
+
+        // Lexer scans: the length of the whitespace run (std::isspace in
+        // the C locale) that starts s, and the offset of the first "*/" in
+        // s, or n if there is none.
+        std::size_t (*spanSpace)(const char *s, std::size_t n);
+        std::size_t (*findCommentEnd)(const char *s, std::size_t n);
+    };
+
+    const Table &active();
+
+    const Table &scalar();
+}
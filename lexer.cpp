@@ -1,14 +1,30 @@
 #include "lexer.hpp"
+#include "ring.hpp"
+#include "kernels.hpp"
+#include "scanner.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
 #include <iostream>
+#include <iterator>
+#include <sstream>
+#include <thread>
 #include <unordered_map>
 
-Lexer::Lexer(const std::string &filename, std::string keywordFile) {
-    file.open(filename);
+Lexer::Lexer(const std::string &filename, std::string keywordFile)
+    : keywords(std::make_shared<Trie>()) {
+    std::ifstream file(filename, std::ios::binary);
     if (!file.is_open()) {
         std::cerr << "Error: cannot open " << filename << std::endl;
         eof = true;
         return;
     }
+    source = std::make_shared<const std::string>(std::istreambuf_iterator<char>(file),
+                                                 std::istreambuf_iterator<char>());
+    text = source->data();
+    limit = source->size();
+    lines = std::make_shared<const LineIndex>(text, limit);
 
     loadKeywordsFromFile(keywordFile);
 
@@ -16,69 +32,317 @@ Lexer::Lexer(const std::string &filename, std::string keywordFile) {
     nextLexem();
 }
 
+Lexer::Lexer(std::shared_ptr<const std::string> source, std::shared_ptr<const LineIndex> lines,
+             const std::string &keywordFile)
+    : source(std::move(source)), lines(std::move(lines)), keywords(std::make_shared<Trie>()), eof(true) {
+    loadKeywordsFromFile(keywordFile);
+}
+
+void Lexer::reset(std::shared_ptr<const std::string> source, std::shared_ptr<const LineIndex> lines,
+                  std::size_t from) {
+    this->source = std::move(source);
+    this->lines = std::move(lines);
+    text = this->source->data();
+    limit = this->source->size();
+    pos = from;
+    eof = false;
+    replay.clear();
+    replaying = false;
+    replayError = nullptr;
+
+    readChar();
+    nextLexem();
+}
+
+Lexer::Lexer(std::vector<Token> tokens)
+    : eof(true), replay(std::move(tokens)), replaying(true) {
+    currentToken = replay.front();
+}
+
+Lexer::Lexer(const Lexer &whole, std::size_t end)
+    : source(whole.source), text(whole.text), pos(whole.pos), limit(end), lines(whole.lines),
+      keywords(whole.keywords), currentChar(whole.currentChar), eof(whole.eof) {
+}
+
+// The file-reading Lexer, moved here by pipeline(), and the ring its
+// thread fills. Tokens travel in batches, so the threads meet once per
+// batch rather than once per token; the batch that ends with EndOfFile is
+// the last one.
+struct Lexer::Pipeline {
+    static constexpr std::size_t batchSize = 256;
+
+    Lexer source;
+    SpscRing<std::vector<Token>, 8> ring;
+    std::exception_ptr error;       // set before the batch that ends a failed scan
+    std::atomic<bool> stop{false};
+    std::atomic<bool> finished{false};
+    std::thread thread;
+
+    // Consumer side.
+    std::vector<Token> batch;
+    std::size_t batchPos = 0;
+    bool drained = false;           // the EndOfFile has been handed out
+
+    explicit Pipeline(Lexer &&source) : source(std::move(source)) {}
+
+    ~Pipeline() {
+        // Keep making room so a producer blocked on a full ring gets to
+        // see `stop`.
+        stop.store(true, std::memory_order_relaxed);
+        std::vector<Token> rest;
+        while (!finished.load(std::memory_order_acquire))
+            if (!ring.tryPop(rest))
+                std::this_thread::yield();
+        thread.join();
+    }
+
+    void run() {
+        bool last = false;
+        while (!last && !stop.load(std::memory_order_relaxed)) {
+            std::vector<Token> out;
+            out.reserve(batchSize);
+            while (!last && out.size() < batchSize) {
+                try {
+                    out.push_back(source.nextLexem());
+                } catch (...) {
+                    error = std::current_exception();
+                    out.push_back(source.makeToken(Token::Type::EndOfFile, "", source.here()));
+                }
+                last = out.back().type == Token::Type::EndOfFile;
+            }
+            ring.push(std::move(out));
+        }
+        finished.store(true, std::memory_order_release);
+    }
+
+    // The token after the last one handed out; valid until the next take().
+    const Token &peek() {
+        return batchPos < batch.size() ? batch[batchPos] : ring.front().front();
+    }
+
+    Token take() {
+        if (batchPos == batch.size()) {
+            batch = ring.pop();
+            batchPos = 0;
+        }
+        Token t = std::move(batch[batchPos++]);
+        drained = t.type == Token::Type::EndOfFile;
+        return t;
+    }
+};
+
+Lexer::~Lexer() = default;
+
+void Lexer::pipeline() {
+    if (piped || replaying)
+        return;
+    Token first = currentToken;
+    piped = std::make_unique<Pipeline>(std::move(*this));
+    currentToken = std::move(first);
+    piped->thread = std::thread([p = piped.get()] { p->run(); });
+}
+
+// At the end of input, like the file Lexer, keeps returning EndOfFile, or
+// keeps throwing the lexical error that ended the scan.
+Token Lexer::nextPiped() {
+    if (!piped->drained) {
+        Token t = piped->take();
+        if (!piped->drained || !piped->error) {
+            currentToken = std::move(t);
+            return currentToken;
+        }
+    }
+    if (piped->error)
+        std::rethrow_exception(piped->error);
+    return currentToken;
+}
+
+Token Lexer::peekPiped() {
+    if (!piped->drained) {
+        const Token &t = piped->peek();
+        if (t.type != Token::Type::EndOfFile || !piped->error)
+            return t;
+    }
+    if (piped->error)
+        std::rethrow_exception(piped->error);
+    return currentToken;
+}
+
+// Where chunks may start: just after a newline that the scanner would
+// skip as whitespace, i.e. one outside comments and literals, so that
+// every token lies wholly inside one chunk. A single pass follows only
+// what can hide a newline -- comments, and string and char literals,
+// consumed exactly as skipWhitespaceAndComments and the read* functions
+// do -- and takes the first such newline after each even split of the
+// remaining bytes. The first chunk starts where this Lexer stands.
+std::vector<std::size_t> Lexer::chunkStarts(unsigned chunks) const {
+    std::size_t from = pos - 1;         // currentChar, not yet consumed
+    std::vector<std::size_t> starts{from};
+    std::size_t next = from + (limit - from) / chunks;
+
+    std::size_t i = from;
+    while (i < limit && starts.size() < chunks) {
+        char c = text[i];
+        char d = i + 1 < limit ? text[i + 1] : '\0';
+        if (c == '/' && d == '/') {
+            while (i < limit && text[i] != '\n')
+                ++i;
+        } else if (c == '/' && d == '*') {
+            i += 2;
+            while (i < limit && !(text[i] == '*' && i + 1 < limit && text[i + 1] == '/'))
+                ++i;
+            i = std::min(i + 2, limit);
+        } else if (c == '"') {
+            ++i;
+            while (i < limit && text[i] != '"' && text[i] != '\n')
+                i += text[i] == '\\' ? 2 : 1;
+            i = std::min(i, limit);
+            if (i < limit && text[i] == '"')
+                ++i;
+        } else if (c == '\'') {
+            ++i;
+            if (i < limit && text[i] != '\n' && text[i] != '\'') {
+                i = std::min(i + (text[i] == '\\' ? 2 : 1), limit);
+                if (i < limit && text[i] == '\'')
+                    ++i;
+            }
+        } else {
+            ++i;
+            if (c == '\n' && i >= next && i < limit) {
+                starts.push_back(i);
+                next = i + (limit - i) / (chunks - starts.size() + 1);
+            }
+        }
+    }
+    return starts;
+}
+
+void Lexer::lexInChunks(unsigned chunks) {
+    if (piped || replaying || eof || chunks < 2)
+        return;
+
+    std::vector<std::size_t> starts = chunkStarts(chunks);
+    starts.push_back(limit);
+    const std::size_t n = starts.size() - 1;
+
+    struct Chunk {
+        std::vector<Token> tokens;
+        std::ostringstream diag;
+        std::exception_ptr error;
+    };
+    std::vector<Chunk> parts(n);
+
+    auto scan = [&](std::size_t k) {
+        Lexer chunk(*this, starts[k + 1]);
+        if (k > 0) {
+            chunk.pos = starts[k];
+            chunk.readChar();
+        }
+        chunk.setDiagnostics(parts[k].diag);
+        try {
+            do
+                parts[k].tokens.push_back(chunk.nextLexem());
+            while (parts[k].tokens.back().type != Token::Type::EndOfFile);
+        } catch (...) {
+            parts[k].error = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (std::size_t k = 1; k < n; ++k)
+        pool.emplace_back(scan, k);
+    scan(0);
+    for (std::thread &t : pool)
+        t.join();
+
+    // Only the last chunk's EndOfFile is the real one; a chunk that fails
+    // ends the stream, as the error would have stopped the scanner.
+    replay.assign(1, currentToken);
+    for (std::size_t k = 0; k < n; ++k) {
+        Chunk &part = parts[k];
+        *diag << part.diag.str();
+        if (part.error) {
+            replay.insert(replay.end(), std::make_move_iterator(part.tokens.begin()),
+                          std::make_move_iterator(part.tokens.end()));
+            replayError = part.error;
+            break;
+        }
+        if (k + 1 < n)
+            part.tokens.pop_back();
+        replay.insert(replay.end(), std::make_move_iterator(part.tokens.begin()),
+                      std::make_move_iterator(part.tokens.end()));
+    }
+    replayPos = 0;
+    replaying = true;
+}
+
 Lexer::Lexer(Lexer &&other) noexcept {
-    file = std::move(other.file);
+    source = std::move(other.source);
+    text = other.text;
+    pos = other.pos;
+    limit = other.limit;
+    lines = std::move(other.lines);
     keywords = std::move(other.keywords);
+    diag = other.diag;
     currentChar = other.currentChar;
     eof = other.eof;
-    line = other.line;
-    column = other.column;
     currentToken = std::move(other.currentToken);
+    replay = std::move(other.replay);
+    replayPos = other.replayPos;
+    replaying = other.replaying;
+    replayError = other.replayError;
+    piped = std::move(other.piped);
 }
 
 Lexer &Lexer::operator=(Lexer &&other) noexcept {
     if (this != &other) {
-        file = std::move(other.file);
+        source = std::move(other.source);
+        text = other.text;
+        pos = other.pos;
+        limit = other.limit;
+        lines = std::move(other.lines);
         keywords = std::move(other.keywords);
+        diag = other.diag;
         currentChar = other.currentChar;
         eof = other.eof;
-        line = other.line;
-        column = other.column;
         currentToken = std::move(other.currentToken);
+        replay = std::move(other.replay);
+        replayPos = other.replayPos;
+        replaying = other.replaying;
+        replayError = other.replayError;
+        piped = std::move(other.piped);
     }
     return *this;
 }
 
-void Lexer::readChar() {
-    if (!file.get(currentChar)) {
-        eof = true;
-        currentChar = '\0';
-    } else {
-        if (currentChar == '\n') {
-            line++;
-            column = 0;
-        } else {
-            column++;
-        }
-    }
-}
-
+// Works on the buffer rather than through readChar: each run of
+// whitespace, and each comment's body, is crossed with one kernel call
+// (memchr for a line comment), and scanning resumes at the byte after it.
 void Lexer::skipWhitespaceAndComments() {
     while (!eof) {
-        while (std::isspace(static_cast<unsigned char>(currentChar)))
-            readChar();
+        if (scanner::isSpace(currentChar)) {
+            seek(pos + scan->spanSpace(text + pos, limit - pos));
+            continue;
+        }
 
-        if (currentChar == '/' && file.peek() == '/') {
-            while (!eof && currentChar != '\n')
-                readChar();
+        if (currentChar == '/' && peekChar() == '/') {
+            const char *nl = static_cast<const char *>(std::memchr(text + pos, '\n', limit - pos));
+            seek(nl ? nl - text : limit);
             continue;
         }
 
-        if (currentChar == '/' && file.peek() == '*') {
+        if (currentChar == '/' && peekChar() == '*') {
             readChar();
             readChar();
             bool closed = false;
-            while (!eof) {
-                if (currentChar == '*' && file.peek() == '/') {
-                    readChar();
-                    readChar();
-                    closed = true;
-                    break;
-                }
-                readChar();
+            if (!eof) {
+                std::size_t from = pos - 1;
+                std::size_t end = from + scan->findCommentEnd(text + from, limit - from);
+                closed = end < limit;
+                seek(closed ? end + 2 : limit);
             }
             if (!closed)
-                std::cerr << "Warning: unterminated block comment\n";
+                *diag << "Warning: unterminated block comment\n";
             continue;
         }
 
@@ -95,14 +359,15 @@ void Lexer::loadKeywordsFromFile(const std::string &filename) {
 
     std::string word;
     while (kwFile >> word)
-        keywords.insert(word);
+        keywords->insert(word);
 }
 
-Token Lexer::makeToken(Token::Type type, const std::string &value, int l, int c) {
+Token Lexer::makeToken(Token::Type type, std::string value, int offset) const {
     Token t;
     t.type = type;
-    t.lexeme = value;
-    t.pos = {l, c};
+    t.lexeme = std::move(value);
+    t.offset = offset;
+    t.lines = lines.get();
     return t;
 }
 
@@ -111,41 +376,51 @@ const Token &Lexer::currentLexeme() const {
 }
 
 Token Lexer::nextLexem() {
+    if (piped)
+        return nextPiped();
+    if (replaying) {
+        if (replayPos + 1 < replay.size())
+            ++replayPos;
+        else if (replayError)
+            std::rethrow_exception(replayError);
+        currentToken = std::move(replay[replayPos]);
+        return currentToken;
+    }
+
     skipWhitespaceAndComments();
     if (eof) {
-        currentToken = makeToken(Token::Type::EndOfFile, "", line, column);
+        currentToken = makeToken(Token::Type::EndOfFile, "", here());
         return currentToken;
     }
 
-    if (std::isalpha(static_cast<unsigned char>(currentChar)) || currentChar == '_') {
-        currentToken = readIdentifierOrKeyword();
-    } else if (std::isdigit(static_cast<unsigned char>(currentChar))) {
-        currentToken = readNumber();
-    } else if (currentChar == '\'') {
+    if (currentChar == '\'') {
         currentToken = readCharLiteral();
     } else if (currentChar == '"') {
         currentToken = readStringLiteral();
     } else {
-        currentToken = readOperatorOrDelimiter();
+        currentToken = readToken();
     }
 
     return currentToken;
 }
 
 Token Lexer::peekNextLexeme() {
-    std::streampos oldPos = file.tellg();
-    int oldLine = line;
-    int oldColumn = column;
+    if (piped)
+        return peekPiped();
+    if (replaying) {
+        if (replayPos + 1 == replay.size() && replayError)
+            std::rethrow_exception(replayError);
+        return replay[std::min(replayPos + 1, replay.size() - 1)];
+    }
+
+    std::size_t oldPos = pos;
     char oldChar = currentChar;
     bool oldEof = eof;
     Token oldToken = currentToken;
 
     Token next = const_cast<Lexer *>(this)->nextLexem();
 
-    file.clear();
-    file.seekg(oldPos);
-    line = oldLine;
-    column = oldColumn;
+    pos = oldPos;
     currentChar = oldChar;
     eof = oldEof;
     currentToken = oldToken;
@@ -153,74 +428,52 @@ Token Lexer::peekNextLexeme() {
     return next;
 }
 
-Token Lexer::readIdentifierOrKeyword() {
-    std::string word;
-    int startLine = line;
-    int startCol = column == 0 ? 1 : column;
-
-    while (std::isalnum(static_cast<unsigned char>(currentChar)) || currentChar == '_') {
-        word += currentChar;
-        readChar();
-    }
-
-    if (keywords.search(word)) {
-        if (word == "int") return makeToken(Token::Type::KwInt, word, startLine, startCol);
-        if (word == "char") return makeToken(Token::Type::KwChar, word, startLine, startCol);
-        if (word == "bool") return makeToken(Token::Type::KwBool, word, startLine, startCol);
-        if (word == "float") return makeToken(Token::Type::KwFloat, word, startLine, startCol);
-        if (word == "void") return makeToken(Token::Type::KwVoid, word, startLine, startCol);
-
-        if (word == "main") return makeToken(Token::Type::KwMain, word, startLine, startCol);
-        if (word == "declare") return makeToken(Token::Type::KwDeclare, word, startLine, startCol);
-
-        if (word == "if") return makeToken(Token::Type::KwIf, word, startLine, startCol);
-        if (word == "else") return makeToken(Token::Type::KwElse, word, startLine, startCol);
-        if (word == "while") return makeToken(Token::Type::KwWhile, word, startLine, startCol);
-        if (word == "for") return makeToken(Token::Type::KwFor, word, startLine, startCol);
-        if (word == "return") return makeToken(Token::Type::KwReturn, word, startLine, startCol);
-        if (word == "break") return makeToken(Token::Type::KwBreak, word, startLine, startCol);
-        if (word == "continue") return makeToken(Token::Type::KwContinue, word, startLine, startCol);
-
-        if (word == "print") return makeToken(Token::Type::KwPrint, word, startLine, startCol);
-        if (word == "read") return makeToken(Token::Type::KwRead, word, startLine, startCol);
-
-        if (word == "true") return makeToken(Token::Type::KwTrue, word, startLine, startCol);
-        if (word == "false") return makeToken(Token::Type::KwFalse, word, startLine, startCol);
+// Runs the DFA from currentChar until it has no transition, and takes
+// the longest prefix that ended in an accepting state.
+Token Lexer::readToken() {
+    const scanner::Dfa &dfa = scanner::dfa;
+    const std::size_t start = pos - 1;
+    std::size_t i = start, end = start;
+    Token::Type type = Token::Type::EndOfFile;
+    std::uint8_t state = scanner::Start;
+
+    while (i < limit) {
+        state = dfa.next[state][dfa.charClass[static_cast<unsigned char>(text[i])]];
+        if (state == scanner::Dead)
+            break;
+        ++i;
+        if (dfa.accept[state] != Token::Type::EndOfFile) {
+            type = dfa.accept[state];
+            end = i;
+        }
     }
 
-    return makeToken(Token::Type::Identifier, word, startLine, startCol);
-}
-
-Token Lexer::readNumber() {
-    int startLine = line;
-    int startCol = column == 0 ? 1 : column;
-    std::string num;
-    bool seenDot = false;
-
-    while (std::isdigit(static_cast<unsigned char>(currentChar)) ||
-           (!seenDot && currentChar == '.')) {
-        if (currentChar == '.')
-            seenDot = true;
-        num += currentChar;
-        readChar();
+    if (end == start) {
+        char c = currentChar;
+        seek(start + 1);
+        SourcePos p = locate(static_cast<int>(start));
+        throw std::runtime_error(
+            std::string("Unknown token '") + c + "' at " + std::to_string(p.line) + ":" + std::to_string(
+                p.column));
     }
 
-    if (seenDot)
-        return makeToken(Token::Type::FloatLiteral, num, startLine, startCol);
-    else
-        return makeToken(Token::Type::IntegerLiteral, num, startLine, startCol);
+    std::string lexeme(text + start, end - start);
+    seek(end);
+    if (type == Token::Type::Identifier && keywords->search(lexeme))
+        type = scanner::keyword(lexeme);
+    return makeToken(type, std::move(lexeme), static_cast<int>(start));
 }
 
 Token Lexer::readCharLiteral() {
-    int startLine = line;
-    int startCol = column == 0 ? 1 : column;
+    int start = here();
 
     readChar();
     std::string content;
 
     if (eof || currentChar == '\n' || currentChar == '\'') {
-        std::cerr << "Error: empty char literal at " << startLine << ":" << startCol << "\n";
-        return makeToken(Token::Type::CharLiteral, "", startLine, startCol);
+        SourcePos p = locate(start);
+        *diag << "Error: empty char literal at " << p.line << ":" << p.column << "\n";
+        return makeToken(Token::Type::CharLiteral, "", start);
     }
 
     if (currentChar == '\\') {
@@ -236,17 +489,17 @@ Token Lexer::readCharLiteral() {
     }
 
     if (currentChar != '\'') {
-        std::cerr << "Error: unterminated char literal at " << startLine << ":" << startCol << "\n";
+        SourcePos p = locate(start);
+        *diag << "Error: unterminated char literal at " << p.line << ":" << p.column << "\n";
     } else {
         readChar();
     }
 
-    return makeToken(Token::Type::CharLiteral, content, startLine, startCol);
+    return makeToken(Token::Type::CharLiteral, content, start);
 }
 
 Token Lexer::readStringLiteral() {
-    int startLine = line;
-    int startCol = column == 0 ? 1 : column;
+    int start = here();
 
     readChar();
     std::string content;
@@ -273,10 +526,11 @@ Token Lexer::readStringLiteral() {
             escaped = true;
         } else if (currentChar == '"') {
             readChar();
-            return makeToken(Token::Type::StringLiteral, content, startLine, startCol);
+            return makeToken(Token::Type::StringLiteral, content, start);
         } else if (currentChar == '\n' || eof) {
-            std::cerr << "Warning: unterminated string literal at "
-                    << startLine << ":" << startCol << "\n";
+            SourcePos p = locate(start);
+            *diag << "Warning: unterminated string literal at "
+                    << p.line << ":" << p.column << "\n";
             break;
         } else {
             content += currentChar;
@@ -284,97 +538,5 @@ Token Lexer::readStringLiteral() {
         readChar();
     }
 
-    return makeToken(Token::Type::StringLiteral, content, startLine, startCol);
-}
-
-Token Lexer::readOperatorOrDelimiter() {
-    int startLine = line;
-    int startCol = column == 0 ? 1 : column;
-    std::string op(1, currentChar);
-    char next = file.peek();
-
-    if (!eof) {
-        std::string two = op + next;
-        if (two == "==") {
-            readChar();
-            readChar();
-            return makeToken(Token::Type::EqualEqual, "==", startLine, startCol);
-        }
-        if (two == "!=") {
-            readChar();
-            readChar();
-            return makeToken(Token::Type::NotEqual, "!=", startLine, startCol);
-        }
-        if (two == "<=") {
-            readChar();
-            readChar();
-            return makeToken(Token::Type::LessEqual, "<=", startLine, startCol);
-        }
-        if (two == ">=") {
-            readChar();
-            readChar();
-            return makeToken(Token::Type::GreaterEqual, ">=", startLine, startCol);
-        }
-        if (two == "++") {
-            readChar();
-            readChar();
-            return makeToken(Token::Type::PlusPlus, "++", startLine, startCol);
-        }
-        if (two == "--") {
-            readChar();
-            readChar();
-            return makeToken(Token::Type::MinusMinus, "--", startLine, startCol);
-        }
-        if (two == "&&") {
-            readChar();
-            readChar();
-            return makeToken(Token::Type::AmpAmp, "&&", startLine, startCol);
-        }
-        if (two == "||") {
-            readChar();
-            readChar();
-            return makeToken(Token::Type::PipePipe, "||", startLine, startCol);
-        }
-        if (two == "<<") {
-            readChar();
-            readChar();
-            return makeToken(Token::Type::Shl, "<<", startLine, startCol);
-        }
-        if (two == ">>") {
-            readChar();
-            readChar();
-            return makeToken(Token::Type::Shr, ">>", startLine, startCol);
-        }
-    }
-
-    char c = currentChar;
-    readChar();
-    switch (c) {
-        case '(': return makeToken(Token::Type::LParen, "(", startLine, startCol);
-        case ')': return makeToken(Token::Type::RParen, ")", startLine, startCol);
-        case '{': return makeToken(Token::Type::LBrace, "{", startLine, startCol);
-        case '}': return makeToken(Token::Type::RBrace, "}", startLine, startCol);
-        case '[': return makeToken(Token::Type::LBracket, "[", startLine, startCol);
-        case ']': return makeToken(Token::Type::RBracket, "]", startLine, startCol);
-        case ',': return makeToken(Token::Type::Comma, ",", startLine, startCol);
-        case ';': return makeToken(Token::Type::Semicolon, ";", startLine, startCol);
-        case '`': return makeToken(Token::Type::Backtick, "`", startLine, startCol);
-        case '+': return makeToken(Token::Type::Plus, "+", startLine, startCol);
-        case '-': return makeToken(Token::Type::Minus, "-", startLine, startCol);
-        case '*': return makeToken(Token::Type::Asterisk, "*", startLine, startCol);
-        case '/': return makeToken(Token::Type::Slash, "/", startLine, startCol);
-        case '%': return makeToken(Token::Type::Percent, "%", startLine, startCol);
-        case '&': return makeToken(Token::Type::Ampersand, "&", startLine, startCol);
-        case '|': return makeToken(Token::Type::VerticalBar, "|", startLine, startCol);
-        case '^': return makeToken(Token::Type::Caret, "^", startLine, startCol);
-        case '!': return makeToken(Token::Type::Exclamation, "!", startLine, startCol);
-        case '~': return makeToken(Token::Type::Tilde, "~", startLine, startCol);
-        case '=': return makeToken(Token::Type::Assign, "=", startLine, startCol);
-        case '<': return makeToken(Token::Type::Less, "<", startLine, startCol);
-        case '>': return makeToken(Token::Type::Greater, ">", startLine, startCol);
-        default:
-            throw std::runtime_error(
-                std::string("Unknown token '") + c + "' at " + std::to_string(startLine) + ":" + std::to_string(
-                    startCol));
-    }
+    return makeToken(Token::Type::StringLiteral, content, start);
 }
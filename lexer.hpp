@@ -1,14 +1,51 @@
 #pragma once
 #include "tokens.hpp"
 #include "trie.hpp"
+#include "kernels.hpp"
+#include <exception>
 #include <string>
 #include <fstream>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <vector>
 
 
 class Lexer {
 public:
 
     explicit Lexer(const std::string &filename, std::string keywordFile = "keywords.txt");
+
+    // Lexes a buffer held in memory, whose LineIndex the caller keeps,
+    // from where reset() points it.
+    Lexer(std::shared_ptr<const std::string> source, std::shared_ptr<const LineIndex> lines,
+          const std::string &keywordFile);
+
+    // Replays tokens lexed earlier; the last one must be EndOfFile.
+    explicit Lexer(std::vector<Token> tokens);
+    ~Lexer();
+
+    // Moves the scanning of the rest of the file onto a producer thread,
+    // which pushes tokens into an SpscRing that nextLexem and
+    // peekNextLexeme read from; a lexical error is rethrown when the
+    // parser reaches it.
+    void pipeline();
+
+    // Lexes the rest of the file now, cut into up to `chunks` pieces that
+    // are scanned on as many threads, and replays the result. The tokens,
+    // positions and lexical errors are the same as nextLexem's; warnings
+    // are written in source order before this returns.
+    void lexInChunks(unsigned chunks);
+
+    // Starts over on `source` at byte `from`, which must be where a token,
+    // or whitespace or a comment before one, begins; an IncrementalCompiler
+    // re-lexes an edited buffer this way. Not for a pipelined Lexer.
+    void reset(std::shared_ptr<const std::string> source, std::shared_ptr<const LineIndex> lines,
+               std::size_t from);
+
+    // Where warnings about bad literals and comments go (std::cerr).
+    void setDiagnostics(std::ostream &os) { diag = &os; }
+
     void loadKeywordsFromFile(const std::string& filename);
 
     Lexer(const Lexer&) = delete;
@@ -22,24 +59,59 @@ public:
     Token peekNextLexeme();
 
 private:
-    std::ifstream file;
-    Trie keywords;
+    std::shared_ptr<const std::string> source;
+    const char *text = nullptr;
+    std::size_t pos = 0;        // next byte readChar takes
+    std::size_t limit = 0;      // end of the bytes this Lexer scans
+    std::shared_ptr<const LineIndex> lines;
+    std::shared_ptr<Trie> keywords;
+    const kernels::Table *scan = &kernels::active();
+    std::ostream *diag = &std::cerr;
     char currentChar = '\0';
     bool eof = false;
-    int line = 1;
-    int column = 0;
 
     Token currentToken;
 
-    void readChar();
+    std::vector<Token> replay;
+    std::size_t replayPos = 0;
+    bool replaying = false;
+    std::exception_ptr replayError;     // thrown on reading past the last token
+
+    struct Pipeline;
+    std::unique_ptr<Pipeline> piped;
+
+    Token nextPiped();
+    Token peekPiped();
+
+    // Scans from where `whole` stands up to byte `end`.
+    Lexer(const Lexer &whole, std::size_t end);
+
+    std::vector<std::size_t> chunkStarts(unsigned chunks) const;
+
+    void readChar() {
+        if (pos >= limit) {
+            eof = true;
+            currentChar = '\0';
+        } else {
+            currentChar = text[pos++];
+        }
+    }
+    // Makes the byte at `to` current, as if read up to it.
+    void seek(std::size_t to) {
+        pos = to;
+        readChar();
+    }
+    // Offset of currentChar; at the end, of the last byte read.
+    int here() const { return static_cast<int>(pos) - 1; }
+    int peekChar() const {
+        return pos < limit ? static_cast<unsigned char>(text[pos]) : std::char_traits<char>::eof();
+    }
     void skipWhitespaceAndComments();
-    static Token makeToken(Token::Type type, const std::string& value, int line, int col);
+    Token makeToken(Token::Type type, std::string value, int offset) const;
+    SourcePos locate(int offset) const { return lines->locate(offset); }
 
-    Token readIdentifierOrKeyword();
-    Token readNumber();
+    Token readToken();
     Token readCharLiteral();
 
     Token readStringLiteral();
-
-    Token readOperatorOrDelimiter();
 };
@@ -3,14 +3,206 @@
 #include "parser.hpp"
 #include "poliz.hpp"
 #include "vm.hpp"
+#include "verifier.hpp"
+#include "transpiler.hpp"
+#include "regcode.hpp"
+#include "batch.hpp"
+#include "incremental.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <string>
 #include <sstream>
+#include <thread>
+#include <unistd.h>
 
-int main() {
+// Lexes `file` with nextLexem alone and again with lexInChunks at several
+// chunk counts, `lexJobs` among them, and reports the
+// first difference in tokens, positions, lexical errors or warnings.
+// Returns false if there is one.
+static bool checkLexer(const std::string &file, const std::string &keywordsFile, unsigned lexJobs) {
+    // The Lexer is kept, as its tokens' positions refer to it.
+    struct Scan {
+        std::unique_ptr<Lexer> lexer;
+        std::vector<Token> tokens;
+        std::string error;
+        std::string warnings;
+    };
+    auto scan = [&](unsigned chunks) {
+        Scan r;
+        std::ostringstream warnings;
+        r.lexer = std::make_unique<Lexer>(file, keywordsFile);
+        r.lexer->setDiagnostics(warnings);
+        r.lexer->lexInChunks(chunks);
+        r.tokens.push_back(r.lexer->currentLexeme());
+        try {
+            while (r.tokens.back().type != Token::Type::EndOfFile)
+                r.tokens.push_back(r.lexer->nextLexem());
+        } catch (const std::exception &e) {
+            r.error = e.what();
+        }
+        r.warnings = warnings.str();
+        return r;
+    };
+
+    std::vector<unsigned> counts = {2, 3, 4, 8, 16, 64};
+    if (lexJobs > 1 && std::find(counts.begin(), counts.end(), lexJobs) == counts.end())
+        counts.push_back(lexJobs);
+
+    const Scan expected = scan(1);
+    for (unsigned chunks : counts) {
+        const Scan got = scan(chunks);
+        std::size_t n = std::min(expected.tokens.size(), got.tokens.size());
+        for (std::size_t i = 0; i <= n; ++i) {
+            if (i < n) {
+                const Token &a = expected.tokens[i], &b = got.tokens[i];
+                if (a.type == b.type && a.lexeme == b.lexeme && a.offset == b.offset)
+                    continue;
+            } else if (expected.tokens.size() == got.tokens.size() &&
+                       expected.error == got.error && expected.warnings == got.warnings) {
+                break;
+            }
+            std::cerr << file << ": " << chunks << " chunks differ from nextLexem at token " << i;
+            if (i < n)
+                std::cerr << ": " << expected.tokens[i].toString() << " vs " << got.tokens[i].toString();
+            std::cerr << "\n";
+            return false;
+        }
+    }
+    std::cout << file << ": chunked lexing matches nextLexem (" << expected.tokens.size() << " tokens)\n";
+    return true;
+}
+
+// Compiles `file`, then applies the edits listed in `editsFile` one by
+// one, as an editor would while the file is being typed in, keeping the
+// program up to date with an IncrementalCompiler. Each line of the list is
+// "<offset> <length> <text>": `length` bytes at byte `offset` become the
+// rest of the line, in which \n, \t and \\ stand for a newline, a tab
+// and a backslash. Returns whether the edited source compiles, putting its
+// program in `out`.
+static bool compileWithEdits(const std::string &file, const std::string &keywordsFile,
+                             const std::string &editsFile, bool vectorize, bool timed, Poliz &out) {
+    std::ifstream list(editsFile);
+    if (!list) {
+        std::cerr << "Error: cannot open " << editsFile << "\n";
+        return false;
+    }
+
+    IncrementalCompiler compiler(file, keywordsFile);
+    compiler.setVectorize(vectorize);
+    auto start = std::chrono::steady_clock::now();
+    bool ok = compiler.compile();
+    if (timed)
+        std::cerr << file << ": full compile, "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+                  << " ms\n";
+
+    std::string line;
+    for (int n = 1; std::getline(list, line); ++n) {
+        if (line.empty())
+            continue;
+        std::istringstream fields(line);
+        std::size_t offset, length;
+        if (!(fields >> offset >> length)) {
+            std::cerr << editsFile << ":" << n << ": expected <offset> <length> <text>\n";
+            return false;
+        }
+        fields.get();
+        std::string text;
+        for (char c; fields.get(c);) {
+            if (c == '\\' && fields.get(c))
+                c = c == 'n' ? '\n' : c == 't' ? '\t' : c;
+            text += c;
+        }
+
+        start = std::chrono::steady_clock::now();
+        try {
+            ok = compiler.edit(offset, length, text);
+        } catch (const std::out_of_range &e) {
+            std::cerr << editsFile << ":" << n << ": " << e.what() << "\n";
+            return false;
+        }
+        if (timed)
+            std::cerr << file << ": edit " << n << ", "
+                      << (compiler.lastEditIncremental() ? "one body" : "full compile") << ", "
+                      << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+                      << " ms\n";
+    }
+
+    if (ok)
+        out = compiler.program();
+    return ok;
+}
+
+int main(int argc, char** argv) {
     const std::string keywordsFile = "keywords.txt";
 
+    bool quiet = false;
+    bool timed = false;
+    bool vectorize = true;
+    int jitThreshold = 1000;
+    std::string emitCpp;
+    std::string engine = "switch";
+    int tierThreshold = 100;
+    bool stats = false;
+    bool lineBuffered = isatty(STDOUT_FILENO);
+    bool prefetchInput = false;
+    std::string batchPath;
+    unsigned jobs = 0;
+    unsigned compileJobs = 1;
+    bool pipelineLexer = false;
+    unsigned lexJobs = 1;
+    bool lexerCheck = false;
+    std::string editsPath;
+    std::vector<std::string> sourceFiles;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--quiet")
+            quiet = true;
+        else if (arg == "--time")
+            timed = true;
+        // Scalar loops only. Vectorized float sums and dot products add in
+        // a different order, so their last digits can differ; see Vectorizer.
+        else if (arg == "--no-vectorize")
+            vectorize = false;
+        else if (arg == "--no-jit")
+            jitThreshold = 0;
+        else if (arg.rfind("--jit-threshold=", 0) == 0)
+            jitThreshold = std::stoi(arg.substr(16));
+        else if (arg == "--stats")
+            stats = true;
+        else if (arg == "--line-buffered")
+            lineBuffered = true;
+        else if (arg == "--prefetch-input")
+            prefetchInput = true;
+        else if (arg.rfind("--tier-threshold=", 0) == 0)
+            tierThreshold = std::stoi(arg.substr(17));
+        else if (arg.rfind("--engine=", 0) == 0)
+            engine = arg.substr(9);
+        else if (arg.rfind("--batch=", 0) == 0)
+            batchPath = arg.substr(8);
+        else if (arg.rfind("--jobs=", 0) == 0)
+            jobs = static_cast<unsigned>(std::stoul(arg.substr(7)));
+        else if (arg == "--pipeline-lexer")
+            pipelineLexer = true;
+        else if (arg.rfind("--lex-jobs=", 0) == 0)
+            lexJobs = static_cast<unsigned>(std::stoul(arg.substr(11)));
+        else if (arg == "--check-lexer")
+            lexerCheck = true;
+        else if (arg.rfind("--edits=", 0) == 0)
+            editsPath = arg.substr(8);
+        else if (arg.rfind("--compile-jobs=", 0) == 0)
+            compileJobs = static_cast<unsigned>(std::stoul(arg.substr(15)));
+        else if (arg.rfind("--emit-cpp=", 0) == 0)
+            emitCpp = arg.substr(11);
+        else
+            sourceFiles.push_back(arg);
+    }
+
     std::vector<std::string> testFiles = {
         "tests/Correct3.txt",
         // "tests/Correct2.txt",
@@ -22,27 +214,130 @@ int main() {
         // "tests/Incorrect5.txt",
     };
 
+    if (!sourceFiles.empty())
+        testFiles = sourceFiles;
+
+    // With --batch, each program runs once per input file (a directory or
+    // a list of paths) instead of once on stdin.
+    std::vector<std::string> batchInputs;
+    if (!batchPath.empty()) {
+        try {
+            batchInputs = BatchRunner::collectInputs(batchPath);
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+    }
+    int status = 0;
+
+    // One reader for all programs: each takes its input from where the
+    // previous one stopped.
+    InputBuffer input(STDIN_FILENO, prefetchInput);
+
     for (const auto& sourceFile : testFiles) {
-        std::cout << "Компиляция: " << sourceFile << "\n";
+        if (lexerCheck) {
+            if (!checkLexer(sourceFile, keywordsFile,
+                            lexJobs ? lexJobs : std::max(1u, std::thread::hardware_concurrency())))
+                status = 1;
+            continue;
+        }
+
+        if (!quiet)
+            std::cout << "Компиляция: " << sourceFile << "\n";
 
-        Lexer   lexer(sourceFile, keywordsFile);
-        Semanter sem;
         Poliz   poliz;
+        bool    parsed;
 
-        Parser parser(lexer, sem, poliz);
+        if (!editsPath.empty()) {
+            parsed = compileWithEdits(sourceFile, keywordsFile, editsPath, vectorize, timed, poliz);
+        } else {
+            Lexer   lexer(sourceFile, keywordsFile);
+            if (pipelineLexer)
+                lexer.pipeline();
+            else if (lexJobs != 1)
+                lexer.lexInChunks(lexJobs ? lexJobs : std::max(1u, std::thread::hardware_concurrency()));
+            Semanter sem;
 
-        if (parser.parseProgram()) {
-            std::cout << "Разбор завершён успешно\n";
+            Parser parser(lexer, sem, poliz);
+            parser.setVectorize(vectorize);
+            parser.setCompileJobs(compileJobs);
+            parsed = parser.parseProgram();
+        }
+
+        if (parsed) {
+            Verifier verifier(poliz);
+            bool verified = verifier.run();
+
+            if (!quiet) {
+                std::cout << "Разбор завершён успешно\n";
+                if (verified)
+                    std::cout << "Верификация пройдена\n";
+                else
+                    std::cout << "Верификация не пройдена: " << verifier.error() << "\n";
+
+                poliz.dump(std::cout);
+
+                std::cout << "VM start\n";
+            }
 
-            poliz.dump(std::cout);
+            if (!emitCpp.empty()) {
+                std::ofstream out(emitCpp);
+                Transpiler transpiler(poliz);
+                if (!out || !transpiler.emit(out))
+                    std::cerr << sourceFile << ": cannot emit C++: "
+                              << (out ? transpiler.error() : "cannot open " + emitCpp) << "\n";
+                continue;
+            }
 
-            std::cout << "VM start\n";
-            InputBuffer input(std::cin);
+            RegisterCode registerCode(poliz);
+            if (engine == "register") {
+                if (!registerCode.translate())
+                    std::cerr << sourceFile << ": no register code: " << registerCode.error() << "\n";
+                else if (!quiet)
+                    registerCode.dump(std::cout);
+            }
 
-            VM vm(poliz, input);
+            auto configure = [&](VM &vm) {
+                if (jitThreshold > 0)
+                    vm.enableJit(jitThreshold);
+                if (engine == "closure")
+                    vm.enableClosures();
+                else if (engine == "cached")
+                    vm.enableStackCache();
+                else if (engine == "register" && !registerCode.code().empty())
+                    vm.enableRegisters(registerCode);
+                else if (engine == "tiered")
+                    vm.enableTiering(tierThreshold);
+            };
+
+            if (!batchPath.empty()) {
+                BatchRunner runner(poliz, configure);
+                auto start = std::chrono::steady_clock::now();
+                int failed = runner.run(batchInputs, jobs, STDOUT_FILENO, std::cerr);
+                auto elapsed = std::chrono::steady_clock::now() - start;
+                if (failed)
+                    status = 1;
+                if (timed)
+                    std::cerr << sourceFile << ": " << batchInputs.size() << " runs, "
+                              << std::chrono::duration<double, std::milli>(elapsed).count() << " ms\n";
+                continue;
+            }
+
+            OutputSink output(STDOUT_FILENO, lineBuffered);
+
+            VM vm(poliz, input, output);
+            configure(vm);
+            auto start = std::chrono::steady_clock::now();
             vm.run();
+            auto elapsed = std::chrono::steady_clock::now() - start;
+
+            if (timed)
+                std::cerr << sourceFile << ": "
+                          << std::chrono::duration<double, std::milli>(elapsed).count() << " ms\n";
+            if (stats)
+                vm.dumpStats(std::cerr);
         }
     }
 
-    return 0;
+    return status;
 }
\ No newline at end of file
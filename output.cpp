@@ -0,0 +1,78 @@
+#include "output.hpp"
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <unistd.h>
+
+
+OutputSink::OutputSink(int fd, bool lineBuffered)
+    : fd(fd), lineBuffered(lineBuffered), buffer(new char[capacity]) {
+}
+
+OutputSink::OutputSink() : OutputSink(-1) {
+}
+
+OutputSink::~OutputSink() {
+    try {
+        flush();
+    } catch (...) {
+    }
+}
+
+// Room for n more bytes; n is at most a formatted number, far below capacity.
+char *OutputSink::reserve(std::size_t n) {
+    if (capacity - used < n)
+        flush();
+    return buffer.get() + used;
+}
+
+void OutputSink::write(std::string_view s) {
+    if (s.size() > capacity - used)
+        flush();
+    if (s.size() > capacity) {
+        writeAll(s.data(), s.size());
+        return;
+    }
+    std::memcpy(buffer.get() + used, s.data(), s.size());
+    used += s.size();
+}
+
+void OutputSink::writeInt(int32_t v) {
+    char *p = reserve(16);
+    used = std::to_chars(p, p + 16, v).ptr - buffer.get();
+}
+
+void OutputSink::writeFloat(float v) {
+    char *p = reserve(32);
+    used = std::to_chars(p, p + 32, v, std::chars_format::general, 6).ptr - buffer.get();
+}
+
+void OutputSink::flush() {
+    std::size_t n = used;
+    used = 0;
+    writeAll(buffer.get(), n);
+}
+
+std::string OutputSink::take() {
+    flush();
+    return std::move(collected);
+}
+
+void OutputSink::writeAll(const char *data, std::size_t size) {
+    if (fd < 0) {
+        collected.append(data, size);
+        return;
+    }
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw std::runtime_error(std::string("Output: write failed: ") + std::strerror(errno));
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+
+// Where PRINT output goes. Values are formatted with std::to_chars into a
+// user-space buffer that is handed to write(2) when it fills up and when
+// the program finishes; in line-buffered mode (interactive use) it is also
+// flushed at the end of every line.
+class OutputSink {
+public:
+    explicit OutputSink(int fd, bool lineBuffered = false);
+
+    // Collects the output in memory instead; see take().
+    OutputSink();
+    ~OutputSink();
+
+    OutputSink(const OutputSink &) = delete;
+    OutputSink &operator=(const OutputSink &) = delete;
+
+    void put(char c) {
+        if (used == capacity)
+            flush();
+        buffer[used++] = c;
+    }
+
+    void endLine() {
+        put('\n');
+        if (lineBuffered)
+            flush();
+    }
+
+    void write(std::string_view s);
+    void writeInt(int32_t v);
+
+    // Same digits as `std::cout << v`: %g with six significant digits.
+    void writeFloat(float v);
+
+    void flush();
+
+    // Everything written since the last take(), for a sink built without
+    // a file descriptor.
+    std::string take();
+
+private:
+    static constexpr std::size_t capacity = 1 << 16;
+
+    int fd;
+    bool lineBuffered;
+    std::string collected;
+    std::unique_ptr<char[]> buffer;
+    std::size_t used = 0;
+
+    char *reserve(std::size_t n);
+    void writeAll(const char *data, std::size_t size);
+};
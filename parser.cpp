@@ -1,6 +1,13 @@
 #include "parser.hpp"
+#include "builtins.hpp"
+#include "vectorizer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
 #include <iostream>
+#include <thread>
 #include <unordered_set>
+#include <cstring>
 
 Parser::Parser(Lexer &l, Semanter &s, Poliz &p)
     : lex(l), sem(s), poliz(p) {
@@ -37,12 +44,12 @@ bool Parser::parseProgram() {
         while (match(Token::Type::KwDeclare))
             parseFunctionDeclaration();
 
+        if (compileJobs != 1 || units)
+            parseDefinitionsParallel();
         while (matchType())
             parseFunctionDefinition();
 
-        int mainEntry = poliz.currentIp();
-        parseMain();
-        poliz.patchJump(start, mainEntry);
+        poliz.patchJump(start, parseMain());
 
 
 
@@ -50,7 +57,9 @@ bool Parser::parseProgram() {
         poliz.emit(Poliz::Op::HALT);
         return true;
     } catch (const std::exception &e) {
-        auto pos = lex.currentLexeme().pos;
+        SourcePos pos = lex.currentLexeme().pos();
+        if (auto *ce = dynamic_cast<const CompileError *>(&e))
+            pos = ce->pos;
         std::cerr << "Error at "
                 << pos.line << ":" << pos.column
                 << "\n" << e.what() << "\n";
@@ -73,6 +82,32 @@ TypeInfo Parser::parseType() {
     }
 }
 
+TypeInfo Parser::parseParamArraySuffix(const TypeInfo &elem) {
+    if (!match(Token::Type::LBracket))
+        return elem;
+
+    if (elem.isVoid())
+        throw std::runtime_error("array of void");
+
+    std::vector<int> dims;
+    while (match(Token::Type::LBracket)) {
+        lex.nextLexem();
+        int size = -1;
+        if (match(Token::Type::IntegerLiteral)) {
+            size = std::stoi(lex.currentLexeme().lexeme);
+            if (size <= 0)
+                throw std::runtime_error("array dimension must be positive");
+            lex.nextLexem();
+        } else if (!dims.empty()) {
+            throw std::runtime_error("only the first array dimension may be omitted");
+        }
+        expect(Token::Type::RBracket, "]");
+        dims.push_back(size);
+    }
+
+    return TypeInfo::makeArray(elem, dims);
+}
+
 void Parser::parseFunctionDeclaration() {
     expect(Token::Type::KwDeclare, "'declare'");
 
@@ -91,7 +126,7 @@ void Parser::parseFunctionDeclaration() {
     std::vector<TypeInfo> params;
     if (!match(Token::Type::RParen)) {
         do {
-            params.push_back(parseType());
+            params.push_back(parseParamArraySuffix(parseType()));
             if (!match(Token::Type::Comma))
                 break;
             lex.nextLexem();
@@ -107,12 +142,23 @@ void Parser::parseFunctionDeclaration() {
     fn->polizIndex = poliz.registerFunction(
         name,
         -1,
-        params.size()
+        params,
+        ret
     );
 }
 
 void Parser::parseFunctionDefinition() {
-    TypeInfo ret = parseType();
+    FunctionDef def = parseFunctionHeader();
+    parseFunctionBody(def);
+
+    def.symbol->entryIp = def.entryIp;
+    poliz.setFunctionEntry(def.symbol->polizIndex, def.entryIp);
+    poliz.setFunctionFrame(def.symbol->polizIndex, def.frameSize);
+}
+
+Parser::FunctionDef Parser::parseFunctionHeader() {
+    FunctionDef def;
+    def.ret = parseType();
 
     Token nameTok = lex.currentLexeme();
     expect(Token::Type::Identifier, "function name");
@@ -120,18 +166,16 @@ void Parser::parseFunctionDefinition() {
 
     expect(Token::Type::LParen, "(");
 
-    std::vector<TypeInfo> paramTypes;
-    std::vector<std::string> paramNames;
-
     if (!match(Token::Type::RParen)) {
         do {
             TypeInfo t = parseType();
 
             Token id = lex.currentLexeme();
             expect(Token::Type::Identifier, "parameter name");
+            t = parseParamArraySuffix(t);
 
-            paramTypes.push_back(t);
-            paramNames.push_back(id.lexeme);
+            def.paramTypes.push_back(t);
+            def.paramNames.push_back(id.lexeme);
 
             if (!match(Token::Type::Comma))
                 break;
@@ -141,45 +185,202 @@ void Parser::parseFunctionDefinition() {
 
     expect(Token::Type::RParen, ")");
 
-    FunctionSymbol* fn = sem.defineFunction(name, ret, paramTypes);
+    def.symbol = sem.defineFunction(name, def.ret, def.paramTypes);
+    return def;
+}
 
+// Emits `JUMP past; body; [RET_VOID]` at the current ip. Only touches the
+// function table through `def`, so it can emit into a Poliz of its own.
+void Parser::parseFunctionBody(FunctionDef &def) {
     int skipJump = poliz.emitJump(Poliz::Op::JUMP);
 
-    fn->entryIp = poliz.currentIp();
-
-    poliz.setFunctionEntry(fn->polizIndex, fn->entryIp);
+    def.entryIp = poliz.currentIp();
 
-    sem.enterFunctionScope(ret);
+    sem.enterFunctionScope(def.ret);
 
-    for (size_t i = 0; i < paramNames.size(); ++i) {
-        sem.declareVariable(paramNames[i], paramTypes[i]);
+    for (size_t i = 0; i < def.paramNames.size(); ++i) {
+        sem.declareVariable(def.paramNames[i], def.paramTypes[i]);
     }
 
     parseBlock();
 
+    def.frameSize = sem.frameSize();
     sem.leaveScope();
 
-    if (ret.isVoid()) {
+    if (def.ret.isVoid()) {
         poliz.emit(Poliz::Op::RET_VOID);
     }
 
     poliz.patchJump(skipJump, poliz.currentIp());
 }
 
-void Parser::parseMain() {
+// Every function is declared before the definitions, so a body only needs
+// the signatures to compile. Headers are parsed here in order, which also
+// marks each function defined; each body's tokens, found by brace
+// matching, then go to a worker with its own Parser, copy of the Semanter
+// and Poliz. Appending the bodies in source order gives the same code as
+// parseFunctionDefinition one after another, and of several errors the
+// first in the source is reported.
+void Parser::parseDefinitionsParallel() {
+    struct Body {
+        FunctionDef def;
+        std::vector<Token> tokens;
+        Poliz code;
+        std::string error;
+        SourcePos errorPos;
+        bool cut = false;       // the lexer failed in it; see collectBlock
+    };
+    std::vector<Body> bodies;
+
+    // A bad header (or token) ends the definitions; it comes after every
+    // body collected so far, so is reported only if they all compile.
+    std::exception_ptr stopped;
+    try {
+        while (matchType()) {
+            Body b;
+            b.def = parseFunctionHeader();
+            b.tokens = collectBlock(stopped);
+            b.cut = static_cast<bool>(stopped);
+            bodies.push_back(std::move(b));
+            if (stopped)
+                break;
+        }
+    } catch (const std::exception &) {
+        stopped = std::current_exception();
+    }
+
+    std::atomic<std::size_t> nextBody{0};
+    auto worker = [&](Semanter local) {
+        for (;;) {
+            std::size_t i = nextBody.fetch_add(1, std::memory_order_relaxed);
+            if (i >= bodies.size())
+                return;
+            Body &b = bodies[i];
+            try {
+                compileBody(units ? b.tokens : std::move(b.tokens), local, b.def, b.code, vectorize,
+                            b.cut ? stopped : nullptr);
+            } catch (const CompileError &e) {
+                b.error = e.what();
+                b.errorPos = e.pos;
+            } catch (const std::exception &) {
+                // Reached the lexer's error; `stopped` reports it.
+            }
+        }
+    };
+
+    unsigned jobs = compileJobs ? compileJobs : std::max(1u, std::thread::hardware_concurrency());
+    jobs = static_cast<unsigned>(std::min<std::size_t>(jobs, bodies.size()));
+    std::vector<std::thread> pool;
+    for (unsigned j = 1; j < jobs; ++j)
+        pool.emplace_back(worker, sem);
+    worker(sem);
+    for (std::thread &t : pool)
+        t.join();
+
+    for (Body &b : bodies) {
+        if (!b.error.empty())
+            throw CompileError(b.error, b.errorPos);
+        if (b.cut)
+            break;
+        int base = poliz.append(b.code);
+        b.def.entryIp += base;
+        b.def.symbol->entryIp = b.def.entryIp;
+        poliz.setFunctionEntry(b.def.symbol->polizIndex, b.def.entryIp);
+        poliz.setFunctionFrame(b.def.symbol->polizIndex, b.def.frameSize);
+        if (units) {
+            b.tokens.pop_back();
+            units->push_back({std::move(b.def), std::move(b.tokens), base, poliz.currentIp()});
+        }
+    }
+    if (stopped)
+        std::rethrow_exception(stopped);
+}
+
+// The tokens of the block starting at the current token, found by brace
+// matching and followed by an EndOfFile at the token after it. A lexical
+// error ends them early and goes in `cut`, for compileBody to report once
+// the tokens before it compile.
+std::vector<Token> Parser::collectBlock(std::exception_ptr &cut) {
+    std::vector<Token> tokens;
+    int depth = 0;
+    try {
+        do {
+            const Token &t = lex.currentLexeme();
+            if (t.type == Token::Type::EndOfFile)
+                break;
+            if (t.type == Token::Type::LBrace)
+                ++depth;
+            else if (t.type == Token::Type::RBrace)
+                --depth;
+            tokens.push_back(t);
+            lex.nextLexem();
+        } while (depth > 0);
+    } catch (const std::exception &) {
+        cut = std::current_exception();
+    }
+    Token end = lex.currentLexeme();
+    end.type = Token::Type::EndOfFile;
+    end.lexeme.clear();
+    tokens.push_back(std::move(end));
+    return tokens;
+}
+
+void Parser::compileBody(std::vector<Token> tokens, Semanter &sem, FunctionDef &def, Poliz &code,
+                         bool vectorize, std::exception_ptr cut) {
+    Lexer lexer(std::move(tokens));
+    Parser parser(lexer, sem, code);
+    parser.setVectorize(vectorize);
+    try {
+        parser.parseFunctionBody(def);
+    } catch (const std::exception &e) {
+        if (cut && lexer.currentLexeme().type == Token::Type::EndOfFile)
+            std::rethrow_exception(cut);
+        throw CompileError(e.what(), lexer.currentLexeme().pos());
+    }
+}
+
+// Returns main's entry ip. When recording units, main's body is compiled
+// on its own like the others, behind the same jump over it.
+int Parser::parseMain() {
     expect(Token::Type::KwMain, "'main'");
 
     FunctionSymbol* fn =
         sem.defineFunction("main", TypeInfo(Token::Type::KwVoid), {});
 
     fn->entryIp = poliz.currentIp();
-    fn->polizIndex = poliz.registerFunction("main", fn->entryIp, 0);
+    if (fn->polizIndex < 0)
+        fn->polizIndex = poliz.registerFunction("main", fn->entryIp, {}, TypeInfo(Token::Type::KwVoid));
+    else
+        poliz.setFunctionEntry(fn->polizIndex, fn->entryIp);
+
+    if (units) {
+        FunctionDef def;
+        def.ret = TypeInfo(Token::Type::KwVoid);
+        def.symbol = fn;
+        std::exception_ptr cut;
+        std::vector<Token> tokens = collectBlock(cut);
+        Poliz code;
+        compileBody(tokens, sem, def, code, vectorize, cut);
+        if (cut)
+            std::rethrow_exception(cut);
+
+        int base = poliz.append(code);
+        def.entryIp += base;
+        fn->entryIp = def.entryIp;
+        poliz.setFunctionEntry(fn->polizIndex, def.entryIp);
+        poliz.setFunctionFrame(fn->polizIndex, def.frameSize);
+        tokens.pop_back();
+        units->push_back({std::move(def), std::move(tokens), base, poliz.currentIp()});
+        return fn->entryIp;
+    }
 
     sem.enterFunctionScope(TypeInfo(Token::Type::KwVoid));
     parseBlock();
+    poliz.setFunctionFrame(fn->polizIndex, sem.frameSize());
     sem.leaveScope();
     poliz.emit(Poliz::Op::RET_VOID);
 
+    return fn->entryIp;
 }
 
 void Parser::parseBlock() {
@@ -268,14 +469,20 @@ void Parser::parseDeclaration() {
     std::string name = id.lexeme;
 
     if (match(Token::Type::LBracket)) {
-        lex.nextLexem();
-        Token sizeTok = lex.currentLexeme();
-        expect(Token::Type::IntegerLiteral, "array size");
-        int size = std::stoi(sizeTok.lexeme);
-        expect(Token::Type::RBracket, "]");
+        std::vector<int> dims;
+        while (match(Token::Type::LBracket)) {
+            lex.nextLexem();
+            Token sizeTok = lex.currentLexeme();
+            expect(Token::Type::IntegerLiteral, "array size");
+            dims.push_back(std::stoi(sizeTok.lexeme));
+            expect(Token::Type::RBracket, "]");
+        }
         expect(Token::Type::Semicolon, ";");
 
-        sem.declareArray(name, base, size);
+        sem.declareArray(name, base, dims);
+
+        Symbol *sym = sem.lookupVariable(name);
+        poliz.emit(Poliz::Op::NEW_ARRAY, sym->slot, poliz.addArrayType(sym->type));
         return;
     }
 
@@ -392,6 +599,9 @@ void Parser::parseFor() {
         poliz.patchJump(c, iterPos);
 
     loopStack.pop_back();
+
+    if (vectorize)
+        Vectorizer::lowerFor(poliz, {condPos, iterPos, bodyPos, endPos}, sem);
 }
 
 void Parser::parseReturn() {
@@ -412,6 +622,7 @@ void Parser::parseReturn() {
 
     TypeInfo t = sem.popType();
     sem.checkReturn(sem.currentReturnType(), t);
+    promoteAt(poliz.currentIp(), sem.currentReturnType(), t);
     poliz.emit(Poliz::Op::RET_VALUE);
 
     expect(Token::Type::Semicolon, "';'");
@@ -422,9 +633,13 @@ void Parser::parsePrint() {
     expect(Token::Type::LParen, "(");
 
     parseExpression();
-    sem.checkPrint(sem.popType());
+    TypeInfo t = sem.popType();
+    sem.checkPrint(t);
 
-    poliz.emit(Poliz::Op::PRINT);
+    if (t.isArray)
+        poliz.emit(Poliz::Op::CALL_BUILTIN, static_cast<int>(Builtin::Print), poliz.addArrayType(t));
+    else
+        poliz.emit(Poliz::Op::PRINT);
 
     expect(Token::Type::RParen, ")");
     expect(Token::Type::Semicolon, "';'");
@@ -443,12 +658,16 @@ void Parser::parseRead() {
     lastLValue.reset();
 
     TypeInfo t = sem.popType();
+    sem.checkRead(t);
+
+    if (t.isArray) {
+        parseReadArray(lv, t);
+        return;
+    }
 
     expect(Token::Type::RParen, ")");
     expect(Token::Type::Semicolon, "';'");
 
-    sem.checkRead(t);
-
     switch (t.baseType) {
         case Token::Type::KwInt:
             poliz.emit(Poliz::Op::READ_INT);
@@ -469,6 +688,27 @@ void Parser::parseRead() {
     emitStoreToLValue(lv);
 }
 
+// read(arr, n) fills arr's first n elements (in row-major order for a
+// multi-dimensional array); read(arr) fills all of them.
+void Parser::parseReadArray(const LValueDesc &lv, const TypeInfo &t) {
+    emitLoadFromLValue(lv);
+
+    if (match(Token::Type::Comma)) {
+        lex.nextLexem();
+        parseExpression();
+        sem.checkReadCount(sem.popType());
+    } else {
+        if (t.arraySize < 0)
+            throw std::runtime_error("read(): array size unknown, use read(arr, n)");
+        poliz.emit(Poliz::Op::PUSH_INT, t.arraySize);
+    }
+
+    expect(Token::Type::RParen, ")");
+    expect(Token::Type::Semicolon, "';'");
+
+    poliz.emit(Poliz::Op::CALL_BUILTIN, static_cast<int>(Builtin::Read), poliz.addArrayType(t));
+}
+
 void Parser::parseExpression() {
     parseComma();
     finalizeRValue();
@@ -504,6 +744,7 @@ void Parser::parseAssignment() {
 
         TypeInfo right = sem.popType();
         sem.checkAssignment(left, right);
+        promoteAt(poliz.currentIp(), left, right);
 
         emitStoreToLValue(target);
         sem.pushType(left);
@@ -519,6 +760,7 @@ void Parser::parseLogicalOr() {
 
         lex.nextLexem();
         parseLogicalAnd();
+        finalizeRValue();
         sem.checkBinaryOp(Token::Type::PipePipe);
         poliz.emit(Poliz::Op::LOG_OR);
 
@@ -533,6 +775,7 @@ void Parser::parseLogicalAnd() {
 
         lex.nextLexem();
         parseBitwiseOr();
+        finalizeRValue();
         sem.checkBinaryOp(Token::Type::AmpAmp);
         poliz.emit(Poliz::Op::LOG_AND);
 
@@ -547,6 +790,7 @@ void Parser::parseBitwiseOr() {
 
         lex.nextLexem();
         parseBitwiseXor();
+        finalizeRValue();
         sem.checkBinaryOp(Token::Type::VerticalBar);
         poliz.emit(Poliz::Op::OR);
     }
@@ -560,6 +804,7 @@ void Parser::parseBitwiseXor() {
 
         lex.nextLexem();
         parseBitwiseAnd();
+        finalizeRValue();
         sem.checkBinaryOp(Token::Type::Caret);
         poliz.emit(Poliz::Op::XOR);
     }
@@ -573,6 +818,7 @@ void Parser::parseBitwiseAnd() {
 
         lex.nextLexem();
         parseEquality();
+        finalizeRValue();
         sem.checkBinaryOp(Token::Type::Ampersand);
         poliz.emit(Poliz::Op::AND);
     }
@@ -587,6 +833,7 @@ void Parser::parseEquality() {
         Token op = lex.currentLexeme();
         lex.nextLexem();
         parseRelational();
+        finalizeRValue();
         sem.checkBinaryOp(op.type);
         poliz.emit(
             op.type == Token::Type::EqualEqual
@@ -630,6 +877,7 @@ void Parser::parseShift() {
         Token op = lex.currentLexeme();
         lex.nextLexem();
         parseAdditive();
+        finalizeRValue();
         sem.checkBinaryOp(op.type);
         poliz.emit(op.type == Token::Type::Shl
                        ? Poliz::Op::SHL
@@ -647,6 +895,7 @@ void Parser::parseAdditive() {
         Token op = lex.currentLexeme();
         lex.nextLexem();
         parseMultiplicative();
+        finalizeRValue();
         sem.checkBinaryOp(op.type);
         poliz.emit(
             op.type == Token::Type::Plus
@@ -667,6 +916,7 @@ void Parser::parseMultiplicative() {
         Token op = lex.currentLexeme();
         lex.nextLexem();
         parseUnary();
+        finalizeRValue();
         sem.checkBinaryOp(op.type);
         switch (op.type) {
             case Token::Type::Asterisk: poliz.emit(Poliz::Op::MUL); break;
@@ -684,6 +934,7 @@ void Parser::parseUnary() {
         Token op = lex.currentLexeme();
         lex.nextLexem();
         parseUnary();
+        finalizeRValue();
         sem.checkUnaryOp(op.type);
 
         poliz.emit(
@@ -713,9 +964,14 @@ void Parser::parsePrimary() {
 
             sem.beginFunctionCall(id.lexeme);
 
+            // The overload is only known once every argument is parsed, so
+            // record where each one ends to promote it afterwards.
+            std::vector<std::pair<int, TypeInfo>> args;
             if (!match(Token::Type::RParen)) {
                 do {
                     parseLogicalOr();
+                    finalizeRValue();
+                    args.emplace_back(poliz.currentIp(), sem.peekType());
                     sem.addCallArg();
                     if (!match(Token::Type::Comma)) break;
                     lex.nextLexem();
@@ -726,7 +982,12 @@ void Parser::parsePrimary() {
 
             FunctionSymbol* f = sem.endFunctionCall();
             finalizeRValue();
-            poliz.emit(Poliz::Op::CALL, f->polizIndex);
+            for (std::size_t i = args.size(); i-- > 0;)
+                promoteAt(args[i].first, f->sig.params[i], args[i].second);
+            if (f->builtin >= 0)
+                poliz.emit(Poliz::Op::CALL_BUILTIN, f->builtin, poliz.addArrayType(f->sig.params[0]));
+            else
+                poliz.emit(Poliz::Op::CALL, f->polizIndex);
 
             return;
         }
@@ -758,9 +1019,20 @@ void Parser::parseLiteral() {
             break;
         }
 
-        case Token::Type::CharLiteral:
-            poliz.emit(Poliz::Op::PUSH_CHAR, tok.lexeme[1]);
+        case Token::Type::CharLiteral: {
+            char c = tok.lexeme.empty() ? '\0' : tok.lexeme[0];
+            if (c == '\\' && tok.lexeme.size() > 1) {
+                switch (tok.lexeme[1]) {
+                    case 'n': c = '\n'; break;
+                    case 't': c = '\t'; break;
+                    case 'r': c = '\r'; break;
+                    case '0': c = '\0'; break;
+                    default:  c = tok.lexeme[1]; break;
+                }
+            }
+            poliz.emit(Poliz::Op::PUSH_CHAR, c);
             break;
+        }
 
         case Token::Type::KwTrue:
             poliz.emit(Poliz::Op::PUSH_BOOL, 1);
@@ -797,14 +1069,20 @@ void Parser::parseLValue() {
 
     TypeInfo curType = sym->type;
 
-    if (match(Token::Type::LBracket)) {
+    int indices = 0;
+    while (match(Token::Type::LBracket)) {
         lex.nextLexem();
         parseExpression();
         TypeInfo idx = sem.popType();
         sem.checkArrayIndex(curType, idx);
         expect(Token::Type::RBracket, "]");
+        ++indices;
+    }
 
+    if (indices > 0) {
+        sem.checkArrayRank(curType, indices);
         lv.kind = LValueDesc::Kind::ArrayElem;
+        lv.indexCount = indices;
         curType = TypeInfo(curType.baseType);
     }
 
@@ -818,7 +1096,8 @@ void Parser::emitLoadFromLValue(const LValueDesc &lv) {
             poliz.emit(Poliz::Op::LOAD_VAR, lv.base->slot);
             break;
         case LValueDesc::Kind::ArrayElem:
-            poliz.emit(Poliz::Op::LOAD_ELEM, lv.base->slot);
+            poliz.emit(lv.indexCount == 1 ? Poliz::Op::LOAD_ELEM : Poliz::Op::LOAD_ELEM_N,
+                       lv.base->slot, poliz.addArrayType(lv.base->type));
             break;
     }
 }
@@ -829,7 +1108,8 @@ void Parser::emitStoreToLValue(const LValueDesc &lv) {
             poliz.emit(Poliz::Op::STORE_VAR, lv.base->slot);
             break;
         case LValueDesc::Kind::ArrayElem:
-            poliz.emit(Poliz::Op::STORE_ELEM, lv.base->slot);
+            poliz.emit(lv.indexCount == 1 ? Poliz::Op::STORE_ELEM : Poliz::Op::STORE_ELEM_N,
+                       lv.base->slot, poliz.addArrayType(lv.base->type));
             break;
     }
 }
@@ -839,4 +1119,12 @@ void Parser::finalizeRValue() {
         emitLoadFromLValue(*lastLValue);
         lastLValue.reset();
     }
-}
\ No newline at end of file
+}
+
+// There is no conversion op: adding int 0 yields an int in every engine.
+void Parser::promoteAt(int at, const TypeInfo &dst, const TypeInfo &src) {
+    if (!sem.promotesToInt(dst, src))
+        return;
+    poliz.insert(at, Poliz::Instr(Poliz::Op::PUSH_INT, 0));
+    poliz.insert(at + 1, Poliz::Instr(Poliz::Op::ADD));
+}
@@ -2,6 +2,8 @@
 #include "lexer.hpp"
 #include "semanter.hpp"
 #include "poliz.hpp"
+#include <exception>
+#include <stdexcept>
 #include <string>
 #include <unordered_set>
 
@@ -15,6 +17,16 @@ struct LValueDesc {
 
     Symbol* base = nullptr;
     std::string field;
+    int indexCount = 0;
+};
+
+// An error from a function body compiled on a worker thread, at the
+// position of that thread's lexer rather than the main one.
+struct CompileError : std::runtime_error {
+    SourcePos pos;
+
+    CompileError(const std::string &what, SourcePos pos)
+        : std::runtime_error(what), pos(pos) {}
 };
 
 struct LoopCtx {
@@ -34,6 +46,44 @@ public:
 
     void parseFunctionDefinition();
 
+    void setVectorize(bool on) { vectorize = on; }
+
+    // Compiles function bodies on `jobs` threads (0: one per core) once
+    // the declarations are read; 1 parses them in order.
+    void setCompileJobs(unsigned jobs) { compileJobs = jobs; }
+
+    struct FunctionDef {
+        TypeInfo ret;
+        std::vector<TypeInfo> paramTypes;
+        std::vector<std::string> paramNames;
+        FunctionSymbol *symbol = nullptr;
+
+        // Set by parseFunctionBody, relative to the Poliz it emitted into.
+        int entryIp = -1;
+        int frameSize = 0;
+    };
+
+    // A function body, main's included, as parseProgram compiled it when
+    // recording units: its tokens from '{' to '}' and the code range it
+    // was appended at (entryIp in `def` is then absolute).
+    struct Unit {
+        FunctionDef def;
+        std::vector<Token> tokens;
+        int codeBegin = 0;
+        int codeEnd = 0;
+    };
+
+    // Makes parseProgram compile every body on its own, as with compile
+    // jobs, and record it in `units` in source order, main last.
+    void setUnits(std::vector<Unit> *out) { units = out; }
+
+    // Compiles a body from its tokens ('{' to '}', then EndOfFile) into
+    // `code` from ip 0, with `sem` as the declarations left it. Errors are
+    // thrown as CompileError at the token they were found at -- except at
+    // the end of tokens cut short by a lexical error, which is rethrown.
+    static void compileBody(std::vector<Token> tokens, Semanter &sem, FunctionDef &def, Poliz &code,
+                            bool vectorize, std::exception_ptr cut = nullptr);
+
 private:
     Lexer& lex;
     Semanter& sem;
@@ -42,6 +92,9 @@ private:
 
     std::optional<LValueDesc> lastLValue;
     std::vector<LoopCtx> loopStack;
+    bool vectorize = true;
+    unsigned compileJobs = 1;
+    std::vector<Unit> *units = nullptr;
 
 
     std::string currentFunctionName;
@@ -54,9 +107,15 @@ private:
 
     void expect(Token::Type t, const std::string& what) ;
 
-    void parseMain();
+    FunctionDef parseFunctionHeader();
+    void parseFunctionBody(FunctionDef &def);
+    void parseDefinitionsParallel();
+    std::vector<Token> collectBlock(std::exception_ptr &cut);
+
+    int parseMain();
 
     TypeInfo parseType();
+    TypeInfo parseParamArraySuffix(const TypeInfo& elem);
 
     void parseLiteral();
     void parseLValue();
@@ -77,6 +136,7 @@ private:
     void parsePrint();
 
     void parseRead();
+    void parseReadArray(const LValueDesc &lv, const TypeInfo &t);
 
 
     void parseExpression();
@@ -100,4 +160,8 @@ private:
     void emitStoreToLValue(const LValueDesc &lv);
 
     void finalizeRValue();
+
+    // Converts the value ending just before `at` from src to dst where
+    // that is not a no-op (char -> int), so int slots only hold ints.
+    void promoteAt(int at, const TypeInfo &dst, const TypeInfo &src);
 };
\ No newline at end of file
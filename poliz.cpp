@@ -27,9 +27,111 @@ const std::string &Poliz::getString(int idx) const {
     return stringPool[idx];
 }
 
+int Poliz::addArrayType(const TypeInfo &t) {
+    for (std::size_t i = 0; i < arrayTypes.size(); ++i)
+        if (arrayTypes[i] == t)
+            return static_cast<int>(i);
+    arrayTypes.push_back(t);
+    return static_cast<int>(arrayTypes.size()) - 1;
+}
+
+const TypeInfo &Poliz::getArrayType(int idx) const {
+    if (idx < 0 || idx >= static_cast<int>(arrayTypes.size())) {
+        throw std::runtime_error("Poliz::getArrayType: invalid index");
+    }
+    return arrayTypes[idx];
+}
+
+
+int Poliz::addVectorLoop(const VectorLoop &loop) {
+    vectorLoops.push_back(loop);
+    return static_cast<int>(vectorLoops.size()) - 1;
+}
+
+const Poliz::VectorLoop &Poliz::getVectorLoop(int idx) const {
+    if (idx < 0 || idx >= static_cast<int>(vectorLoops.size())) {
+        throw std::runtime_error("Poliz::getVectorLoop: invalid index");
+    }
+    return vectorLoops[idx];
+}
+
+// Inserts instr before ip. Jumps that were already patched are relocated:
+// targets past ip move by one, and a target equal to ip moves only for
+// jumps inside the shifted tail, so code before ip keeps reaching the
+// inserted instruction.
+void Poliz::insert(int ip, const Instr &instr) {
+    if (ip < 0 || ip > static_cast<int>(code.size())) {
+        throw std::runtime_error("Poliz::insert: invalid index");
+    }
+    code.insert(code.begin() + ip, instr);
+
+    for (int k = 0; k < static_cast<int>(code.size()); ++k) {
+        Instr &in = code[k];
+        if (k == ip)
+            continue;
+        std::optional<int> *target = nullptr;
+        if (in.op == Op::JUMP || in.op == Op::JUMP_IF_FALSE)
+            target = &in.arg1;
+        else if (in.op == Op::VEC_LOOP)
+            target = &in.arg2;
+        if (!target || !*target || **target < 0)
+            continue;
+        if (**target > ip || (**target == ip && k > ip))
+            ++**target;
+    }
+
+    for (auto &f : functions)
+        if (f.entryIp > ip)
+            ++f.entryIp;
+}
+
+int Poliz::append(const Poliz &other) {
+    const int base = currentIp();
+    const int stringBase = static_cast<int>(stringPool.size());
+    const int loopBase = static_cast<int>(vectorLoops.size());
+
+    // addArrayType deduplicates, so taking other's types in their own
+    // order numbers them as if they had been added here directly.
+    std::vector<int> typeIndex;
+    typeIndex.reserve(other.arrayTypes.size());
+    for (const TypeInfo &t : other.arrayTypes)
+        typeIndex.push_back(addArrayType(t));
+    stringPool.insert(stringPool.end(), other.stringPool.begin(), other.stringPool.end());
+    vectorLoops.insert(vectorLoops.end(), other.vectorLoops.begin(), other.vectorLoops.end());
+
+    for (Instr in : other.code) {
+        switch (in.op) {
+            case Op::JUMP:
+            case Op::JUMP_IF_FALSE:
+                if (in.arg1 && *in.arg1 >= 0)
+                    *in.arg1 += base;
+                break;
+            case Op::VEC_LOOP:
+                *in.arg1 += loopBase;
+                *in.arg2 += base;
+                break;
+            case Op::PUSH_STRING:
+                *in.arg1 += stringBase;
+                break;
+            case Op::NEW_ARRAY:
+            case Op::LOAD_ELEM:
+            case Op::STORE_ELEM:
+            case Op::LOAD_ELEM_N:
+            case Op::STORE_ELEM_N:
+            case Op::CALL_BUILTIN:
+                if (in.arg2)
+                    in.arg2 = typeIndex[*in.arg2];
+                break;
+            default:
+                break;
+        }
+        code.push_back(in);
+    }
+    return base;
+}
 
 
-static const char *opName(Poliz::Op op) {
+const char *Poliz::opName(Op op) {
     using Op = Poliz::Op;
     switch (op) {
         case Op::PUSH_INT: return "PUSH_INT";
@@ -75,6 +177,11 @@ static const char *opName(Poliz::Op op) {
         case Op::READ_STRING: return "READ_STRING";
         case Op::LOAD_ELEM : return "LOAD_ELEM";
         case Op::STORE_ELEM: return "STORE_ELEM";
+        case Op::NEW_ARRAY: return "NEW_ARRAY";
+        case Op::LOAD_ELEM_N: return "LOAD_ELEM_N";
+        case Op::STORE_ELEM_N: return "STORE_ELEM_N";
+        case Op::CALL_BUILTIN: return "CALL_BUILTIN";
+        case Op::VEC_LOOP: return "VEC_LOOP";
         default: return "UNKNOWN";
     }
 }
@@ -101,18 +208,64 @@ void Poliz::dump(std::ostream &os) const {
         }
     }
 
+    if (!arrayTypes.empty()) {
+        os << "--- Array types ---\n";
+        for (std::size_t i = 0; i < arrayTypes.size(); ++i)
+            os << i << ": " << arrayTypes[i].toString() << "\n";
+    }
+
+    if (!vectorLoops.empty()) {
+        static const char *kinds[] = {"map", "sum", "dot"};
+        os << "--- Vector loops ---\n";
+        for (std::size_t i = 0; i < vectorLoops.size(); ++i) {
+            const auto &v = vectorLoops[i];
+            os << i << ": " << kinds[static_cast<int>(v.kind)]
+               << (v.isFloat ? " float" : " int")
+               << " index=" << v.indexSlot << " target=" << v.target;
+            if (v.kind == VectorLoop::Kind::Map)
+                os << " op=" << opName(v.op);
+            os << "\n";
+        }
+    }
+
+    if (!functions.empty()) {
+        os << "--- Functions ---\n";
+        for (std::size_t i = 0; i < functions.size(); ++i) {
+            const auto &f = functions[i];
+            os << i << ": " << f.name << " @" << f.entryIp
+               << " params=" << f.paramCount
+               << " frame=" << f.frameSize;
+            if (f.maxStack >= 0)
+                os << " maxStack=" << f.maxStack;
+            os << "\n";
+        }
+    }
+
 }
 
 
 int Poliz::registerFunction(
     const std::string& name,
     int entryIp,
-    int paramCount
+    const std::vector<TypeInfo>& params,
+    const TypeInfo& ret
 ) {
-    functions.emplace_back(name, entryIp, paramCount);
+    functions.emplace_back(name, entryIp, params, ret);
     return functions.size() - 1;
 }
 
+void Poliz::setFunctionFrame(int index, int frameSize) {
+    if (index < 0 || index >= functions.size())
+        throw std::runtime_error("Invalid function index");
+    functions[index].frameSize = frameSize;
+}
+
+void Poliz::setFunctionMaxStack(int index, int maxStack) {
+    if (index < 0 || index >= functions.size())
+        throw std::runtime_error("Invalid function index");
+    functions[index].maxStack = maxStack;
+}
+
 const Poliz::FunctionInfo& Poliz::getFunction(int index) const {
     if (index < 0 || index >= functions.size())
         throw std::runtime_error("Invalid function index");
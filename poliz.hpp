@@ -2,6 +2,9 @@
 #include <vector>
 #include <string>
 #include <iostream>
+#include <optional>
+#include <stdexcept>
+#include "typeinfo.hpp"
 
 
 class Poliz {
@@ -10,9 +13,15 @@ public:
         std::string name;
         int entryIp;
         int paramCount;
+        std::vector<TypeInfo> paramTypes;
+        TypeInfo returnType;
 
-        FunctionInfo(const std::string &n, int ip, int pc)
-            : name(n), entryIp(ip), paramCount(pc) {
+        int frameSize = 0;
+        int maxStack = -1;
+
+        FunctionInfo(const std::string &n, int ip, const std::vector<TypeInfo> &params, const TypeInfo &ret)
+            : name(n), entryIp(ip), paramCount(static_cast<int>(params.size())),
+              paramTypes(params), returnType(ret) {
         }
     };
 
@@ -71,6 +80,11 @@ public:
         HALT,
         LOAD_ELEM,
         STORE_ELEM,
+        NEW_ARRAY,
+        LOAD_ELEM_N,
+        STORE_ELEM_N,
+        CALL_BUILTIN,
+        VEC_LOOP,
     };
 
     struct Instr {
@@ -83,10 +97,35 @@ public:
         }
     };
 
+    // Operand of a vectorized loop body. value is a slot for Array/Var,
+    // the literal for Int, or the literal's bit pattern for Float.
+    struct VectorOperand {
+        enum class Kind { None, Array, Var, Int, Float } kind = Kind::None;
+        int value = 0;
+    };
+
+    // A canonical counted loop `for (i = ...; i < bound; i = i + 1)` whose
+    // body was recognised by the Vectorizer.
+    //   Map: target[i] = lhs op rhs   (op NOP: target[i] = lhs)
+    //   Sum: target = target + lhs[i]
+    //   Dot: target = target + lhs[i] * rhs[i]
+    struct VectorLoop {
+        enum class Kind { Map, Sum, Dot } kind = Kind::Map;
+        bool isFloat = false;
+        int indexSlot = -1;
+        VectorOperand bound;
+        int target = -1;
+        Op op = Op::NOP;
+        VectorOperand lhs{}, rhs{};
+    };
+
 private:
     std::vector<Instr> code;
     std::vector<std::string> stringPool;
     std::vector<FunctionInfo> functions;
+    std::vector<TypeInfo> arrayTypes;
+    std::vector<VectorLoop> vectorLoops;
+    bool verified = false;
 
 public:
     int emit(Op op,
@@ -104,6 +143,28 @@ public:
 
     const std::string &getString(int idx) const;
 
+    std::size_t stringCount() const { return stringPool.size(); }
+
+    int addArrayType(const TypeInfo &t);
+
+    const TypeInfo &getArrayType(int idx) const;
+
+    std::size_t arrayTypeCount() const { return arrayTypes.size(); }
+
+    int addVectorLoop(const VectorLoop &loop);
+
+    const VectorLoop &getVectorLoop(int idx) const;
+
+    std::size_t vectorLoopCount() const { return vectorLoops.size(); }
+
+    void insert(int ip, const Instr &instr);
+
+    // Appends the code of `other`, which was emitted starting at ip 0:
+    // jump targets move by the ip it lands at, and string, array-type and
+    // vector-loop operands are renumbered into this Poliz's tables. Its
+    // function table is not copied. Returns the ip of its first instruction.
+    int append(const Poliz &other);
+
     const Instr &operator[](std::size_t i) const { return code[i]; }
     Instr &operator[](std::size_t i) { return code[i]; }
 
@@ -115,16 +176,28 @@ public:
 
     void dump(std::ostream &os) const;
 
+    static const char *opName(Op op);
+
     int registerFunction(
         const std::string &name,
         int entryIp,
-        int paramCount
+        const std::vector<TypeInfo> &params,
+        const TypeInfo &ret
     );
 
     const FunctionInfo &getFunction(int index) const;
 
     int getFunctionIndex(const std::string &name) const;
 
+    std::size_t functionCount() const { return functions.size(); }
+
+    void setFunctionFrame(int index, int frameSize);
+
+    void setFunctionMaxStack(int index, int maxStack);
+
+    bool isVerified() const { return verified; }
+    void setVerified(bool v) { verified = v; }
+
     void setFunctionEntry(int index, int entryIp) {
         if (index < 0 || index >= functions.size())
             throw std::runtime_error("Invalid function index");
@@ -0,0 +1,485 @@
+#include "regcode.hpp"
+#include "builtins.hpp"
+#include "verifier.hpp"
+#include <map>
+#include <set>
+
+
+namespace {
+    using POp = Poliz::Op;
+    using ROp = RegisterCode::Op;
+
+    bool isIntLike(Verifier::KindMask m) {
+        return m && !(m & ~(Verifier::KInt | Verifier::KChar | Verifier::KBool));
+    }
+
+    // Offset of a compare within EQ..GE, which every compare family
+    // below lists in the same order.
+    int condIndex(POp op) {
+        return static_cast<int>(op) - static_cast<int>(POp::CMP_EQ);
+    }
+
+    ROp offset(ROp first, int by) {
+        return static_cast<ROp>(static_cast<int>(first) + by);
+    }
+}
+
+
+class RegisterCode::FunctionTranslator {
+public:
+    FunctionTranslator(RegisterCode &out, int fnIdx, const Verifier::FunctionAnalysis &a)
+        : out(out), poliz(out.poliz), fnIdx(fnIdx), states(a.states.begin(), a.states.end()),
+          frameSize(out.poliz.getFunction(fnIdx).frameSize) {
+    }
+
+    void run() {
+        const int codeSize = static_cast<int>(poliz.size());
+
+        std::set<int> leaders = {poliz.getFunction(fnIdx).entryIp};
+        for (const auto &[ip, st] : states) {
+            if (ip >= codeSize)
+                continue;
+            const auto &ins = poliz[ip];
+            if (ins.op == POp::JUMP || ins.op == POp::JUMP_IF_FALSE)
+                leaders.insert(*ins.arg1);
+            else if (ins.op == POp::VEC_LOOP)
+                leaders.insert(*ins.arg2);
+        }
+
+        bool dead = true;
+        int skip = -1;
+        for (const auto &[ip, st] : states) {
+            if (ip >= codeSize || ip == skip)
+                continue;
+
+            const bool leader = leaders.contains(ip);
+            if (dead) {
+                stack.clear();
+                for (std::size_t d = 0; d < st.stack.size(); ++d)
+                    stack.push_back(Operand::inRegister(temp(static_cast<int>(d))));
+                dead = false;
+                lastWriter = -1;
+            } else if (leader) {
+                flush();
+                lastWriter = -1;
+            }
+            at[ip] = static_cast<int>(out.instrs.size());
+
+            const auto &ins = poliz[ip];
+            if (isCompare(ins.op) && ip + 1 < codeSize && poliz[ip + 1].op == POp::JUMP_IF_FALSE &&
+                !leaders.contains(ip + 1)) {
+                compareBranch(ins.op, st, *poliz[ip + 1].arg1);
+                skip = ip + 1;
+                continue;
+            }
+            dead = translate(ip, st);
+        }
+
+        for (const auto &[idx, target] : fixups) {
+            if (!at.contains(target)) {
+                at[target] = static_cast<int>(out.instrs.size());
+                out.instrs.push_back({ROp::HALT});
+            }
+            out.instrs[idx].target = at[target];
+        }
+        out.entries[fnIdx] = at[poliz.getFunction(fnIdx).entryIp];
+    }
+
+private:
+    // What an operand-stack cell holds right now: a register (a local, or
+    // the cell's own temp once materialized) or a constant not yet loaded.
+    struct Operand {
+        bool isConst = false;
+        int reg = 0;
+        int k = 0;
+        std::optional<int> intValue;
+
+        static Operand inRegister(int r) {
+            Operand o;
+            o.reg = r;
+            return o;
+        }
+    };
+
+    RegisterCode &out;
+    const Poliz &poliz;
+    int fnIdx;
+    std::map<int, Verifier::State> states;
+    int frameSize;
+
+    std::vector<Operand> stack;
+    std::map<int, int> at;
+    std::vector<std::pair<int, int>> fixups;
+    int lastWriter = -1;
+
+    static bool isCompare(POp op) {
+        return op >= POp::CMP_EQ && op <= POp::CMP_GE;
+    }
+
+    int temp(int d) const { return frameSize + d; }
+
+    int emit(Instr in) {
+        out.instrs.push_back(in);
+        return static_cast<int>(out.instrs.size()) - 1;
+    }
+
+    void emitJump(Instr in, int target) {
+        fixups.emplace_back(emit(in), target);
+    }
+
+    // Writes cell d into its own temp register.
+    void materialize(int d) {
+        Operand &o = stack[d];
+        if (o.isConst)
+            emit({ROp::LOADK, temp(d), o.k});
+        else if (o.reg != temp(d))
+            emit({ROp::MOVE, temp(d), o.reg});
+        o = Operand::inRegister(temp(d));
+    }
+
+    void flush() {
+        for (int d = 0; d < static_cast<int>(stack.size()); ++d)
+            materialize(d);
+    }
+
+    // Cells still reading local `slot` must take a copy before it changes.
+    void detach(int slot) {
+        for (int d = 0; d < static_cast<int>(stack.size()); ++d)
+            if (!stack[d].isConst && stack[d].reg == slot)
+                materialize(d);
+    }
+
+    int reg(int d) {
+        if (stack[d].isConst)
+            materialize(d);
+        return stack[d].reg;
+    }
+
+    int depth() const { return static_cast<int>(stack.size()); }
+
+    void pushConst(const Poliz::Instr &ins) {
+        Operand o;
+        o.isConst = true;
+        auto [it, added] = out.constIndex.try_emplace({ins.op, *ins.arg1}, static_cast<int>(out.consts.size()));
+        if (added)
+            out.consts.push_back(ins);
+        o.k = it->second;
+        if (ins.op == POp::PUSH_INT)
+            o.intValue = *ins.arg1;
+        stack.push_back(o);
+    }
+
+    // Emits `dst <- ...` for the cell about to be pushed at depth d and
+    // remembers it so a following STORE_VAR can write the local directly.
+    void produce(Instr in, int d) {
+        in.a = temp(d);
+        lastWriter = emit(in);
+        stack.resize(d);
+        stack.push_back(Operand::inRegister(temp(d)));
+    }
+
+    void store(int slot) {
+        const int d = depth() - 1;
+        const Operand v = stack[d];
+        stack.pop_back();
+
+        bool referenced = false;
+        for (const Operand &o : stack)
+            referenced |= !o.isConst && o.reg == slot;
+
+        if (!referenced && !v.isConst && v.reg == temp(d) &&
+            lastWriter == static_cast<int>(out.instrs.size()) - 1 &&
+            out.instrs[lastWriter].a == temp(d)) {
+            out.instrs[lastWriter].a = slot;
+        } else {
+            detach(slot);
+            if (v.isConst)
+                emit({ROp::LOADK, slot, v.k});
+            else if (v.reg != slot)
+                emit({ROp::MOVE, slot, v.reg});
+        }
+        lastWriter = -1;
+    }
+
+    void binary(POp op, const Verifier::State &st) {
+        const int d = depth();
+        const bool ints = isIntLike(st.stack[d - 2]) && isIntLike(st.stack[d - 1]);
+        const Operand rhs = stack[d - 1];
+
+        Instr in{};
+        switch (op) {
+            case POp::ADD:
+            case POp::SUB:
+            case POp::MUL: {
+                const int by = op == POp::ADD ? 0 : op == POp::SUB ? 1 : 2;
+                if (ints && rhs.intValue) {
+                    in = {offset(ROp::IADDK, by), 0, reg(d - 2), 0, *rhs.intValue};
+                    break;
+                }
+                in = {offset(ints ? ROp::IADD : ROp::ADD, by), 0, reg(d - 2), reg(d - 1)};
+                break;
+            }
+            case POp::DIV:     in = {ROp::DIV, 0, reg(d - 2), reg(d - 1)}; break;
+            case POp::MOD:     in = {ROp::MOD, 0, reg(d - 2), reg(d - 1)}; break;
+            case POp::AND:     in = {ROp::AND, 0, reg(d - 2), reg(d - 1)}; break;
+            case POp::OR:      in = {ROp::OR, 0, reg(d - 2), reg(d - 1)}; break;
+            case POp::XOR:     in = {ROp::XOR, 0, reg(d - 2), reg(d - 1)}; break;
+            case POp::SHL:     in = {ROp::SHL, 0, reg(d - 2), reg(d - 1)}; break;
+            case POp::SHR:     in = {ROp::SHR, 0, reg(d - 2), reg(d - 1)}; break;
+            case POp::LOG_AND: in = {ROp::LOG_AND, 0, reg(d - 2), reg(d - 1)}; break;
+            case POp::LOG_OR:  in = {ROp::LOG_OR, 0, reg(d - 2), reg(d - 1)}; break;
+            default:           in = {offset(ROp::EQ, condIndex(op)), 0, reg(d - 2), reg(d - 1)}; break;
+        }
+        produce(in, d - 2);
+    }
+
+    // CMP_xx; JUMP_IF_FALSE target
+    void compareBranch(POp op, const Verifier::State &st, int target) {
+        const int d = depth();
+        const bool ints = isIntLike(st.stack[d - 2]) && isIntLike(st.stack[d - 1]);
+        const Operand rhs = stack[d - 1];
+
+        Instr in{};
+        if (ints && rhs.intValue)
+            in = {offset(ROp::IJEQK, condIndex(op)), reg(d - 2), 0, 0, *rhs.intValue};
+        else
+            in = {offset(ints ? ROp::IJEQ : ROp::JEQ, condIndex(op)), reg(d - 2), reg(d - 1)};
+        stack.resize(d - 2);
+        flush();
+        emitJump(in, target);
+        lastWriter = -1;
+    }
+
+    // Returns true when control cannot fall through to ip + 1.
+    bool translate(int ip, const Verifier::State &st) {
+        const auto &ins = poliz[ip];
+        const int d = depth();
+
+        switch (ins.op) {
+            case POp::PUSH_INT:
+            case POp::PUSH_FLOAT:
+            case POp::PUSH_CHAR:
+            case POp::PUSH_BOOL:
+            case POp::PUSH_STRING:
+                pushConst(ins);
+                break;
+
+            case POp::LOAD_VAR:
+                stack.push_back(Operand::inRegister(*ins.arg1));
+                break;
+            case POp::STORE_VAR:
+                store(*ins.arg1);
+                break;
+
+            case POp::ADD: case POp::SUB: case POp::MUL: case POp::DIV: case POp::MOD:
+            case POp::AND: case POp::OR: case POp::XOR: case POp::SHL: case POp::SHR:
+            case POp::LOG_AND: case POp::LOG_OR:
+            case POp::CMP_EQ: case POp::CMP_NE: case POp::CMP_LT:
+            case POp::CMP_LE: case POp::CMP_GT: case POp::CMP_GE:
+                binary(ins.op, st);
+                break;
+
+            case POp::NEG:
+            case POp::NOT:
+            case POp::BNOT: {
+                ROp op = ins.op == POp::NEG ? ROp::NEG : ins.op == POp::NOT ? ROp::NOT : ROp::BNOT;
+                produce({op, 0, reg(d - 1)}, d - 1);
+                break;
+            }
+
+            case POp::JUMP:
+                flush();
+                emitJump({ROp::JMP}, *ins.arg1);
+                return true;
+            case POp::JUMP_IF_FALSE: {
+                int cond = reg(d - 1);
+                stack.pop_back();
+                flush();
+                emitJump({ROp::JF, cond}, *ins.arg1);
+                lastWriter = -1;
+                break;
+            }
+
+            case POp::CALL: {
+                const auto &f = poliz.getFunction(*ins.arg1);
+                flush();
+                emit({ROp::CALL, temp(d - f.paramCount), *ins.arg1});
+                stack.resize(d - f.paramCount);
+                if (!f.returnType.isVoid())
+                    stack.push_back(Operand::inRegister(temp(d - f.paramCount)));
+                lastWriter = -1;
+                break;
+            }
+            case POp::RET_VALUE:
+                emit({ROp::RET, reg(d - 1)});
+                return true;
+            case POp::RET_VOID:
+                emit({ROp::RET_VOID});
+                return true;
+
+            case POp::PRINT:
+                emit({ROp::PRINT, reg(d - 1)});
+                stack.pop_back();
+                break;
+            case POp::READ_INT:
+            case POp::READ_FLOAT:
+            case POp::READ_BOOL:
+            case POp::READ_CHAR:
+            case POp::READ_STRING:
+                produce({ROp::READ, 0, static_cast<int>(ins.op)}, d);
+                break;
+
+            case POp::NEW_ARRAY:
+                detach(*ins.arg1);
+                emit({ROp::NEW_ARRAY, *ins.arg1, *ins.arg2});
+                break;
+            case POp::LOAD_ELEM:
+                produce({ROp::LOAD_ELEM, 0, *ins.arg1, reg(d - 1)}, d - 1);
+                break;
+            case POp::STORE_ELEM:
+                emit({ROp::STORE_ELEM, *ins.arg1, reg(d - 2), reg(d - 1)});
+                stack.resize(d - 2);
+                break;
+
+            case POp::LOAD_ELEM_N:
+            case POp::STORE_ELEM_N:
+            case POp::CALL_BUILTIN: {
+                flush();
+                emit({ROp::STACK_OP, temp(d), ip});
+                const int after = static_cast<int>(states.at(ip + 1).stack.size());
+                stack.resize(std::min(after, d));
+                for (int k = depth(); k < after; ++k)
+                    stack.push_back(Operand::inRegister(temp(k)));
+                lastWriter = -1;
+                break;
+            }
+
+            case POp::VEC_LOOP:
+                flush();
+                emitJump({ROp::VEC_LOOP, 0, *ins.arg1}, *ins.arg2);
+                lastWriter = -1;
+                break;
+
+            case POp::NOP:
+                break;
+            case POp::HALT:
+                emit({ROp::HALT});
+                return true;
+        }
+        return false;
+    }
+};
+
+
+RegisterCode::RegisterCode(const Poliz &poliz)
+    : poliz(poliz), entries(poliz.functionCount(), -1) {
+}
+
+bool RegisterCode::translate() {
+    if (!poliz.isVerified()) {
+        lastError = "register code needs a verified program";
+        return false;
+    }
+
+    for (std::size_t f = 0; f < poliz.functionCount(); ++f) {
+        const int fnIdx = static_cast<int>(f);
+        if (poliz.getFunction(fnIdx).entryIp < 0)
+            continue;
+        Verifier::FunctionAnalysis a = Verifier::analyze(poliz, fnIdx);
+        if (!a.ok) {
+            lastError = a.error;
+            return false;
+        }
+        FunctionTranslator(*this, fnIdx, a).run();
+    }
+    return true;
+}
+
+const char *RegisterCode::opName(Op op) {
+    static const char *const names[] = {
+        "MOVE", "LOADK",
+        "ADD", "SUB", "MUL", "DIV",
+        "IADD", "ISUB", "IMUL",
+        "IADDK", "ISUBK", "IMULK",
+        "MOD", "AND", "OR", "XOR", "SHL", "SHR",
+        "NEG", "NOT", "BNOT",
+        "LOG_AND", "LOG_OR",
+        "EQ", "NE", "LT", "LE", "GT", "GE",
+        "JEQ", "JNE", "JLT", "JLE", "JGT", "JGE",
+        "IJEQ", "IJNE", "IJLT", "IJLE", "IJGT", "IJGE",
+        "IJEQK", "IJNEK", "IJLTK", "IJLEK", "IJGTK", "IJGEK",
+        "JMP", "JF",
+        "CALL", "RET", "RET_VOID",
+        "PRINT", "READ", "NEW_ARRAY", "LOAD_ELEM", "STORE_ELEM",
+        "STACK_OP", "VEC_LOOP", "HALT",
+    };
+    return names[static_cast<int>(op)];
+}
+
+void RegisterCode::dump(std::ostream &os) const {
+    os << "REGISTER CODE\n";
+    for (std::size_t f = 0; f < entries.size(); ++f)
+        if (entries[f] >= 0)
+            os << "; " << poliz.getFunction(static_cast<int>(f)).name << " @" << entries[f] << "\n";
+
+    for (std::size_t i = 0; i < instrs.size(); ++i) {
+        const Instr &in = instrs[i];
+        os << i << ":\t" << opName(in.op);
+        switch (in.op) {
+            case Op::JMP:
+                break;
+            case Op::JF:
+            case Op::RET:
+            case Op::PRINT:
+                os << " r" << in.a;
+                break;
+            case Op::RET_VOID:
+            case Op::HALT:
+                break;
+            case Op::LOADK:
+                os << " r" << in.a << ", k" << in.b;
+                break;
+            case Op::CALL:
+                os << " r" << in.a << ", " << poliz.getFunction(in.b).name;
+                break;
+            case Op::READ:
+                os << " r" << in.a << ", " << Poliz::opName(static_cast<Poliz::Op>(in.b));
+                break;
+            case Op::NEW_ARRAY:
+                os << " r" << in.a << ", type " << in.b;
+                break;
+            case Op::STACK_OP:
+                os << " r" << in.a << ", " << Poliz::opName(poliz[in.b].op) << " @" << in.b;
+                break;
+            case Op::VEC_LOOP:
+                os << " " << in.b;
+                break;
+            case Op::IADDK: case Op::ISUBK: case Op::IMULK:
+                os << " r" << in.a << ", r" << in.b << ", " << in.k;
+                break;
+            case Op::IJEQK: case Op::IJNEK: case Op::IJLTK:
+            case Op::IJLEK: case Op::IJGTK: case Op::IJGEK:
+                os << " r" << in.a << ", " << in.k;
+                break;
+            case Op::JEQ: case Op::JNE: case Op::JLT: case Op::JLE: case Op::JGT: case Op::JGE:
+            case Op::IJEQ: case Op::IJNE: case Op::IJLT: case Op::IJLE: case Op::IJGT: case Op::IJGE:
+                os << " r" << in.a << ", r" << in.b;
+                break;
+            case Op::MOVE: case Op::NEG: case Op::NOT: case Op::BNOT:
+                os << " r" << in.a << ", r" << in.b;
+                break;
+            default:
+                os << " r" << in.a << ", r" << in.b << ", r" << in.c;
+                break;
+        }
+        if (in.target >= 0)
+            os << " -> " << in.target;
+        os << "\n";
+    }
+
+    if (!consts.empty()) {
+        os << "--- Constants ---\n";
+        for (std::size_t k = 0; k < consts.size(); ++k)
+            os << "k" << k << ": " << Poliz::opName(consts[k].op) << " " << *consts[k].arg1 << "\n";
+    }
+}
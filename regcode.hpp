@@ -0,0 +1,95 @@
+#pragma once
+#include "poliz.hpp"
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+// Three-address form of a verified Poliz program. Registers are frame
+// cells: 0..frameSize-1 are the function's locals, frameSize+d is the
+// operand-stack cell at depth d (the verifier fixes d for every ip). The
+// translator tracks what each stack cell holds, so `a = b + c` becomes a
+// single `ADD a, b, c` instead of LOAD, LOAD, ADD, STORE.
+class RegisterCode {
+public:
+    enum class Op : uint8_t {
+        MOVE,       // a <- b
+        LOADK,      // a <- constants[b]
+
+        ADD, SUB, MUL, DIV,     // a <- b op c, VM::binaryNumOp rules
+        IADD, ISUB, IMUL,       // a <- b op c, both known int-like
+        IADDK, ISUBK, IMULK,    // a <- b op k
+        MOD, AND, OR, XOR, SHL, SHR,
+
+        NEG, NOT, BNOT,         // a <- op b
+        LOG_AND, LOG_OR,
+
+        EQ, NE, LT, LE, GT, GE, // a <- bool(b cmp c), compared as float
+
+        // if !(a cmp b) goto target; the I forms know both are int-like,
+        // the IK forms compare register a with immediate k.
+        JEQ, JNE, JLT, JLE, JGT, JGE,
+        IJEQ, IJNE, IJLT, IJLE, IJGT, IJGE,
+        IJEQK, IJNEK, IJLTK, IJLEK, IJGTK, IJGEK,
+
+        JMP,        // goto target
+        JF,         // if a is false goto target
+
+        CALL,       // call function b with arguments from register a up;
+                    // the result lands in register a
+        RET,        // return a
+        RET_VOID,
+
+        PRINT,      // print a
+        READ,       // a <- input, b is the Poliz READ_* op
+        NEW_ARRAY,  // local a <- new array of type b
+        LOAD_ELEM,  // a <- local b [c]
+        STORE_ELEM, // local a [b] <- c
+
+        // Runs Poliz instruction b as the stack VM would, with the
+        // operand stack starting at register a (LOAD_ELEM_N,
+        // STORE_ELEM_N, CALL_BUILTIN).
+        STACK_OP,
+        VEC_LOOP,   // vector loop b; on success goto target
+        HALT,
+    };
+
+    struct Instr {
+        Op op;
+        int a = 0;
+        int b = 0;
+        int c = 0;
+        int k = 0;
+        int target = -1;
+    };
+
+    explicit RegisterCode(const Poliz &poliz);
+
+    // Translates every function; fails on unverified code.
+    bool translate();
+
+    const std::string &error() const { return lastError; }
+
+    const std::vector<Instr> &code() const { return instrs; }
+
+    // Constants are the Poliz push instruction that produced them.
+    const std::vector<Poliz::Instr> &constants() const { return consts; }
+
+    // Register-code index of each function's entry, -1 if it has no body.
+    int entry(int fnIdx) const { return entries[fnIdx]; }
+
+    void dump(std::ostream &os) const;
+
+    static const char *opName(Op op);
+
+private:
+    const Poliz &poliz;
+    std::vector<Instr> instrs;
+    std::vector<Poliz::Instr> consts;
+    std::map<std::pair<Poliz::Op, int>, int> constIndex;
+    std::vector<int> entries;
+    std::string lastError;
+
+    class FunctionTranslator;
+};
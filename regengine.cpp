@@ -0,0 +1,248 @@
+#include "regengine.hpp"
+#include <cstring>
+
+
+namespace {
+    int32_t wrapAdd(int32_t a, int32_t b) { return static_cast<int32_t>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b)); }
+    int32_t wrapSub(int32_t a, int32_t b) { return static_cast<int32_t>(static_cast<uint32_t>(a) - static_cast<uint32_t>(b)); }
+    int32_t wrapMul(int32_t a, int32_t b) { return static_cast<int32_t>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b)); }
+}
+
+
+RegisterEngine::RegisterEngine(VM &vm, const Poliz &poliz, const RegisterCode &code)
+    : vm(vm), poliz(poliz), code(code) {
+    for (const Poliz::Instr &k : code.constants()) {
+        switch (k.op) {
+            case Poliz::Op::PUSH_FLOAT: {
+                int bits = *k.arg1;
+                float v;
+                std::memcpy(&v, &bits, sizeof(float));
+                constants.push_back(VM::Value::makeFloat(v));
+                break;
+            }
+            case Poliz::Op::PUSH_BOOL:   constants.push_back(VM::Value::makeBool(*k.arg1 != 0)); break;
+            case Poliz::Op::PUSH_CHAR:   constants.push_back(VM::Value::makeChar(static_cast<char>(*k.arg1))); break;
+            case Poliz::Op::PUSH_STRING: constants.push_back(VM::Value::makeString(*k.arg1)); break;
+            default:                     constants.push_back(VM::Value::makeInt(*k.arg1)); break;
+        }
+    }
+}
+
+// LOAD_ELEM_N, STORE_ELEM_N and CALL_BUILTIN keep their stack form; the
+// caller has pointed sp at the register holding the first operand.
+void RegisterEngine::stackOp(const Poliz::Instr &ins) {
+    switch (ins.op) {
+        case Poliz::Op::LOAD_ELEM_N: {
+            const VM::ArrayObject &arr = vm.arrayAt<false>(*ins.arg1, "LOAD_ELEM_N");
+            int flat = vm.flatIndex<false>(arr, poliz.getArrayType(*ins.arg2), "LOAD_ELEM_N");
+            vm.stack[vm.sp++] = arr.load(flat);
+            break;
+        }
+        case Poliz::Op::STORE_ELEM_N: {
+            VM::Value value = vm.stack[--vm.sp];
+            VM::ArrayObject &arr = vm.arrayAt<false>(*ins.arg1, "STORE_ELEM_N");
+            int flat = vm.flatIndex<false>(arr, poliz.getArrayType(*ins.arg2), "STORE_ELEM_N");
+            arr.store(flat, value);
+            break;
+        }
+        default:
+            vm.callBuiltin<false>(static_cast<Builtin>(*ins.arg1));
+            break;
+    }
+}
+
+void RegisterEngine::run(int mainIdx) {
+    using Op = RegisterCode::Op;
+    using Value = VM::Value;
+
+    const RegisterCode::Instr *instrs = code.code().data();
+    Value *r = &vm.stack[vm.base];
+    int pc = code.entry(mainIdx);
+    uint64_t executed = 0;
+
+    auto asFloat = [](const Value &v) {
+        return v.kind == Value::Kind::Float ? v.f : static_cast<float>(v.i);
+    };
+    auto numeric = [&](const RegisterCode::Instr &in, auto intOp, auto floatOp) {
+        const Value &a = r[in.b], &b = r[in.c];
+        if (a.kind != Value::Kind::Float && b.kind != Value::Kind::Float)
+            r[in.a] = Value::makeInt(intOp(a.i, b.i));
+        else
+            r[in.a] = Value::makeFloat(floatOp(asFloat(a), asFloat(b)));
+    };
+    auto branch = [&](const RegisterCode::Instr &in, bool taken) {
+        pc = taken ? pc + 1 : in.target;
+    };
+
+    for (;;) {
+        const RegisterCode::Instr &in = instrs[pc];
+        ++executed;
+
+        switch (in.op) {
+            case Op::MOVE:  r[in.a] = r[in.b]; ++pc; break;
+            case Op::LOADK: r[in.a] = constants[in.b]; ++pc; break;
+
+            case Op::ADD:
+                numeric(in, wrapAdd, [](float a, float b) { return a + b; });
+                ++pc;
+                break;
+            case Op::SUB:
+                numeric(in, wrapSub, [](float a, float b) { return a - b; });
+                ++pc;
+                break;
+            case Op::MUL:
+                numeric(in, wrapMul, [](float a, float b) { return a * b; });
+                ++pc;
+                break;
+            case Op::DIV:
+                numeric(in,
+                        [](int a, int b) {
+                            if (b == 0) throw std::runtime_error("VM: division by zero");
+                            return a / b;
+                        },
+                        [](float a, float b) {
+                            if (b == 0) throw std::runtime_error("VM: division by zero");
+                            return a / b;
+                        });
+                ++pc;
+                break;
+
+            case Op::IADD:  r[in.a] = Value::makeInt(wrapAdd(r[in.b].i, r[in.c].i)); ++pc; break;
+            case Op::ISUB:  r[in.a] = Value::makeInt(wrapSub(r[in.b].i, r[in.c].i)); ++pc; break;
+            case Op::IMUL:  r[in.a] = Value::makeInt(wrapMul(r[in.b].i, r[in.c].i)); ++pc; break;
+            case Op::IADDK: r[in.a] = Value::makeInt(wrapAdd(r[in.b].i, in.k)); ++pc; break;
+            case Op::ISUBK: r[in.a] = Value::makeInt(wrapSub(r[in.b].i, in.k)); ++pc; break;
+            case Op::IMULK: r[in.a] = Value::makeInt(wrapMul(r[in.b].i, in.k)); ++pc; break;
+
+            case Op::MOD:
+                if (r[in.c].i == 0)
+                    throw std::runtime_error("VM: modulo by zero");
+                r[in.a] = Value::makeInt(r[in.b].i % r[in.c].i);
+                ++pc;
+                break;
+            case Op::AND: r[in.a] = Value::makeInt(r[in.b].i & r[in.c].i); ++pc; break;
+            case Op::OR:  r[in.a] = Value::makeInt(r[in.b].i | r[in.c].i); ++pc; break;
+            case Op::XOR: r[in.a] = Value::makeInt(r[in.b].i ^ r[in.c].i); ++pc; break;
+            case Op::SHL: r[in.a] = Value::makeInt(r[in.b].i << r[in.c].i); ++pc; break;
+            case Op::SHR: r[in.a] = Value::makeInt(r[in.b].i >> r[in.c].i); ++pc; break;
+
+            case Op::NEG: {
+                const Value &a = r[in.b];
+                r[in.a] = a.kind == Value::Kind::Int ? Value::makeInt(-a.i) : Value::makeFloat(-a.f);
+                ++pc;
+                break;
+            }
+            case Op::NOT:     r[in.a] = Value::makeBool(!r[in.b].i); ++pc; break;
+            case Op::BNOT:    r[in.a] = Value::makeInt(~r[in.b].i); ++pc; break;
+            case Op::LOG_AND: r[in.a] = Value::makeBool(r[in.b].i && r[in.c].i); ++pc; break;
+            case Op::LOG_OR:  r[in.a] = Value::makeBool(r[in.b].i || r[in.c].i); ++pc; break;
+
+            case Op::EQ: r[in.a] = Value::makeBool(asFloat(r[in.b]) == asFloat(r[in.c])); ++pc; break;
+            case Op::NE: r[in.a] = Value::makeBool(asFloat(r[in.b]) != asFloat(r[in.c])); ++pc; break;
+            case Op::LT: r[in.a] = Value::makeBool(asFloat(r[in.b]) < asFloat(r[in.c])); ++pc; break;
+            case Op::LE: r[in.a] = Value::makeBool(asFloat(r[in.b]) <= asFloat(r[in.c])); ++pc; break;
+            case Op::GT: r[in.a] = Value::makeBool(asFloat(r[in.b]) > asFloat(r[in.c])); ++pc; break;
+            case Op::GE: r[in.a] = Value::makeBool(asFloat(r[in.b]) >= asFloat(r[in.c])); ++pc; break;
+
+            case Op::JEQ: branch(in, asFloat(r[in.a]) == asFloat(r[in.b])); break;
+            case Op::JNE: branch(in, asFloat(r[in.a]) != asFloat(r[in.b])); break;
+            case Op::JLT: branch(in, asFloat(r[in.a]) < asFloat(r[in.b])); break;
+            case Op::JLE: branch(in, asFloat(r[in.a]) <= asFloat(r[in.b])); break;
+            case Op::JGT: branch(in, asFloat(r[in.a]) > asFloat(r[in.b])); break;
+            case Op::JGE: branch(in, asFloat(r[in.a]) >= asFloat(r[in.b])); break;
+
+            case Op::IJEQ: branch(in, static_cast<float>(r[in.a].i) == static_cast<float>(r[in.b].i)); break;
+            case Op::IJNE: branch(in, static_cast<float>(r[in.a].i) != static_cast<float>(r[in.b].i)); break;
+            case Op::IJLT: branch(in, static_cast<float>(r[in.a].i) < static_cast<float>(r[in.b].i)); break;
+            case Op::IJLE: branch(in, static_cast<float>(r[in.a].i) <= static_cast<float>(r[in.b].i)); break;
+            case Op::IJGT: branch(in, static_cast<float>(r[in.a].i) > static_cast<float>(r[in.b].i)); break;
+            case Op::IJGE: branch(in, static_cast<float>(r[in.a].i) >= static_cast<float>(r[in.b].i)); break;
+
+            case Op::IJEQK: branch(in, static_cast<float>(r[in.a].i) == static_cast<float>(in.k)); break;
+            case Op::IJNEK: branch(in, static_cast<float>(r[in.a].i) != static_cast<float>(in.k)); break;
+            case Op::IJLTK: branch(in, static_cast<float>(r[in.a].i) < static_cast<float>(in.k)); break;
+            case Op::IJLEK: branch(in, static_cast<float>(r[in.a].i) <= static_cast<float>(in.k)); break;
+            case Op::IJGTK: branch(in, static_cast<float>(r[in.a].i) > static_cast<float>(in.k)); break;
+            case Op::IJGEK: branch(in, static_cast<float>(r[in.a].i) >= static_cast<float>(in.k)); break;
+
+            case Op::JMP: pc = in.target; break;
+            case Op::JF:  pc = r[in.a].i == 0 ? in.target : pc + 1; break;
+
+            case Op::CALL: {
+                const VM::CallTarget &f = vm.callTargets[in.b];
+                const int argBase = vm.base + in.a;
+                vm.sp = argBase + f.paramCount;
+                ++vm.profile[in.b].calls;
+                if (vm.tryNative(in.b, argBase)) {
+                    r = &vm.stack[vm.base];
+                    ++pc;
+                    break;
+                }
+                vm.pushFrame(f, argBase, pc + 1);
+                r = &vm.stack[vm.base];
+                pc = code.entry(in.b);
+                break;
+            }
+            case Op::RET: {
+                Value ret = r[in.a];
+                pc = vm.popFrame();
+                vm.stack[vm.sp] = ret;
+                r = &vm.stack[vm.base];
+                break;
+            }
+            case Op::RET_VOID:
+                if (vm.callStack.empty()) {
+                    vm.dispatched += executed;
+                    return;
+                }
+                pc = vm.popFrame();
+                r = &vm.stack[vm.base];
+                break;
+
+            case Op::PRINT:
+                vm.printValue(r[in.a]);
+                ++pc;
+                break;
+            case Op::READ:
+                r[in.a] = vm.readInput(static_cast<Poliz::Op>(in.b));
+                ++pc;
+                break;
+
+            case Op::NEW_ARRAY:
+                vm.newArray(in.a, in.b);
+                ++pc;
+                break;
+            case Op::LOAD_ELEM: {
+                const VM::ArrayObject &arr = vm.arrayAt<false>(in.b, "LOAD_ELEM");
+                const int idx = r[in.c].i;
+                if (idx < 0 || idx >= arr.length)
+                    throw std::runtime_error("LOAD_ELEM: out of range");
+                r[in.a] = arr.load(idx);
+                ++pc;
+                break;
+            }
+            case Op::STORE_ELEM: {
+                VM::ArrayObject &arr = vm.arrayAt<false>(in.a, "STORE_ELEM");
+                const int idx = r[in.b].i;
+                if (idx < 0 || idx >= arr.length)
+                    throw std::runtime_error("STORE_ELEM: out of range");
+                arr.store(idx, r[in.c]);
+                ++pc;
+                break;
+            }
+
+            case Op::STACK_OP:
+                vm.sp = vm.base + in.a;
+                stackOp(poliz[in.b]);
+                ++pc;
+                break;
+            case Op::VEC_LOOP:
+                pc = vm.runVectorLoop(poliz.getVectorLoop(in.b)) ? in.target : pc + 1;
+                break;
+
+            case Op::HALT:
+                vm.dispatched += executed;
+                return;
+        }
+    }
+}
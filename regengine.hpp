@@ -0,0 +1,25 @@
+#pragma once
+#include "regcode.hpp"
+#include "vm.hpp"
+#include <vector>
+
+
+// Executes RegisterCode on the VM's own stack: a frame's registers are
+// the cells from `base` up, so locals, arguments, calls and returns have
+// the same layout as in the stack interpreter and the VM helpers for
+// frames, arrays, input and builtins are shared.
+class RegisterEngine {
+public:
+    RegisterEngine(VM &vm, const Poliz &poliz, const RegisterCode &code);
+
+    // Runs main, whose frame the VM has already set up, to completion.
+    void run(int mainIdx);
+
+private:
+    VM &vm;
+    const Poliz &poliz;
+    const RegisterCode &code;
+    std::vector<VM::Value> constants;
+
+    void stackOp(const Poliz::Instr &ins);
+};
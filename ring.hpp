@@ -0,0 +1,93 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+
+// Fixed-size queue between exactly one producer thread and one consumer
+// thread. try* never block; push and pop wait on the other side's index
+// (std::atomic::wait) only when the ring is full or empty. A side about to
+// wait says so first, and the other side only notifies then, so a busy
+// ring makes no futex calls.
+template<class T, std::size_t N>
+class SpscRing {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+    // An rvalue is only moved from when it is actually pushed.
+    template<class U>
+    bool tryPush(U &&v) {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == N)
+            return false;
+        slots[t & (N - 1)] = std::forward<U>(v);
+        tail.store(t + 1, std::memory_order_release);
+        wake(consumerWaiting, tail);
+        return true;
+    }
+
+    bool tryPop(T &v) {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        v = std::move(slots[h & (N - 1)]);
+        head.store(h + 1, std::memory_order_release);
+        wake(producerWaiting, head);
+        return true;
+    }
+
+    template<class U>
+    void push(U &&v) {
+        while (!tryPush(std::forward<U>(v))) {
+            std::size_t h = head.load(std::memory_order_acquire);
+            if (tail.load(std::memory_order_relaxed) - h == N)
+                sleep(producerWaiting, head, h);
+        }
+    }
+
+    T pop() {
+        T v;
+        while (!tryPop(v)) {
+            std::size_t t = tail.load(std::memory_order_acquire);
+            if (t == head.load(std::memory_order_relaxed))
+                sleep(consumerWaiting, tail, t);
+        }
+        return v;
+    }
+
+    // The oldest element, waiting for one if the ring is empty. It stays
+    // in its slot, unchanged, until the next pop.
+    const T &front() {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        for (;;) {
+            std::size_t t = tail.load(std::memory_order_acquire);
+            if (t != h)
+                return slots[h & (N - 1)];
+            sleep(consumerWaiting, tail, t);
+        }
+    }
+
+private:
+    std::array<T, N> slots{};
+    alignas(64) std::atomic<std::size_t> head{0};
+    std::atomic<bool> producerWaiting{false};
+    alignas(64) std::atomic<std::size_t> tail{0};
+    std::atomic<bool> consumerWaiting{false};
+
+    // Either the sleeper sees the new index after raising its flag, or
+    // the waker, after storing the index, sees the flag; the seq_cst
+    // store and fence keep both from missing each other.
+    static void sleep(std::atomic<bool> &waiting, std::atomic<std::size_t> &index, std::size_t seen) {
+        waiting.store(true, std::memory_order_seq_cst);
+        if (index.load(std::memory_order_seq_cst) == seen)
+            index.wait(seen, std::memory_order_acquire);
+        waiting.store(false, std::memory_order_relaxed);
+    }
+
+    static void wake(std::atomic<bool> &waiting, std::atomic<std::size_t> &index) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed))
+            index.notify_one();
+    }
+};
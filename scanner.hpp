@@ -0,0 +1,151 @@
+#pragma once
+#include "tokens.hpp"
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+
+// The lexer's token spec and the DFA built from it at compile time. The
+// DFA covers identifiers, numbers and the operators and delimiters below,
+// each scanned by maximal munch; literals, whitespace and comments are
+// left to the Lexer. A new operator or keyword is one more line here (and
+// its Token::Type).
+namespace scanner {
+
+    struct Spelling {
+        std::string_view text;
+        Token::Type type;
+    };
+
+    inline constexpr Spelling operators[] = {
+        {"(", Token::Type::LParen}, {")", Token::Type::RParen},
+        {"{", Token::Type::LBrace}, {"}", Token::Type::RBrace},
+        {"[", Token::Type::LBracket}, {"]", Token::Type::RBracket},
+        {",", Token::Type::Comma}, {";", Token::Type::Semicolon}, {"`", Token::Type::Backtick},
+
+        {"+", Token::Type::Plus}, {"-", Token::Type::Minus}, {"*", Token::Type::Asterisk},
+        {"/", Token::Type::Slash}, {"%", Token::Type::Percent},
+        {"++", Token::Type::PlusPlus}, {"--", Token::Type::MinusMinus},
+
+        {"=", Token::Type::Assign},
+
+        {"<<", Token::Type::Shl}, {">>", Token::Type::Shr},
+
+        {"&", Token::Type::Ampersand}, {"|", Token::Type::VerticalBar}, {"^", Token::Type::Caret},
+        {"&&", Token::Type::AmpAmp}, {"||", Token::Type::PipePipe},
+        {"!", Token::Type::Exclamation}, {"~", Token::Type::Tilde},
+
+        {"==", Token::Type::EqualEqual}, {"!=", Token::Type::NotEqual},
+        {"<", Token::Type::Less}, {">", Token::Type::Greater},
+        {"<=", Token::Type::LessEqual}, {">=", Token::Type::GreaterEqual},
+    };
+
+    // An identifier listed in the keywords file becomes one of these; a
+    // listed word missing here stays an identifier.
+    inline constexpr Spelling keywords[] = {
+        {"int", Token::Type::KwInt}, {"char", Token::Type::KwChar}, {"bool", Token::Type::KwBool},
+        {"float", Token::Type::KwFloat}, {"void", Token::Type::KwVoid},
+
+        {"main", Token::Type::KwMain}, {"declare", Token::Type::KwDeclare},
+
+        {"if", Token::Type::KwIf}, {"else", Token::Type::KwElse},
+        {"while", Token::Type::KwWhile}, {"for", Token::Type::KwFor},
+        {"return", Token::Type::KwReturn}, {"break", Token::Type::KwBreak},
+        {"continue", Token::Type::KwContinue},
+
+        {"print", Token::Type::KwPrint}, {"read", Token::Type::KwRead},
+
+        {"true", Token::Type::KwTrue}, {"false", Token::Type::KwFalse},
+    };
+
+    inline Token::Type keyword(std::string_view word) {
+        for (const Spelling &k : keywords)
+            if (k.text == word)
+                return k.type;
+        return Token::Type::Identifier;
+    }
+
+    // Character classes: the fixed ones, then one per distinct character
+    // used by an operator.
+    enum : std::uint8_t { Other, Space, Letter, Digit, Dot, FirstOperatorClass };
+
+    // States; the operators' states follow. No token is EndOfFile, so it
+    // marks a state that accepts nothing.
+    enum : std::uint8_t { Dead, Start, Ident, Int, Float, FirstOperatorState };
+
+    constexpr std::size_t operatorChars() {
+        std::size_t n = 0;
+        for (const Spelling &op : operators)
+            n += op.text.size();
+        return n;
+    }
+
+    struct Dfa {
+        static constexpr std::size_t maxClasses = FirstOperatorClass + operatorChars();
+        static constexpr std::size_t maxStates = FirstOperatorState + operatorChars();
+        static_assert(maxStates <= 256, "scanner states must fit in a byte");
+
+        std::array<std::uint8_t, 256> charClass{};
+        std::array<std::array<std::uint8_t, maxClasses>, maxStates> next{};
+        std::array<Token::Type, maxStates> accept{};
+    };
+
+    constexpr Dfa build() {
+        Dfa d;
+        for (int c = 0; c < 256; ++c) {
+            if (c == ' ' || (c >= '\t' && c <= '\r'))
+                d.charClass[c] = Space;
+            else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_')
+                d.charClass[c] = Letter;
+            else if (c >= '0' && c <= '9')
+                d.charClass[c] = Digit;
+            else if (c == '.')
+                d.charClass[c] = Dot;
+        }
+
+        std::uint8_t classes = FirstOperatorClass;
+        for (const Spelling &op : operators)
+            for (char c : op.text) {
+                auto &cls = d.charClass[static_cast<unsigned char>(c)];
+                if (cls == Letter || cls == Digit || cls == Space)
+                    throw "operators may not contain letters, digits or whitespace";
+                if (cls == Other)
+                    cls = classes++;
+            }
+
+        d.next[Start][Letter] = Ident;
+        d.next[Ident][Letter] = Ident;
+        d.next[Ident][Digit] = Ident;
+        d.accept[Ident] = Token::Type::Identifier;
+
+        // One dot makes a float, digits or none after it ("1." included).
+        d.next[Start][Digit] = Int;
+        d.next[Int][Digit] = Int;
+        d.next[Int][Dot] = Float;
+        d.next[Float][Digit] = Float;
+        d.accept[Int] = Token::Type::IntegerLiteral;
+        d.accept[Float] = Token::Type::FloatLiteral;
+
+        // The operators form a trie below Start.
+        std::uint8_t states = FirstOperatorState;
+        for (const Spelling &op : operators) {
+            std::uint8_t s = Start;
+            for (char c : op.text) {
+                std::uint8_t &to = d.next[s][d.charClass[static_cast<unsigned char>(c)]];
+                if (to == Dead)
+                    to = states++;
+                s = to;
+            }
+            if (d.accept[s] != Token::Type::EndOfFile)
+                throw "operator listed twice";
+            d.accept[s] = op.type;
+        }
+        return d;
+    }
+
+    inline constexpr Dfa dfa = build();
+
+    inline bool isSpace(char c) {
+        return dfa.charClass[static_cast<unsigned char>(c)] == Space;
+    }
+}
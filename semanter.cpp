@@ -1,4 +1,5 @@
 #include "semanter.hpp"
+#include "builtins.hpp"
 
 bool FunctionSignature::matches(const std::vector<TypeInfo>& args,
                                 const Semanter& sem) const {
@@ -15,6 +16,31 @@ bool FunctionSignature::matches(const std::vector<TypeInfo>& args,
 
 Semanter::Semanter() {
     enterScope();
+    declareBuiltins();
+}
+
+void Semanter::declareBuiltins() {
+    for (Token::Type elem : {Token::Type::KwInt, Token::Type::KwFloat}) {
+        TypeInfo scalar(elem);
+        TypeInfo array = TypeInfo::makeArray(scalar);
+
+        for (const auto &b : builtinTable) {
+            if (b.id == Builtin::Read || b.id == Builtin::Print)
+                continue;
+            std::vector<TypeInfo> params{array};
+            if (b.paramCount == 2)
+                params.push_back(b.secondIsArray ? array : scalar);
+
+            TypeInfo ret = b.returnsValue ? scalar : TypeInfo(Token::Type::KwVoid);
+
+            FunctionSymbol f;
+            f.sig = {std::string(b.name), params, ret};
+            f.declared = true;
+            f.defined = true;
+            f.builtin = static_cast<int>(b.id);
+            functions[f.sig.name].push_back(f);
+        }
+    }
 }
 
 
@@ -31,6 +57,7 @@ void Semanter::leaveScope() {
 void Semanter::enterFunctionScope(const TypeInfo& ret) {
     scopes.clear();
     nextSlot = 0;
+    slotTypes.clear();
     currentReturn = ret;
     enterScope();
 }
@@ -41,6 +68,7 @@ void Semanter::declareVariable(const std::string& name, const TypeInfo& type) {
     if (scope.contains(name))
         throw std::runtime_error("Variable '" + name + "' already declared");
 
+    slotTypes.push_back(type);
     scope[name] = Symbol{name, type, nextSlot++};
 }
 
@@ -131,8 +159,6 @@ FunctionSymbol* Semanter::endFunctionCall() {
     auto ctx = callStack.top();
     callStack.pop();
 
-    std::reverse(ctx.args.begin(), ctx.args.end());
-
     auto* f = resolveFunction(ctx.name, ctx.args);
     pushType(f->sig.returnType);
     return f;
@@ -159,13 +185,30 @@ TypeInfo Semanter::peekType() const {
 
 
 bool Semanter::compatible(const TypeInfo& dst, const TypeInfo& src) const {
+    if (dst.isArray || src.isArray) {
+        if (!dst.isArray || !src.isArray ||
+            dst.baseType != src.baseType || dst.rank() != src.rank())
+            return false;
+        for (int k = 0; k < dst.rank(); ++k)
+            if (dst.dims[k] >= 0 && dst.dims[k] != src.dims[k])
+                return false;
+        return true;
+    }
+
     if (dst == src) return true;
     if (src.baseType == Token::Type::KwChar && dst.baseType == Token::Type::KwInt)
         return true;
     return false;
 }
 
+bool Semanter::promotesToInt(const TypeInfo& dst, const TypeInfo& src) const {
+    return !dst.isArray && !src.isArray &&
+           dst.baseType == Token::Type::KwInt && src.baseType == Token::Type::KwChar;
+}
+
 void Semanter::checkAssignment(const TypeInfo& left, const TypeInfo& right) {
+    if (left.isArray || right.isArray)
+        throw std::runtime_error("Arrays are not assignable");
     if (!compatible(left, right))
         throw std::runtime_error("Incompatible assignment");
     pushType(left);
@@ -177,7 +220,7 @@ void Semanter::checkReturn(const TypeInfo& expected, const TypeInfo& actual) {
 }
 
 void Semanter::checkIfCondition(const TypeInfo& t) {
-    if (!t.isBool() && !t.isIntegral())
+    if (t.isArray || (!t.isBool() && !t.isIntegral()))
         throw std::runtime_error("Invalid if condition");
 }
 
@@ -189,7 +232,7 @@ TypeInfo Semanter::commonNumeric(const TypeInfo& a, const TypeInfo& b) const {
 
 void Semanter::checkUnaryOp(Token::Type op) {
     auto t = popType();
-    if (!t.isNumeric())
+    if (t.isArray || !t.isNumeric())
         throw std::runtime_error("Unary op on non-numeric");
     pushType(t);
 }
@@ -198,7 +241,7 @@ void Semanter::checkBinaryOp(Token::Type op) {
     auto b = popType();
     auto a = popType();
 
-    if (!a.isNumeric() || !b.isNumeric())
+    if (a.isArray || b.isArray || !a.isNumeric() || !b.isNumeric())
         throw std::runtime_error("Binary op on non-numeric");
 
     pushType(commonNumeric(a, b));
@@ -206,12 +249,22 @@ void Semanter::checkBinaryOp(Token::Type op) {
 
 void Semanter::declareArray(const std::string& name,
                             const TypeInfo& elemType,
-                            int size) {
+                            const std::vector<int>& dims) {
     auto& scope = scopes.back();
     if (scope.contains(name))
         throw std::runtime_error("Variable '" + name + "' already declared");
 
-    TypeInfo arr = TypeInfo::makeArray(elemType, size);
+    long long total = 1;
+    for (int d : dims) {
+        if (d <= 0)
+            throw std::runtime_error("Array '" + name + "' must have positive size");
+        total *= d;
+        if (total > 0x7fffffff)
+            throw std::runtime_error("Array '" + name + "' is too large");
+    }
+
+    TypeInfo arr = TypeInfo::makeArray(elemType, dims);
+    slotTypes.push_back(arr);
     scope[name] = Symbol{name, arr, nextSlot++};
 }
 
@@ -224,6 +277,24 @@ void Semanter::checkArrayIndex(const TypeInfo& arr,
         throw std::runtime_error("Array index must be integer");
 }
 
+void Semanter::checkReadCount(const TypeInfo& n) const {
+    if (!n.isIntegral())
+        throw std::runtime_error("read(): count must be integer");
+}
+
+// Whole arrays go through the read/print builtins, which like the others
+// handle int and float elements only.
+bool Semanter::isBulkArray(const TypeInfo& t) {
+    return t.isArray && (t.baseType == Token::Type::KwInt || t.baseType == Token::Type::KwFloat);
+}
+
+void Semanter::checkArrayRank(const TypeInfo& arr, int indexCount) const {
+    if (indexCount != arr.rank())
+        throw std::runtime_error(
+            "Array of rank " + std::to_string(arr.rank()) +
+            " indexed with " + std::to_string(indexCount) + " indices");
+}
+
 TypeInfo Semanter::getLiteralType(const Token& tok) const {
     switch (tok.type) {
         case Token::Type::IntegerLiteral: return TypeInfo(Token::Type::KwInt);
@@ -240,12 +311,20 @@ TypeInfo Semanter::getLiteralType(const Token& tok) const {
 void Semanter::checkPrint(const TypeInfo& t) const {
     if (t.isVoid())
         throw std::runtime_error("Cannot print void");
+    if (t.isArray && !isBulkArray(t))
+        throw std::runtime_error("Cannot print array");
 }
 
 void Semanter::checkRead(const TypeInfo& t) const {
     if (t.isVoid())
         throw std::runtime_error("read(): cannot read into void");
 
+    if (t.isArray) {
+        if (!isBulkArray(t))
+            throw std::runtime_error("read(): cannot read into array");
+        return;
+    }
+
     if (!t.isNumeric() && !t.isBool() && !t.isChar())
         throw std::runtime_error("read(): unsupported type");
 }
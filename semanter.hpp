@@ -34,6 +34,7 @@ struct FunctionSymbol {
     bool defined = false;
     int entryIp = -1;
     int polizIndex = -1;
+    int builtin = -1;
 };
 
 
@@ -47,6 +48,8 @@ class Semanter {
 public:
     Semanter();
 
+    void declareBuiltins();
+
     void enterScope();
     void leaveScope();
 
@@ -89,10 +92,14 @@ public:
 
     TypeInfo commonNumeric(const TypeInfo& a, const TypeInfo& b) const;
     bool compatible(const TypeInfo& dst, const TypeInfo& src) const;
+    // A compatible value that must be converted before it lands in dst:
+    // a char stored, passed or returned as an int.
+    bool promotesToInt(const TypeInfo& dst, const TypeInfo& src) const;
 
-    void declareArray(const std::string& name, const TypeInfo& elemType, int size);
+    void declareArray(const std::string& name, const TypeInfo& elemType, const std::vector<int>& dims);
 
     void checkArrayIndex(const TypeInfo& arr, const TypeInfo& idx) const;
+    void checkArrayRank(const TypeInfo& arr, int indexCount) const;
 
     TypeInfo getLiteralType(const Token& tok) const;
 
@@ -102,11 +109,24 @@ public:
         return currentReturn;
     }
 
+    int frameSize() const {
+        return nextSlot;
+    }
+
+    const TypeInfo* slotType(int slot) const {
+        if (slot < 0 || slot >= static_cast<int>(slotTypes.size()))
+            return nullptr;
+        return &slotTypes[slot];
+    }
+
     void checkRead(const TypeInfo& t) const;
+    void checkReadCount(const TypeInfo& n) const;
+    static bool isBulkArray(const TypeInfo& t);
 
 private:
     std::vector<std::unordered_map<std::string, Symbol>> scopes;
     int nextSlot = 0;
+    std::vector<TypeInfo> slotTypes;
 
     std::unordered_map<std::string, std::vector<FunctionSymbol>> functions;
 
@@ -0,0 +1,355 @@
+#include "vm.hpp"
+#include "closures.hpp"
+#include "verifier.hpp"
+#include <algorithm>
+
+
+namespace {
+    using Op = Poliz::Op;
+
+    // CachedInstr::code for op at depth class k (0..4).
+    constexpr int cachedOp(Op op, int k) {
+        return static_cast<int>(op) * 5 + k;
+    }
+
+    // binaryNumOp, with the int path wrapping like the other engines.
+    template<Op O, class V>
+    V arith(const V &x, const V &y) {
+        if (x.kind != V::Kind::Float && y.kind != V::Kind::Float) {
+            uint32_t a = static_cast<uint32_t>(x.i), b = static_cast<uint32_t>(y.i);
+            if constexpr (O == Op::ADD) return V::makeInt(static_cast<int32_t>(a + b));
+            else if constexpr (O == Op::SUB) return V::makeInt(static_cast<int32_t>(a - b));
+            else if constexpr (O == Op::MUL) return V::makeInt(static_cast<int32_t>(a * b));
+            else {
+                if (y.i == 0) throw std::runtime_error("VM: division by zero");
+                return V::makeInt(x.i / y.i);
+            }
+        }
+
+        float a = x.kind == V::Kind::Float ? x.f : static_cast<float>(x.i);
+        float b = y.kind == V::Kind::Float ? y.f : static_cast<float>(y.i);
+        if constexpr (O == Op::ADD) return V::makeFloat(a + b);
+        else if constexpr (O == Op::SUB) return V::makeFloat(a - b);
+        else if constexpr (O == Op::MUL) return V::makeFloat(a * b);
+        else {
+            if (b == 0) throw std::runtime_error("VM: division by zero");
+            return V::makeFloat(a / b);
+        }
+    }
+
+    template<Op O, class V>
+    V compare(const V &x, const V &y) {
+        float a = x.kind == V::Kind::Float ? x.f : static_cast<float>(x.i);
+        float b = y.kind == V::Kind::Float ? y.f : static_cast<float>(y.i);
+        if constexpr (O == Op::CMP_EQ) return V::makeBool(a == b);
+        else if constexpr (O == Op::CMP_NE) return V::makeBool(a != b);
+        else if constexpr (O == Op::CMP_LT) return V::makeBool(a < b);
+        else if constexpr (O == Op::CMP_LE) return V::makeBool(a <= b);
+        else if constexpr (O == Op::CMP_GT) return V::makeBool(a > b);
+        else return V::makeBool(a >= b);
+    }
+}
+
+
+void VM::enableStackCache() {
+    if (!poliz.isVerified())
+        return;
+
+    // The sentinel past the end lets the loop run without a bounds check.
+    const int codeSize = static_cast<int>(poliz.size());
+    cachedCode.assign(codeSize + 1, CachedInstr{});
+    for (CachedInstr &c : cachedCode)
+        c.code = cachedOp(Op::HALT, 0);
+
+    for (std::size_t f = 0; f < poliz.functionCount(); ++f) {
+        if (poliz.getFunction(static_cast<int>(f)).entryIp < 0)
+            continue;
+        Verifier::FunctionAnalysis an = Verifier::analyze(poliz, static_cast<int>(f));
+        if (!an.ok)
+            throw std::runtime_error("VM: " + an.error);
+
+        for (const auto &[ip, st] : an.states) {
+            if (ip >= codeSize)
+                continue;
+            const auto &ins = poliz[ip];
+            CachedInstr &c = cachedCode[ip];
+            c.depth = std::min(static_cast<int>(st.stack.size()), 4);
+            c.a = ins.arg1.value_or(0);
+            c.b = ins.arg2.value_or(0);
+
+            Op op = ins.op;
+            switch (ins.op) {
+                case Op::PUSH_INT:
+                    c.imm = Value::makeInt(c.a);
+                    break;
+                case Op::PUSH_FLOAT: {
+                    float v;
+                    std::memcpy(&v, &c.a, sizeof(float));
+                    c.imm = Value::makeFloat(v);
+                    op = Op::PUSH_INT;
+                    break;
+                }
+                case Op::PUSH_BOOL:
+                    c.imm = Value::makeBool(c.a != 0);
+                    op = Op::PUSH_INT;
+                    break;
+                case Op::PUSH_CHAR:
+                    c.imm = Value::makeChar(static_cast<char>(c.a));
+                    op = Op::PUSH_INT;
+                    break;
+                case Op::PUSH_STRING:
+                    c.imm = Value::makeString(c.a);
+                    op = Op::PUSH_INT;
+                    break;
+                case Op::READ_FLOAT:
+                case Op::READ_BOOL:
+                case Op::READ_CHAR:
+                case Op::READ_STRING:
+                    op = Op::READ_INT;
+                    break;
+                default:
+                    break;
+            }
+            if (op == Op::READ_INT)
+                c.a = static_cast<int>(ins.op);
+            c.code = cachedOp(op, c.depth);
+        }
+    }
+}
+
+
+// The operand stack of the current frame is split between memory and two
+// locals: at depth d the top min(d, 2) cells are in `a` (the lower) and
+// `b`, and `top` points just past the cells below them. Every CachedInstr
+// moves the cells between the two so that its successor finds exactly the
+// split its own depth class expects; ops that need the whole stack in
+// memory (calls, builtins, multi-index arrays) spill the locals first and
+// fill them again afterwards, which leaves the stack laid out as in
+// execute() whenever control passes to a helper or another engine.
+void VM::executeCached(int ip) {
+    const CachedInstr *code = cachedCode.data();
+    Value *locals = stack.data() + base;
+    Value *top = stack.data() + sp;
+    Value a, b;
+    uint64_t executed = 0;
+
+    auto save = [&] {
+        sp = static_cast<int>(top - stack.data());
+    };
+    auto load = [&] {
+        locals = stack.data() + base;
+        top = stack.data() + sp;
+    };
+    auto spill = [&](int k) {
+        if (k >= 1) *top++ = a;
+        if (k >= 2) *top++ = b;
+    };
+    auto fill = [&](int k) {
+        if (k >= 2) b = *--top;
+        if (k >= 1) a = *--top;
+    };
+    auto put = [&](int k, const Value &v) {
+        if (k == 0) {
+            a = v;
+        } else if (k == 1) {
+            b = v;
+        } else {
+            *top++ = a;
+            a = b;
+            b = v;
+        }
+    };
+    auto take = [&](int k) {
+        if (k <= 1)
+            return a;
+        Value v = b;
+        if (k >= 3) {
+            b = a;
+            a = *--top;
+        }
+        return v;
+    };
+    auto binary = [&](int k, auto op) {
+        if (k <= 2) {
+            a = op(a, b);
+        } else {
+            b = op(a, b);
+            a = *--top;
+        }
+    };
+    auto unary = [&](int k, auto op) {
+        if (k <= 1) a = op(a);
+        else b = op(b);
+    };
+    auto intOp = [&](int k, auto op) {
+        binary(k, [op](const Value &x, const Value &y) { return Value::makeInt(op(x.i, y.i)); });
+    };
+
+// One case per depth class, with the class as the constant k.
+#define CACHED(OP, ...)                                                   \
+    case cachedOp(OP, 0): { constexpr int k = 0; __VA_ARGS__ } break;     \
+    case cachedOp(OP, 1): { constexpr int k = 1; __VA_ARGS__ } break;     \
+    case cachedOp(OP, 2): { constexpr int k = 2; __VA_ARGS__ } break;     \
+    case cachedOp(OP, 3): { constexpr int k = 3; __VA_ARGS__ } break;     \
+    case cachedOp(OP, 4): { constexpr int k = 4; __VA_ARGS__ } break;
+
+// The same for an op whose code does not depend on the class.
+#define ANY_DEPTH(OP, ...)                                                \
+    case cachedOp(OP, 0): case cachedOp(OP, 1): case cachedOp(OP, 2):     \
+    case cachedOp(OP, 3): case cachedOp(OP, 4): { __VA_ARGS__ } break;
+
+    for (;;) {
+        const CachedInstr &in = code[ip];
+        ++executed;
+
+        switch (in.code) {
+            CACHED(Op::PUSH_INT, put(k, in.imm); ++ip;)
+            CACHED(Op::LOAD_VAR, put(k, locals[in.a]); ++ip;)
+            CACHED(Op::STORE_VAR, locals[in.a] = take(k); ++ip;)
+
+            CACHED(Op::ADD, binary(k, arith<Op::ADD, Value>); ++ip;)
+            CACHED(Op::SUB, binary(k, arith<Op::SUB, Value>); ++ip;)
+            CACHED(Op::MUL, binary(k, arith<Op::MUL, Value>); ++ip;)
+            CACHED(Op::DIV, binary(k, arith<Op::DIV, Value>); ++ip;)
+            CACHED(Op::MOD,
+                intOp(k, [](int x, int y) {
+                    if (y == 0) throw std::runtime_error("VM: modulo by zero");
+                    return x % y;
+                });
+                ++ip;)
+
+            CACHED(Op::AND, intOp(k, [](int x, int y) { return x & y; }); ++ip;)
+            CACHED(Op::OR, intOp(k, [](int x, int y) { return x | y; }); ++ip;)
+            CACHED(Op::XOR, intOp(k, [](int x, int y) { return x ^ y; }); ++ip;)
+            CACHED(Op::SHL, intOp(k, [](int x, int y) { return x << y; }); ++ip;)
+            CACHED(Op::SHR, intOp(k, [](int x, int y) { return x >> y; }); ++ip;)
+
+            CACHED(Op::CMP_EQ, binary(k, compare<Op::CMP_EQ, Value>); ++ip;)
+            CACHED(Op::CMP_NE, binary(k, compare<Op::CMP_NE, Value>); ++ip;)
+            CACHED(Op::CMP_LT, binary(k, compare<Op::CMP_LT, Value>); ++ip;)
+            CACHED(Op::CMP_LE, binary(k, compare<Op::CMP_LE, Value>); ++ip;)
+            CACHED(Op::CMP_GT, binary(k, compare<Op::CMP_GT, Value>); ++ip;)
+            CACHED(Op::CMP_GE, binary(k, compare<Op::CMP_GE, Value>); ++ip;)
+
+            CACHED(Op::LOG_AND,
+                binary(k, [](const Value &x, const Value &y) { return Value::makeBool(x.i && y.i); });
+                ++ip;)
+            CACHED(Op::LOG_OR,
+                binary(k, [](const Value &x, const Value &y) { return Value::makeBool(x.i || y.i); });
+                ++ip;)
+
+            CACHED(Op::NEG,
+                unary(k, [](const Value &x) {
+                    return x.kind == Value::Kind::Int ? Value::makeInt(-x.i) : Value::makeFloat(-x.f);
+                });
+                ++ip;)
+            CACHED(Op::NOT, unary(k, [](const Value &x) { return Value::makeBool(!x.i); }); ++ip;)
+            CACHED(Op::BNOT, unary(k, [](const Value &x) { return Value::makeInt(~x.i); }); ++ip;)
+
+            CACHED(Op::JUMP,
+                if (tierThreshold && in.a <= ip && ++backEdges[ip] >= tierThreshold) {
+                    promote(functionAt(ip), Tier::Closure, ip, backEdges[ip]);
+                    spill(k);
+                    save();
+                    ip = closures->run(in.a);
+                    load();
+                    fill(code[ip].depth);
+                    break;
+                }
+                ip = in.a;)
+            CACHED(Op::JUMP_IF_FALSE, ip = take(k).i == 0 ? in.a : ip + 1;)
+
+            ANY_DEPTH(Op::NOP, ++ip;)
+
+            ANY_DEPTH(Op::NEW_ARRAY, newArray(in.a, in.b); ++ip;)
+            CACHED(Op::LOAD_ELEM,
+                unary(k, [&](const Value &idx) {
+                    const ArrayObject &arr = arrayAt<false>(in.a, "LOAD_ELEM");
+                    if (idx.i < 0 || idx.i >= arr.length)
+                        throw std::runtime_error("LOAD_ELEM: out of range");
+                    return arr.load(idx.i);
+                });
+                ++ip;)
+            CACHED(Op::STORE_ELEM,
+                Value value = take(k);
+                Value idx = take(k - 1);
+                ArrayObject &arr = arrayAt<false>(in.a, "STORE_ELEM");
+                if (idx.i < 0 || idx.i >= arr.length)
+                    throw std::runtime_error("STORE_ELEM: out of range");
+                arr.store(idx.i, value);
+                ++ip;)
+            CACHED(Op::LOAD_ELEM_N,
+                spill(k);
+                save();
+                const ArrayObject &arr = arrayAt<false>(in.a, "LOAD_ELEM_N");
+                int flat = flatIndex<false>(arr, poliz.getArrayType(in.b), "LOAD_ELEM_N");
+                load();
+                *top++ = arr.load(flat);
+                fill(code[++ip].depth);)
+            CACHED(Op::STORE_ELEM_N,
+                spill(k);
+                Value value = *--top;
+                save();
+                ArrayObject &arr = arrayAt<false>(in.a, "STORE_ELEM_N");
+                int flat = flatIndex<false>(arr, poliz.getArrayType(in.b), "STORE_ELEM_N");
+                arr.store(flat, value);
+                load();
+                fill(code[++ip].depth);)
+            CACHED(Op::CALL_BUILTIN,
+                spill(k);
+                save();
+                callBuiltin<false>(static_cast<Builtin>(in.a));
+                load();
+                fill(code[++ip].depth);)
+            ANY_DEPTH(Op::VEC_LOOP,
+                ip = runVectorLoop(poliz.getVectorLoop(in.a)) ? in.b : ip + 1;)
+
+            CACHED(Op::READ_INT, put(k, readInput(static_cast<Op>(in.a))); ++ip;)
+            CACHED(Op::PRINT, printValue(take(k)); ++ip;)
+
+            CACHED(Op::CALL,
+                const CallTarget &f = callTargets[in.a];
+                spill(k);
+                save();
+                int argBase = sp - f.paramCount;
+                uint64_t calls = ++profile[in.a].calls;
+                if (tryNative(in.a, argBase)) {
+                    load();
+                    fill(code[++ip].depth);
+                    break;
+                }
+
+                pushFrame(f, argBase, ip + 1);
+                if (tierThreshold && calls >= tierThreshold) {
+                    promote(in.a, Tier::Closure, -1, calls);
+                    ip = closures->run(f.entryIp);
+                    load();
+                    fill(code[ip].depth);
+                    break;
+                }
+                load();
+                ip = f.entryIp;)
+            CACHED(Op::RET_VALUE,
+                Value ret = take(k);
+                ip = popFrame();
+                load();
+                *top++ = ret;
+                fill(code[ip].depth);)
+            ANY_DEPTH(Op::RET_VOID,
+                if (callStack.empty()) {
+                    ip = static_cast<int>(poliz.size());
+                    break;
+                }
+                ip = popFrame();
+                load();
+                fill(code[ip].depth);)
+
+            default:
+                save();
+                dispatched += executed;
+                return;
+        }
+    }
+#undef CACHED
+#undef ANY_DEPTH
+}
@@ -0,0 +1,22 @@
+#!/bin/sh
+# Usage: tests/check_lexer.sh [path/to/TranslatorLexer]
+# Run from the repository root so keywords.txt is found. Lexes every
+# program under tests/ and bench/, and the fixtures in tests/lexer/ --
+# multi-line comments, literals continued over a newline, comments and
+# literals left open -- with nextLexem alone and in chunks (--check-lexer,
+# with --lex-jobs counts of its own and the ones below), and fails if any
+# chunked token stream differs.
+BIN=${1:-build/TranslatorLexer}
+DIR=$(dirname "$0")
+
+if [ ! -x "$BIN" ]; then
+    echo "usage: $0 [path/to/TranslatorLexer] (no $BIN; build with cmake -S . -B build)" >&2
+    exit 2
+fi
+
+status=0
+for jobs in 1 5 32; do
+    "$BIN" --check-lexer --lex-jobs=$jobs "$DIR"/*.txt "$DIR"/lexer/*.txt "$DIR"/../bench/*.txt >/dev/null || status=1
+done
+[ $status -eq 0 ] && echo "chunked lexing matches nextLexem on $(ls "$DIR"/*.txt "$DIR"/lexer/*.txt "$DIR"/../bench/*.txt | wc -l) files"
+exit $status
@@ -0,0 +1,68 @@
+#!/bin/sh
+# Usage: tests/run.sh [path/to/TranslatorLexer]
+# Run from the repository root so keywords.txt is found. Every tests/*.txt
+# with a .out file next to it is compiled and run -- stdin from its .in
+# file if there is one, extra driver flags from its .args file -- and all
+# it prints, stdout and stderr, must match the .out file. The checks after
+# that need more than one run each; check_lexer.sh runs last.
+BIN=${1:-build/TranslatorLexer}
+DIR=$(dirname "$0")
+
+if [ ! -x "$BIN" ]; then
+    echo "usage: $0 [path/to/TranslatorLexer] (no $BIN; build with cmake -S . -B build)" >&2
+    exit 2
+fi
+
+status=0
+fail() {
+    echo "FAIL: $*" >&2
+    status=1
+}
+
+GOT=$(mktemp)
+WORK=$(mktemp -d)
+trap 'rm -rf "$GOT" "$WORK"' EXIT
+
+# The shell's own "Aborted" notes go to the stderr its command was given,
+# so the program's stderr is redirected inside a child of its own.
+for out in "$DIR"/*.out; do
+    [ -f "$out" ] || continue
+    name=${out%.out}
+    input=/dev/null
+    [ -f "$name.in" ] && input=$name.in
+    args=$(cat "$name.args" 2>/dev/null)
+    ( sh -c 'exec "$@" 2>&1' sh "$BIN" --quiet $args "$name.txt" <"$input" >"$GOT"; : ) 2>/dev/null
+    if ! cmp -s "$GOT" "$out"; then
+        fail "$name.txt"
+        diff "$out" "$GOT" | head -10 >&2
+    fi
+done
+
+# Programs that must pass the verifier, not just run: --emit-cpp stops
+# after compiling, and without --quiet the driver reports the verdict.
+for prog in Correct5 Correct7 Correct8 Correct9 Correct10; do
+    "$BIN" --emit-cpp=/dev/null "$DIR/$prog.txt" 2>&1 | grep -q "^Верификация пройдена" ||
+        fail "$prog.txt does not verify"
+done
+
+# The float Sum loop in Correct6 is reassociated when vectorized; the
+# scalar loop gives the sum in source order.
+got=$("$BIN" --quiet --no-vectorize "$DIR/Correct6.txt" 2>&1)
+[ "$got" = 7.48548 ] || fail "Correct6.txt --no-vectorize: $got"
+
+# Deep recursion on --batch worker threads with the JIT compiling at once:
+# native frames have to stay within each worker's own stack, also when the
+# main thread's stack is unlimited.
+for n in 10 1000 300000; do
+    echo "$n" >"$WORK/$n.txt"
+done
+for limit in "" unlimited; do
+    got=$( ( [ -z "$limit" ] || ulimit -s "$limit" 2>/dev/null
+             "$BIN" --quiet --jit-threshold=1 --batch="$WORK" --jobs=2 "$DIR/Correct4.txt" ) 2>&1 )
+    [ "$got" = "$(printf '10\n10\n10\n1000\n10\n300000')" ] || fail "Correct4.txt --batch, stack limit ${limit:-default}: $got"
+done
+
+sh "$DIR/check_lexer.sh" "$BIN" >/dev/null || fail "check_lexer.sh"
+
+[ $status -eq 0 ] && echo "all tests passed"
+exit $status
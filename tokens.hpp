@@ -1,11 +1,56 @@
 #pragma once
+#include <algorithm>
 #include <string>
+#include <cstdint>
+#include <cstring>
+#include <vector>
 
 struct SourcePos {
     int line = 1;
     int column = 1;
 };
 
+// Offsets of the newlines in a source file, found once with memchr, so
+// that a byte offset turns into a line and column by binary search only
+// when a position is actually shown.
+class LineIndex {
+public:
+    LineIndex(const char *text, std::size_t size) {
+        const char *p = text, *end = text + size;
+        while ((p = static_cast<const char *>(std::memchr(p, '\n', end - p))))
+            newlines.push_back(static_cast<int>(p++ - text));
+    }
+
+    // Follows an edit that replaced `removed` bytes at `offset` with the
+    // `size` bytes at `inserted`.
+    void replace(int offset, int removed, const char *inserted, std::size_t size) {
+        auto first = std::lower_bound(newlines.begin(), newlines.end(), offset);
+        auto last = std::lower_bound(first, newlines.end(), offset + removed);
+        int delta = static_cast<int>(size) - removed;
+        for (auto it = last; it != newlines.end(); ++it)
+            *it += delta;
+
+        std::vector<int> added;
+        const char *p = inserted, *end = inserted + size;
+        while ((p = static_cast<const char *>(std::memchr(p, '\n', end - p))))
+            added.push_back(offset + static_cast<int>(p++ - inserted));
+        newlines.insert(newlines.erase(first, last), added.begin(), added.end());
+    }
+
+    // Where the scanner stands after reading the byte at `offset`: a
+    // newline counts towards its own line, at column 0, and -1 (nothing
+    // read yet) is 1:0.
+    SourcePos locate(int offset) const {
+        auto it = std::upper_bound(newlines.begin(), newlines.end(), offset);
+        int line = 1 + static_cast<int>(it - newlines.begin());
+        int lineStart = it == newlines.begin() ? -1 : *(it - 1);
+        return {line, offset - lineStart};
+    }
+
+private:
+    std::vector<int> newlines;
+};
+
 struct Token {
     enum class Type : uint16_t {
         EndOfFile = 0,
@@ -52,8 +97,11 @@ struct Token {
     };
 
     Type type;
+    int offset = -1;                    // the byte the scanner stood on: the token's first, or the last one read for EndOfFile
     std::string lexeme;
-    SourcePos pos;
+    const LineIndex *lines = nullptr;   // owned by the Lexer that read the file
+
+    SourcePos pos() const { return lines ? lines->locate(offset) : SourcePos{}; }
 
     std::string toString() const;
 };
@@ -132,6 +180,7 @@ inline std::string tokenTypeName(Token::Type t) {
 }
 
 inline std::string Token::toString() const {
+    SourcePos p = pos();
     return tokenTypeName(type) + " '" + lexeme + "' @" +
-           std::to_string(pos.line) + ":" + std::to_string(pos.column);
+           std::to_string(p.line) + ":" + std::to_string(p.column);
 }
\ No newline at end of file
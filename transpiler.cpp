@@ -0,0 +1,712 @@
+#include "transpiler.hpp"
+#include "builtins.hpp"
+#include "verifier.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <set>
+
+
+namespace {
+    using Op = Poliz::Op;
+
+    const char *const prelude = R"PRELUDE(// Generated from Poliz by TranslatorLexer --emit-cpp.
+#include <cfloat>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Value {
+    enum class Kind { Int, Float, Bool, Char, String, Array } kind = Kind::Int;
+    int   i = 0;
+    float f = 0.0f;
+
+    static Value makeInt(int v)     { Value x; x.kind = Kind::Int; x.i = v; return x; }
+    static Value makeFloat(float v) { Value x; x.kind = Kind::Float; x.f = v; return x; }
+    static Value makeBool(bool v)   { Value x; x.kind = Kind::Bool; x.i = v ? 1 : 0; return x; }
+    static Value makeChar(char c)   { Value x; x.kind = Kind::Char; x.i = c; return x; }
+    static Value makeString(int k)  { Value x; x.kind = Kind::String; x.i = k; return x; }
+    static Value makeArray(int h)   { Value x; x.kind = Kind::Array; x.i = h; return x; }
+};
+
+using K = Value::Kind;
+
+inline int32_t wrapAdd(int32_t a, int32_t b) { return static_cast<int32_t>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b)); }
+inline int32_t wrapSub(int32_t a, int32_t b) { return static_cast<int32_t>(static_cast<uint32_t>(a) - static_cast<uint32_t>(b)); }
+inline int32_t wrapMul(int32_t a, int32_t b) { return static_cast<int32_t>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b)); }
+inline int32_t wrapNeg(int32_t a) { return static_cast<int32_t>(0u - static_cast<uint32_t>(a)); }
+inline int32_t shl(int32_t a, int32_t b) { return static_cast<int32_t>(static_cast<uint32_t>(a) << (b & 31)); }
+inline int32_t shr(int32_t a, int32_t b) { return a >> (b & 31); }
+
+struct ArrayType {
+    K elem;
+    int size;
+};
+
+struct ArrayObject {
+    K elemKind;
+    int length;
+    int descriptor;
+    std::vector<int32_t> ints;
+    std::vector<float> floats;
+    std::vector<char> chars;
+
+    ArrayObject(K kind, int len, int desc) : elemKind(kind), length(len), descriptor(desc) {
+        switch (elemKind) {
+            case K::Float: floats.assign(length, 0.0f); break;
+            case K::Char:
+            case K::Bool:  chars.assign(length, 0); break;
+            default:       ints.assign(length, 0); break;
+        }
+    }
+
+    void reset() {
+        std::fill(ints.begin(), ints.end(), 0);
+        std::fill(floats.begin(), floats.end(), 0.0f);
+        std::fill(chars.begin(), chars.end(), 0);
+    }
+
+    Value load(int idx) const {
+        switch (elemKind) {
+            case K::Float: return Value::makeFloat(floats[idx]);
+            case K::Char:  return Value::makeChar(chars[idx]);
+            case K::Bool:  return Value::makeBool(chars[idx] != 0);
+            default:       return Value::makeInt(ints[idx]);
+        }
+    }
+
+    void store(int idx, const Value &v) {
+        switch (elemKind) {
+            case K::Float: floats[idx] = v.kind == K::Float ? v.f : static_cast<float>(v.i); break;
+            case K::Char:  chars[idx] = static_cast<char>(v.kind == K::Float ? static_cast<int>(v.f) : v.i); break;
+            case K::Bool:  chars[idx] = (v.kind == K::Float ? v.f != 0.0f : v.i != 0) ? 1 : 0; break;
+            default:       ints[idx] = v.kind == K::Float ? static_cast<int32_t>(v.f) : v.i; break;
+        }
+    }
+};
+
+std::vector<std::string> strings;
+std::vector<ArrayObject> heap;
+
+inline Value leave(std::size_t heapBase, Value v) {
+    heap.erase(heap.begin() + heapBase, heap.end());
+    return v;
+}
+
+inline void newArray(Value &cell, int descriptor, const ArrayType &t, std::size_t heapBase) {
+    if (cell.kind == K::Array && cell.i >= static_cast<int>(heapBase) &&
+        cell.i < static_cast<int>(heap.size()) && heap[cell.i].descriptor == descriptor) {
+        heap[cell.i].reset();
+        return;
+    }
+    heap.emplace_back(t.elem, t.size, descriptor);
+    cell = Value::makeArray(static_cast<int>(heap.size()) - 1);
+}
+
+[[noreturn]] inline void fail(const std::string &msg) { throw std::runtime_error(msg); }
+[[noreturn]] inline void outOfRange(const char *what) { fail(std::string(what) + ": out of range"); }
+
+inline std::string nextInput() {
+    std::string s;
+    if (!(std::cin >> s))
+        fail("Input exhausted");
+    return s;
+}
+
+// Numbers are parsed as InputBuffer::nextInt / nextFloat do.
+inline Value readInt() {
+    std::string s = nextInput();
+    const char *p = s.data(), *e = p + s.size();
+    if (p != e && *p == '+' && e - p > 1 && p[1] != '-')
+        ++p;
+
+    int32_t v;
+    if (std::from_chars(p, e, v).ec != std::errc())
+        fail("Invalid int input: " + s);
+    return Value::makeInt(v);
+}
+
+inline bool isHexDigit(char c) {
+    return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
+
+inline Value readFloat() {
+    std::string s = nextInput();
+    const char *p = s.data(), *e = p + s.size();
+    bool negative = false;
+    if (p != e && (*p == '+' || *p == '-')) {
+        negative = *p == '-';
+        ++p;
+    }
+
+    auto format = std::chars_format::general;
+    if (e - p > 2 && p[0] == '0' && (p[1] | 0x20) == 'x' && (isHexDigit(p[2]) || p[2] == '.')) {
+        format = std::chars_format::hex;
+        p += 2;
+    }
+
+    float v;
+    if (p == e || *p == '-' || std::from_chars(p, e, v, format).ec != std::errc() ||
+        (v != 0 && std::fabs(v) < FLT_MIN))
+        fail("Invalid float input: " + s);
+    return Value::makeFloat(negative ? -v : v);
+}
+
+inline Value readBool() {
+    std::string s = nextInput();
+    if (s == "true") return Value::makeBool(true);
+    if (s == "false") return Value::makeBool(false);
+    fail("Invalid bool input: " + s);
+}
+
+inline Value readChar() {
+    std::string s = nextInput();
+    if (s.size() != 1)
+        fail("Invalid char input: " + s);
+    return Value::makeChar(s[0]);
+}
+
+inline Value readString() {
+    strings.push_back(nextInput());
+    return Value::makeString(static_cast<int>(strings.size()) - 1);
+}
+
+inline void print(const Value &v) {
+    switch (v.kind) {
+        case K::Int:    std::cout << v.i; break;
+        case K::Float:  std::cout << v.f; break;
+        case K::Bool:   std::cout << (v.i ? "true" : "false"); break;
+        case K::Char:   std::cout << static_cast<char>(v.i); break;
+        case K::String: std::cout << strings[v.i]; break;
+        case K::Array:  std::cout << "<array>"; break;
+    }
+    std::cout << "\n";
+}
+
+inline float asFloat(const Value &v) { return v.kind == K::Float ? v.f : static_cast<float>(v.i); }
+inline bool bothInt(const Value &a, const Value &b) { return a.kind != K::Float && b.kind != K::Float; }
+
+inline Value add(Value a, Value b) {
+    return bothInt(a, b) ? Value::makeInt(wrapAdd(a.i, b.i)) : Value::makeFloat(asFloat(a) + asFloat(b));
+}
+inline Value sub(Value a, Value b) {
+    return bothInt(a, b) ? Value::makeInt(wrapSub(a.i, b.i)) : Value::makeFloat(asFloat(a) - asFloat(b));
+}
+inline Value mul(Value a, Value b) {
+    return bothInt(a, b) ? Value::makeInt(wrapMul(a.i, b.i)) : Value::makeFloat(asFloat(a) * asFloat(b));
+}
+inline Value div(Value a, Value b) {
+    if (bothInt(a, b)) {
+        if (b.i == 0) fail("VM: division by zero");
+        return Value::makeInt(a.i / b.i);
+    }
+    if (asFloat(b) == 0) fail("VM: division by zero");
+    return Value::makeFloat(asFloat(a) / asFloat(b));
+}
+inline Value neg(Value a) {
+    return a.kind == K::Int ? Value::makeInt(wrapNeg(a.i)) : Value::makeFloat(-a.f);
+}
+
+// Builtins run the scalar reference loops; the VM may use SIMD kernels,
+// whose float sum/dot round differently.
+inline ArrayObject &sameLength(const char *name, ArrayObject &a, const Value &other) {
+    ArrayObject &b = heap[other.i];
+    if (b.length != a.length)
+        fail(std::string("VM: ") + name + ": length mismatch");
+    return b;
+}
+
+inline Value builtinSum(Value x) {
+    ArrayObject &a = heap[x.i];
+    if (a.elemKind == K::Float) {
+        float s = 0.0f;
+        for (float v : a.floats) s += v;
+        return Value::makeFloat(s);
+    }
+    int32_t s = 0;
+    for (int32_t v : a.ints) s = wrapAdd(s, v);
+    return Value::makeInt(s);
+}
+
+inline Value builtinDot(Value x, Value y) {
+    ArrayObject &a = heap[x.i];
+    ArrayObject &b = sameLength("dot", a, y);
+    if (a.elemKind == K::Float) {
+        float s = 0.0f;
+        for (int k = 0; k < a.length; ++k) s += a.floats[k] * b.floats[k];
+        return Value::makeFloat(s);
+    }
+    int32_t s = 0;
+    for (int k = 0; k < a.length; ++k) s = wrapAdd(s, wrapMul(a.ints[k], b.ints[k]));
+    return Value::makeInt(s);
+}
+
+inline Value builtinExtreme(Value x, bool wantMax) {
+    ArrayObject &a = heap[x.i];
+    if (a.elemKind == K::Float) {
+        float m = a.floats[0];
+        for (float v : a.floats) if (wantMax ? v > m : v < m) m = v;
+        return Value::makeFloat(m);
+    }
+    int32_t m = a.ints[0];
+    for (int32_t v : a.ints) if (wantMax ? v > m : v < m) m = v;
+    return Value::makeInt(m);
+}
+
+inline void builtinFill(Value x, Value v) {
+    ArrayObject &a = heap[x.i];
+    if (a.elemKind == K::Float) std::fill(a.floats.begin(), a.floats.end(), asFloat(v));
+    else std::fill(a.ints.begin(), a.ints.end(), v.i);
+}
+
+inline void builtinScale(Value x, Value k) {
+    ArrayObject &a = heap[x.i];
+    if (a.elemKind == K::Float) { for (float &v : a.floats) v *= asFloat(k); }
+    else { for (int32_t &v : a.ints) v = wrapMul(v, k.i); }
+}
+
+inline void builtinCopy(Value x, Value y) {
+    ArrayObject &a = heap[x.i];
+    ArrayObject &b = sameLength("copy", a, y);
+    if (a.elemKind == K::Float) std::memmove(a.floats.data(), b.floats.data(), a.length * sizeof(float));
+    else std::memmove(a.ints.data(), b.ints.data(), a.length * sizeof(int32_t));
+}
+
+inline void builtinRead(Value x, Value n) {
+    ArrayObject &a = heap[x.i];
+    if (n.i < 0 || n.i > a.length)
+        fail("VM: read: count out of range");
+    for (int k = 0; k < n.i; ++k) {
+        if (a.elemKind == K::Float) a.floats[k] = readFloat().f;
+        else a.ints[k] = readInt().i;
+    }
+}
+
+inline void builtinPrint(Value x) {
+    ArrayObject &a = heap[x.i];
+    for (int k = 0; k < a.length; ++k)
+        print(a.elemKind == K::Float ? Value::makeFloat(a.floats[k]) : Value::makeInt(a.ints[k]));
+}
+
+)PRELUDE";
+
+    using KindMask = Verifier::KindMask;
+    constexpr KindMask intLike = Verifier::KInt | Verifier::KChar | Verifier::KBool;
+
+    bool isIntLike(KindMask m) { return m && !(m & ~intLike); }
+
+    std::string escape(const std::string &s) {
+        std::string out = "\"";
+        for (unsigned char c : s) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += static_cast<char>(c);
+            } else if (c < 0x20 || c >= 0x7f) {
+                char buf[8];
+                std::snprintf(buf, sizeof buf, "\\%03o", c);
+                out += buf;
+            } else {
+                out += static_cast<char>(c);
+            }
+        }
+        return out + "\"";
+    }
+
+    const char *kindName(Token::Type t) {
+        switch (t) {
+            case Token::Type::KwFloat: return "K::Float";
+            case Token::Type::KwChar:  return "K::Char";
+            case Token::Type::KwBool:  return "K::Bool";
+            default:                   return "K::Int";
+        }
+    }
+
+    class FunctionWriter {
+    public:
+        FunctionWriter(std::ostream &os, const Poliz &poliz, int fnIdx,
+                       const Verifier::FunctionAnalysis &a)
+            : os(os), poliz(poliz), fnIdx(fnIdx), fn(poliz.getFunction(fnIdx)),
+              states(a.states.begin(), a.states.end()), maxDepth(a.maxDepth) {
+        }
+
+        void write() {
+            const int codeSize = static_cast<int>(poliz.size());
+
+            std::vector<KindMask> slotKinds(fn.frameSize, 0);
+            std::set<int> targets;
+            for (const auto &[ip, st] : states) {
+                for (int s = 0; s < fn.frameSize; ++s)
+                    slotKinds[s] |= st.slots[s];
+                if (ip < codeSize && (poliz[ip].op == Op::JUMP || poliz[ip].op == Op::JUMP_IF_FALSE))
+                    targets.insert(*poliz[ip].arg1);
+            }
+            typedInt.assign(fn.frameSize, false);
+            for (int s = 0; s < fn.frameSize; ++s)
+                typedInt[s] = slotKinds[s] == Verifier::KInt;
+
+            os << "Value " << name(fnIdx, poliz) << "(" << params() << ") {\n";
+            os << "    const std::size_t heapBase = heap.size();\n";
+            for (int s = 0; s < fn.frameSize; ++s) {
+                os << "    " << (typedInt[s] ? "int32_t " : "Value ") << "l" << s;
+                if (s < fn.paramCount)
+                    os << " = a" << s << (typedInt[s] ? ".i" : "");
+                else if (typedInt[s])
+                    os << " = 0";
+                os << ";\n";
+            }
+            for (int d = 0; d < maxDepth; ++d)
+                os << "    Value s" << d << ";\n";
+            if (!states.empty() && states.begin()->first != fn.entryIp)
+                os << "    goto L" << fn.entryIp << ";\n";
+
+            for (const auto &[ip, st] : states) {
+                if (ip >= codeSize)
+                    continue;
+                if (targets.contains(ip))
+                    os << "L" << ip << ":\n";
+                instruction(ip, st);
+            }
+            // The analysis has a state past the code only if control can
+            // run off its end; every other path already returned.
+            if (states.contains(codeSize)) {
+                if (targets.contains(codeSize))
+                    os << "L" << codeSize << ":\n";
+                os << "    return leave(heapBase, Value());\n";
+            }
+            os << "}\n\n";
+        }
+
+        static std::string name(int idx, const Poliz &poliz) {
+            return "f" + std::to_string(idx) + "_" + poliz.getFunction(idx).name;
+        }
+
+        std::string params() const {
+            std::string p;
+            for (int k = 0; k < fn.paramCount; ++k)
+                p += (k ? ", Value a" : "Value a") + std::to_string(k);
+            return p;
+        }
+
+    private:
+        std::ostream &os;
+        const Poliz &poliz;
+        int fnIdx;
+        const Poliz::FunctionInfo &fn;
+        std::map<int, Verifier::State> states;
+        int maxDepth;
+        std::vector<bool> typedInt;
+
+        static std::string cell(int d) { return "s" + std::to_string(d); }
+
+        void line(const std::string &code) { os << "    " << code << "\n"; }
+
+        std::string slotArray(int slot) const { return "heap[l" + std::to_string(slot) + ".i]"; }
+
+        void arith(const Verifier::State &st, int d, const char *wrap, char op, const char *generic) {
+            const std::string a = cell(d - 2), b = cell(d - 1);
+            KindMask ka = st.stack[d - 2], kb = st.stack[d - 1];
+            if (isIntLike(ka) && isIntLike(kb))
+                line(a + " = Value::makeInt(" + wrap + "(" + a + ".i, " + b + ".i));");
+            else if (ka == Verifier::KFloat && kb == Verifier::KFloat)
+                line(a + " = Value::makeFloat(" + a + ".f " + op + " " + b + ".f);");
+            else
+                line(a + " = " + generic + "(" + a + ", " + b + ");");
+        }
+
+        void compare(const Verifier::State &st, int d, const char *op) {
+            const std::string a = cell(d - 2), b = cell(d - 1);
+            KindMask ka = st.stack[d - 2], kb = st.stack[d - 1];
+            std::string lhs, rhs;
+            if (isIntLike(ka) && isIntLike(kb)) {
+                lhs = "static_cast<float>(" + a + ".i)";
+                rhs = "static_cast<float>(" + b + ".i)";
+            } else if (ka == Verifier::KFloat && kb == Verifier::KFloat) {
+                lhs = a + ".f";
+                rhs = b + ".f";
+            } else {
+                lhs = "asFloat(" + a + ")";
+                rhs = "asFloat(" + b + ")";
+            }
+            line(a + " = Value::makeBool(" + lhs + " " + op + " " + rhs + ");");
+        }
+
+        void intOp(int d, const std::string &expr) {
+            line(cell(d - 2) + " = Value::makeInt(" + expr + ");");
+        }
+
+        // Inline copy of VM::flatIndex for a rank-n access whose indices
+        // start at cell `first`.
+        void flatIndex(int slot, int arrayType, int first, const char *what) {
+            const TypeInfo &t = poliz.getArrayType(arrayType);
+            line("ArrayObject &arr = " + slotArray(slot) + ";");
+            line("int flat = 0;");
+            line("bool bad = false;");
+            for (int k = 0; k < t.rank(); ++k) {
+                std::string dim = t.dims[k] >= 0 ? std::to_string(t.dims[k])
+                                                 : "arr.length / " + std::to_string(t.strides[k]);
+                std::string idx = cell(first + k) + ".i";
+                line("bad |= static_cast<unsigned>(" + idx + ") >= static_cast<unsigned>(" + dim + ");");
+                line("flat += " + idx + " * " + std::to_string(t.strides[k]) + ";");
+            }
+            line(std::string("if (bad || flat >= arr.length) outOfRange(\"") + what + "\");");
+        }
+
+        void instruction(int ip, const Verifier::State &st) {
+            const auto &ins = poliz[ip];
+            const int d = static_cast<int>(st.stack.size());
+            const std::string top = d > 0 ? cell(d - 1) : "";
+
+            switch (ins.op) {
+                case Op::PUSH_INT:
+                    line(cell(d) + " = Value::makeInt(" + std::to_string(*ins.arg1) + ");");
+                    break;
+                case Op::PUSH_FLOAT: {
+                    int bits = *ins.arg1;
+                    line("{ int32_t bits = " + std::to_string(bits) + "; float v; std::memcpy(&v, &bits, 4); " +
+                         cell(d) + " = Value::makeFloat(v); }");
+                    break;
+                }
+                case Op::PUSH_CHAR:
+                    line(cell(d) + " = Value::makeChar(static_cast<char>(" + std::to_string(*ins.arg1) + "));");
+                    break;
+                case Op::PUSH_BOOL:
+                    line(cell(d) + " = Value::makeBool(" + (*ins.arg1 ? "true" : "false") + ");");
+                    break;
+                case Op::PUSH_STRING:
+                    line(cell(d) + " = Value::makeString(" + std::to_string(*ins.arg1) + ");");
+                    break;
+
+                case Op::LOAD_VAR: {
+                    std::string l = "l" + std::to_string(*ins.arg1);
+                    line(cell(d) + " = " + (typedInt[*ins.arg1] ? "Value::makeInt(" + l + ")" : l) + ";");
+                    break;
+                }
+                case Op::STORE_VAR:
+                    line("l" + std::to_string(*ins.arg1) + " = " + top + (typedInt[*ins.arg1] ? ".i" : "") + ";");
+                    break;
+
+                case Op::ADD: arith(st, d, "wrapAdd", '+', "add"); break;
+                case Op::SUB: arith(st, d, "wrapSub", '-', "sub"); break;
+                case Op::MUL: arith(st, d, "wrapMul", '*', "mul"); break;
+
+                case Op::DIV:
+                    if (isIntLike(st.stack[d - 2]) && isIntLike(st.stack[d - 1])) {
+                        line("if (" + top + ".i == 0) fail(\"VM: division by zero\");");
+                        intOp(d, cell(d - 2) + ".i / " + top + ".i");
+                    } else {
+                        line(cell(d - 2) + " = div(" + cell(d - 2) + ", " + top + ");");
+                    }
+                    break;
+                case Op::MOD:
+                    line("if (" + top + ".i == 0) fail(\"VM: modulo by zero\");");
+                    intOp(d, cell(d - 2) + ".i % " + top + ".i");
+                    break;
+
+                case Op::AND: intOp(d, cell(d - 2) + ".i & " + top + ".i"); break;
+                case Op::OR:  intOp(d, cell(d - 2) + ".i | " + top + ".i"); break;
+                case Op::XOR: intOp(d, cell(d - 2) + ".i ^ " + top + ".i"); break;
+                case Op::SHL: intOp(d, "shl(" + cell(d - 2) + ".i, " + top + ".i)"); break;
+                case Op::SHR: intOp(d, "shr(" + cell(d - 2) + ".i, " + top + ".i)"); break;
+
+                case Op::NEG:
+                    if (st.stack[d - 1] == Verifier::KInt)
+                        line(top + " = Value::makeInt(wrapNeg(" + top + ".i));");
+                    else
+                        line(top + " = neg(" + top + ");");
+                    break;
+                case Op::NOT:
+                    line(top + " = Value::makeBool(!" + top + ".i);");
+                    break;
+                case Op::BNOT:
+                    line(top + " = Value::makeInt(~" + top + ".i);");
+                    break;
+
+                case Op::CMP_EQ: compare(st, d, "=="); break;
+                case Op::CMP_NE: compare(st, d, "!="); break;
+                case Op::CMP_LT: compare(st, d, "<"); break;
+                case Op::CMP_LE: compare(st, d, "<="); break;
+                case Op::CMP_GT: compare(st, d, ">"); break;
+                case Op::CMP_GE: compare(st, d, ">="); break;
+
+                case Op::LOG_AND:
+                    line(cell(d - 2) + " = Value::makeBool(" + cell(d - 2) + ".i && " + top + ".i);");
+                    break;
+                case Op::LOG_OR:
+                    line(cell(d - 2) + " = Value::makeBool(" + cell(d - 2) + ".i || " + top + ".i);");
+                    break;
+
+                case Op::JUMP:
+                    line("goto L" + std::to_string(*ins.arg1) + ";");
+                    break;
+                case Op::JUMP_IF_FALSE:
+                    line("if (" + top + ".i == 0) goto L" + std::to_string(*ins.arg1) + ";");
+                    break;
+
+                case Op::CALL: {
+                    const auto &callee = poliz.getFunction(*ins.arg1);
+                    const int first = d - callee.paramCount;
+                    std::string args;
+                    for (int k = 0; k < callee.paramCount; ++k)
+                        args += (k ? ", " : "") + cell(first + k);
+                    std::string call = FunctionWriter::name(*ins.arg1, poliz) + "(" + args + ")";
+                    line(callee.returnType.isVoid() ? call + ";" : cell(first) + " = " + call + ";");
+                    break;
+                }
+                case Op::RET_VALUE:
+                    line("return leave(heapBase, " + top + ");");
+                    break;
+                case Op::RET_VOID:
+                    line("return leave(heapBase, Value());");
+                    break;
+
+                case Op::PRINT:
+                    line("print(" + top + ");");
+                    break;
+                case Op::READ_INT:    line(cell(d) + " = readInt();"); break;
+                case Op::READ_FLOAT:  line(cell(d) + " = readFloat();"); break;
+                case Op::READ_BOOL:   line(cell(d) + " = readBool();"); break;
+                case Op::READ_CHAR:   line(cell(d) + " = readChar();"); break;
+                case Op::READ_STRING: line(cell(d) + " = readString();"); break;
+
+                case Op::NEW_ARRAY:
+                    line("newArray(l" + std::to_string(*ins.arg1) + ", " + std::to_string(*ins.arg2) +
+                         ", arrayTypes[" + std::to_string(*ins.arg2) + "], heapBase);");
+                    break;
+                case Op::LOAD_ELEM:
+                    line("{");
+                    line("ArrayObject &arr = " + slotArray(*ins.arg1) + ";");
+                    line("if (" + top + ".i < 0 || " + top + ".i >= arr.length) outOfRange(\"LOAD_ELEM\");");
+                    line(top + " = arr.load(" + top + ".i);");
+                    line("}");
+                    break;
+                case Op::STORE_ELEM:
+                    line("{");
+                    line("ArrayObject &arr = " + slotArray(*ins.arg1) + ";");
+                    line("if (" + cell(d - 2) + ".i < 0 || " + cell(d - 2) + ".i >= arr.length) outOfRange(\"STORE_ELEM\");");
+                    line("arr.store(" + cell(d - 2) + ".i, " + top + ");");
+                    line("}");
+                    break;
+                case Op::LOAD_ELEM_N: {
+                    const int first = d - poliz.getArrayType(*ins.arg2).rank();
+                    line("{");
+                    flatIndex(*ins.arg1, *ins.arg2, first, "LOAD_ELEM_N");
+                    line(cell(first) + " = arr.load(flat);");
+                    line("}");
+                    break;
+                }
+                case Op::STORE_ELEM_N: {
+                    const int first = d - 1 - poliz.getArrayType(*ins.arg2).rank();
+                    line("{");
+                    flatIndex(*ins.arg1, *ins.arg2, first, "STORE_ELEM_N");
+                    line("arr.store(flat, " + top + ");");
+                    line("}");
+                    break;
+                }
+
+                case Op::CALL_BUILTIN: {
+                    const BuiltinInfo &b = builtinTable[*ins.arg1];
+                    const int first = d - b.paramCount;
+                    const std::string x = cell(first), y = b.paramCount == 2 ? cell(first + 1) : "";
+                    switch (b.id) {
+                        case Builtin::Sum:   line(x + " = builtinSum(" + x + ");"); break;
+                        case Builtin::Dot:   line(x + " = builtinDot(" + x + ", " + y + ");"); break;
+                        case Builtin::MinOf: line(x + " = builtinExtreme(" + x + ", false);"); break;
+                        case Builtin::MaxOf: line(x + " = builtinExtreme(" + x + ", true);"); break;
+                        case Builtin::Fill:  line("builtinFill(" + x + ", " + y + ");"); break;
+                        case Builtin::Scale: line("builtinScale(" + x + ", " + y + ");"); break;
+                        case Builtin::Copy:  line("builtinCopy(" + x + ", " + y + ");"); break;
+                        case Builtin::Read:  line("builtinRead(" + x + ", " + y + ");"); break;
+                        case Builtin::Print: line("builtinPrint(" + x + ");"); break;
+                    }
+                    break;
+                }
+
+                case Op::VEC_LOOP:
+                    // The scalar loop that follows is left to the C++ compiler.
+                    break;
+
+                case Op::NOP:
+                    break;
+                case Op::HALT:
+                    line("std::cout.flush();");
+                    line("std::exit(0);");
+                    break;
+            }
+        }
+    };
+}
+
+
+Transpiler::Transpiler(const Poliz &poliz) : poliz(poliz) {
+}
+
+bool Transpiler::emit(std::ostream &os) {
+    if (!poliz.isVerified()) {
+        lastError = "program must pass verification before it can be transpiled";
+        return false;
+    }
+
+    std::vector<Verifier::FunctionAnalysis> analyses;
+    for (std::size_t f = 0; f < poliz.functionCount(); ++f) {
+        if (poliz.getFunction(static_cast<int>(f)).entryIp < 0) {
+            analyses.emplace_back();
+            continue;
+        }
+        analyses.push_back(Verifier::analyze(poliz, static_cast<int>(f)));
+        if (!analyses.back().ok) {
+            lastError = analyses.back().error;
+            return false;
+        }
+    }
+
+    os << prelude;
+
+    os << "const ArrayType arrayTypes[] = {\n";
+    for (std::size_t t = 0; t < poliz.arrayTypeCount(); ++t) {
+        const TypeInfo &type = poliz.getArrayType(static_cast<int>(t));
+        os << "    {" << kindName(type.baseType) << ", " << type.arraySize << "},\n";
+    }
+    if (poliz.arrayTypeCount() == 0)
+        os << "    {K::Int, 0},\n";
+    os << "};\n\n";
+
+    for (std::size_t f = 0; f < poliz.functionCount(); ++f) {
+        if (poliz.getFunction(static_cast<int>(f)).entryIp < 0)
+            continue;
+        FunctionWriter w(os, poliz, static_cast<int>(f), analyses[f]);
+        os << "Value " << FunctionWriter::name(static_cast<int>(f), poliz) << "(" << w.params() << ");\n";
+    }
+    os << "\n";
+
+    for (std::size_t f = 0; f < poliz.functionCount(); ++f) {
+        if (poliz.getFunction(static_cast<int>(f)).entryIp < 0)
+            continue;
+        FunctionWriter(os, poliz, static_cast<int>(f), analyses[f]).write();
+    }
+
+    os << "}\n\n";
+    os << "int main() {\n";
+    os << "    strings = {\n";
+    for (std::size_t k = 0; k < poliz.stringCount(); ++k)
+        os << "        " << escape(poliz.getString(static_cast<int>(k))) << ",\n";
+    os << "    };\n";
+    // As in VM::run, output written before a runtime error is flushed and
+    // the error ends the program through std::terminate.
+    os << "    try {\n";
+    os << "        " << FunctionWriter::name(poliz.getFunctionIndex("main"), poliz) << "();\n";
+    os << "    } catch (...) {\n";
+    os << "        std::cout.flush();\n";
+    os << "        throw;\n";
+    os << "    }\n";
+    os << "    return 0;\n";
+    os << "}\n";
+    return true;
+}
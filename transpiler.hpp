@@ -0,0 +1,28 @@
+#pragma once
+#include "poliz.hpp"
+#include <ostream>
+#include <string>
+
+
+// Ahead-of-time backend: turns a verified Poliz program into one standalone
+// C++ translation unit with the same I/O and runtime errors as VM. Every
+// function becomes a C++ function; locals that only ever hold ints are
+// plain int32_t, everything else stays a tagged Value. Operand-stack cells
+// are numbered locals (the verifier gives a static depth at every ip), and
+// arithmetic whose operand kinds are known is emitted without a kind test.
+//
+// Vectorized loops run their scalar form and builtins use scalar loops, so
+// float sums may round differently from the VM; recursion depth is bounded
+// by the native stack rather than the VM's heap-allocated one.
+class Transpiler {
+public:
+    explicit Transpiler(const Poliz &poliz);
+
+    bool emit(std::ostream &os);
+
+    const std::string &error() const { return lastError; }
+
+private:
+    const Poliz &poliz;
+    std::string lastError;
+};
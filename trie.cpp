@@ -8,7 +8,22 @@ Trie::~Trie() {
     clear(root);
 }
 
+Trie::Trie(Trie&& other) noexcept : root(other.root) {
+    other.root = nullptr;
+}
+
+Trie& Trie::operator=(Trie&& other) noexcept {
+    if (this != &other) {
+        clear(root);
+        root = other.root;
+        other.root = nullptr;
+    }
+    return *this;
+}
+
 void Trie::clear(TrieNode* node) {
+    if (!node)
+        return;
     for (auto& p : node->children)
         clear(p.second);
     delete node;
@@ -14,6 +14,11 @@ private:
 public:
     Trie();
     ~Trie();
+
+    Trie(const Trie&) = delete;
+    Trie& operator=(const Trie&) = delete;
+    Trie(Trie&& other) noexcept;
+    Trie& operator=(Trie&& other) noexcept;
     void insert(const std::string& word);
     bool search(const std::string& word) const;
     void clear(TrieNode* node);
@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <optional>
+#include <vector>
 #include "tokens.hpp"
 
 struct TypeInfo {
@@ -8,19 +9,33 @@ struct TypeInfo {
     bool isArray = false;
     int arraySize = -1;
     std::optional<Token::Type> elementType;
+    std::vector<int> dims;
+    std::vector<int> strides;
 
     TypeInfo() : baseType(Token::Type::KwVoid) {}
     TypeInfo(Token::Type t) : baseType(t) {}
 
     static TypeInfo makeArray(const TypeInfo& elem, int size = -1) {
+        return makeArray(elem, std::vector<int>{size});
+    }
+
+    static TypeInfo makeArray(const TypeInfo& elem, const std::vector<int>& dims) {
         TypeInfo t;
         t.isArray = true;
-        t.arraySize = size;
         t.elementType = elem.baseType;
         t.baseType = elem.baseType;
+        t.dims = dims;
+        t.strides.assign(dims.size(), 1);
+        for (int k = static_cast<int>(dims.size()) - 2; k >= 0; --k)
+            t.strides[k] = t.strides[k + 1] * dims[k + 1];
+        t.arraySize = dims.empty() || dims[0] < 0 ? -1 : t.strides[0] * dims[0];
         return t;
     }
 
+    int rank() const {
+        return static_cast<int>(dims.size());
+    }
+
     bool isVoid() const {
         return baseType == Token::Type::KwVoid && !isArray;
     }
@@ -50,7 +65,7 @@ struct TypeInfo {
             return false;
         if (isArray)
             return baseType == o.baseType &&
-                   arraySize == o.arraySize;
+                   dims == o.dims;
         return baseType == o.baseType;
     }
 
@@ -70,10 +85,12 @@ struct TypeInfo {
         }
 
         if (isArray) {
-            s += "[";
-            if (arraySize >= 0)
-                s += std::to_string(arraySize);
-            s += "]";
+            for (int d : dims) {
+                s += "[";
+                if (d >= 0)
+                    s += std::to_string(d);
+                s += "]";
+            }
         }
 
         return s;
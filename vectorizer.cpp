@@ -0,0 +1,220 @@
+#include "vectorizer.hpp"
+
+
+namespace {
+    using Op = Poliz::Op;
+    using VectorLoop = Poliz::VectorLoop;
+    using VectorOperand = Poliz::VectorOperand;
+
+    bool isScalarInt(const TypeInfo *t) {
+        return t && !t->isArray &&
+               (t->baseType == Token::Type::KwInt || t->baseType == Token::Type::KwChar);
+    }
+
+    bool isScalarFloat(const TypeInfo *t) {
+        return t && !t->isArray && t->baseType == Token::Type::KwFloat;
+    }
+
+    class BodyMatcher {
+    public:
+        BodyMatcher(const Poliz &poliz, const Semanter &sem, int index, int begin, int end)
+            : poliz(poliz), sem(sem), index(index), ip(begin), end(end) {
+        }
+
+        bool matchMap(VectorLoop &v) {
+            if (!loadsVar(ip, index))
+                return false;
+            ++ip;
+
+            if (!operand(v.lhs))
+                return false;
+            v.op = Op::NOP;
+            if (ip < end - 1 && operand(v.rhs)) {
+                Op op = poliz[ip].op;
+                if (op != Op::ADD && op != Op::SUB && op != Op::MUL)
+                    return false;
+                v.op = op;
+                ++ip;
+                if (v.lhs.kind != VectorOperand::Kind::Array &&
+                    v.rhs.kind != VectorOperand::Kind::Array)
+                    return false;
+            }
+
+            if (ip != end - 1 || poliz[ip].op != Op::STORE_ELEM || !poliz[ip].arg2)
+                return false;
+            if (!elementType(*poliz[ip].arg2))
+                return false;
+            v.kind = VectorLoop::Kind::Map;
+            v.target = *poliz[ip].arg1;
+            return typesAgree(v);
+        }
+
+        bool matchReduce(VectorLoop &v) {
+            if (end - ip != 5 && end - ip != 8)
+                return false;
+            if (poliz[ip].op != Op::LOAD_VAR)
+                return false;
+            int acc = *poliz[ip].arg1;
+            ++ip;
+
+            if (!operand(v.lhs) || v.lhs.kind != VectorOperand::Kind::Array)
+                return false;
+            v.kind = VectorLoop::Kind::Sum;
+            if (end - ip == 5) {
+                if (!operand(v.rhs) || v.rhs.kind != VectorOperand::Kind::Array ||
+                    poliz[ip].op != Op::MUL)
+                    return false;
+                ++ip;
+                v.kind = VectorLoop::Kind::Dot;
+            }
+
+            if (poliz[ip].op != Op::ADD ||
+                poliz[ip + 1].op != Op::STORE_VAR || *poliz[ip + 1].arg1 != acc)
+                return false;
+
+            const TypeInfo *accType = sem.slotType(acc);
+            if (acc == index ||
+                (v.bound.kind == VectorOperand::Kind::Var && v.bound.value == acc))
+                return false;
+            if (isFloat ? !isScalarFloat(accType)
+                        : !(accType && !accType->isArray && accType->baseType == Token::Type::KwInt))
+                return false;
+
+            v.target = acc;
+            return true;
+        }
+
+        bool isFloat = false;
+
+    private:
+        const Poliz &poliz;
+        const Semanter &sem;
+        int index;
+        int ip;
+        int end;
+        bool typed = false;
+
+        bool loadsVar(int at, int slot) const {
+            return at < end && poliz[at].op == Op::LOAD_VAR && *poliz[at].arg1 == slot;
+        }
+
+        // Records the element type of every array touched; all of them must
+        // be one-dimensional and share int or float elements.
+        bool elementType(int arrayType) {
+            const TypeInfo &t = poliz.getArrayType(arrayType);
+            if (t.rank() != 1)
+                return false;
+            bool f = t.baseType == Token::Type::KwFloat;
+            if (!f && t.baseType != Token::Type::KwInt)
+                return false;
+            if (typed && f != isFloat)
+                return false;
+            typed = true;
+            isFloat = f;
+            return true;
+        }
+
+        bool operand(VectorOperand &out) {
+            if (ip >= end)
+                return false;
+            const auto &ins = poliz[ip];
+
+            if (loadsVar(ip, index) && ip + 1 < end &&
+                poliz[ip + 1].op == Op::LOAD_ELEM && poliz[ip + 1].arg2) {
+                if (!elementType(*poliz[ip + 1].arg2))
+                    return false;
+                out = {VectorOperand::Kind::Array, *poliz[ip + 1].arg1};
+                ip += 2;
+                return true;
+            }
+
+            switch (ins.op) {
+                case Op::PUSH_INT:
+                    out = {VectorOperand::Kind::Int, *ins.arg1};
+                    break;
+                case Op::PUSH_FLOAT:
+                    out = {VectorOperand::Kind::Float, *ins.arg1};
+                    break;
+                case Op::LOAD_VAR: {
+                    const TypeInfo *t = sem.slotType(*ins.arg1);
+                    if (*ins.arg1 == index || !(isScalarInt(t) || isScalarFloat(t)))
+                        return false;
+                    out = {VectorOperand::Kind::Var, *ins.arg1};
+                    break;
+                }
+                default:
+                    return false;
+            }
+            ++ip;
+            return true;
+        }
+
+        // Scalar operands of an int loop must be int-typed, so every
+        // element op stays in wrapping 32-bit arithmetic; float loops
+        // accept ints as well, converted the way the VM promotes them.
+        bool typesAgree(const VectorLoop &v) const {
+            for (const VectorOperand *o : {&v.lhs, &v.rhs}) {
+                if (isFloat)
+                    continue;
+                if (o->kind == VectorOperand::Kind::Float)
+                    return false;
+                if (o->kind == VectorOperand::Kind::Var && !isScalarInt(sem.slotType(o->value)))
+                    return false;
+            }
+            return true;
+        }
+    };
+}
+
+
+bool Vectorizer::lowerFor(Poliz &poliz, const ForLoop &loop, const Semanter &sem) {
+    const int c = loop.condPos;
+    if (loop.iterPos != c + 5 || loop.bodyPos != loop.iterPos + 5 || loop.endPos <= loop.bodyPos)
+        return false;
+
+    // LOAD_VAR i; <bound>; CMP_LT; JUMP_IF_FALSE end; JUMP body
+    if (poliz[c].op != Op::LOAD_VAR)
+        return false;
+    const int index = *poliz[c].arg1;
+    if (!isScalarInt(sem.slotType(index)))
+        return false;
+
+    VectorLoop v;
+    v.indexSlot = index;
+    const auto &b = poliz[c + 1];
+    if (b.op == Op::PUSH_INT)
+        v.bound = {VectorOperand::Kind::Int, *b.arg1};
+    else if (b.op == Op::LOAD_VAR && *b.arg1 != index && isScalarInt(sem.slotType(*b.arg1)))
+        v.bound = {VectorOperand::Kind::Var, *b.arg1};
+    else
+        return false;
+    if (poliz[c + 2].op != Op::CMP_LT)
+        return false;
+
+    // LOAD_VAR i; PUSH_INT 1; ADD; STORE_VAR i; JUMP cond
+    const int it = loop.iterPos;
+    if (poliz[it].op != Op::LOAD_VAR || *poliz[it].arg1 != index ||
+        poliz[it + 1].op != Op::PUSH_INT || *poliz[it + 1].arg1 != 1 ||
+        poliz[it + 2].op != Op::ADD ||
+        poliz[it + 3].op != Op::STORE_VAR || *poliz[it + 3].arg1 != index)
+        return false;
+
+    const int bodyEnd = loop.endPos - 1;
+    if (poliz[bodyEnd].op != Op::JUMP || *poliz[bodyEnd].arg1 != it)
+        return false;
+
+    BodyMatcher map(poliz, sem, index, loop.bodyPos, bodyEnd);
+    BodyMatcher reduce(poliz, sem, index, loop.bodyPos, bodyEnd);
+    if (map.matchMap(v)) {
+        v.isFloat = map.isFloat;
+    } else {
+        v = VectorLoop{VectorLoop::Kind::Map, false, index, v.bound};
+        if (!reduce.matchReduce(v))
+            return false;
+        v.isFloat = reduce.isFloat;
+    }
+
+    int desc = poliz.addVectorLoop(v);
+    poliz.insert(c, Poliz::Instr(Op::VEC_LOOP, desc, loop.endPos + 1));
+    return true;
+}
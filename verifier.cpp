@@ -0,0 +1,442 @@
+#include "verifier.hpp"
+#include "builtins.hpp"
+#include <algorithm>
+
+
+Verifier::Verifier(Poliz &p) : poliz(p) {
+}
+
+Verifier::KindMask Verifier::kindsOf(const TypeInfo &t) {
+    if (t.isArray)
+        return KArray;
+    switch (t.baseType) {
+        case Token::Type::KwInt:    return KInt;
+        case Token::Type::KwFloat:  return KFloat;
+        case Token::Type::KwBool:   return KBool;
+        case Token::Type::KwChar:   return KChar;
+        case Token::Type::KwString: return KString;
+        default:                    return 0;
+    }
+}
+
+static Verifier::KindMask elementKind(const TypeInfo &arr) {
+    switch (arr.baseType) {
+        case Token::Type::KwFloat: return Verifier::KFloat;
+        case Token::Type::KwBool:  return Verifier::KBool;
+        case Token::Type::KwChar:  return Verifier::KChar;
+        default:                   return Verifier::KInt;
+    }
+}
+
+static Verifier::KindMask numericResult(Verifier::KindMask a, Verifier::KindMask b) {
+    Verifier::KindMask r = 0;
+    if ((a & ~Verifier::KFloat) && (b & ~Verifier::KFloat))
+        r |= Verifier::KInt;
+    if ((a & Verifier::KFloat) || (b & Verifier::KFloat))
+        r |= Verifier::KFloat;
+    return r;
+}
+
+Verifier::FunctionAnalysis Verifier::analyze(const Poliz &poliz, int functionIndex) {
+    using Op = Poliz::Op;
+
+    FunctionAnalysis res;
+    const auto &fn = poliz.getFunction(functionIndex);
+    const int codeSize = static_cast<int>(poliz.size());
+
+    if (fn.entryIp < 0 || fn.entryIp >= codeSize) {
+        res.error = "function has no body";
+        return res;
+    }
+    if (fn.frameSize < fn.paramCount) {
+        res.error = "frame smaller than parameter list";
+        return res;
+    }
+
+    State entry;
+    entry.slots.assign(fn.frameSize, KInt);
+    for (int i = 0; i < fn.paramCount; ++i)
+        entry.slots[i] = kindsOf(fn.paramTypes[i]);
+
+    res.states[fn.entryIp] = entry;
+    std::vector<int> work{fn.entryIp};
+
+    auto fail = [&](int ip, const std::string &msg) {
+        res.error = "ip " + std::to_string(ip) + " (" +
+                    Poliz::opName(poliz[ip].op) + "): " + msg;
+        res.ok = false;
+        return res;
+    };
+
+    // Joins st into the state recorded at target; false on a depth mismatch.
+    auto propagate = [&](int target, const State &st) {
+        auto it = res.states.find(target);
+        if (it == res.states.end()) {
+            res.states.emplace(target, st);
+            work.push_back(target);
+            return true;
+        }
+
+        State &old = it->second;
+        if (old.stack.size() != st.stack.size())
+            return false;
+
+        State merged = old;
+        for (std::size_t i = 0; i < merged.stack.size(); ++i)
+            merged.stack[i] |= st.stack[i];
+        for (std::size_t i = 0; i < merged.slots.size(); ++i)
+            merged.slots[i] |= st.slots[i];
+
+        if (!(merged == old)) {
+            old = std::move(merged);
+            work.push_back(target);
+        }
+        return true;
+    };
+
+    while (!work.empty()) {
+        int ip = work.back();
+        work.pop_back();
+
+        if (ip == codeSize)
+            continue;
+
+        State st = res.states[ip];
+        const auto &ins = poliz[ip];
+        auto &stk = st.stack;
+
+        auto need = [&](std::size_t n) { return stk.size() >= n; };
+        auto pop = [&]() {
+            KindMask k = stk.back();
+            stk.pop_back();
+            return k;
+        };
+        auto slotInRange = [&](int slot) {
+            return slot >= 0 && slot < fn.frameSize;
+        };
+        auto arrayTypeInRange = [&](const std::optional<int> &idx) {
+            return idx && *idx >= 0 && *idx < static_cast<int>(poliz.arrayTypeCount());
+        };
+        auto jumpInRange = [&](int target) {
+            return target >= 0 && target <= codeSize;
+        };
+
+        bool needsArg1 = true;
+        switch (ins.op) {
+            case Op::ADD: case Op::SUB: case Op::MUL: case Op::DIV: case Op::MOD:
+            case Op::NEG: case Op::NOT: case Op::BNOT:
+            case Op::CMP_EQ: case Op::CMP_NE: case Op::CMP_LT:
+            case Op::CMP_LE: case Op::CMP_GT: case Op::CMP_GE:
+            case Op::LOG_AND: case Op::LOG_OR:
+            case Op::AND: case Op::OR: case Op::XOR: case Op::SHL: case Op::SHR:
+            case Op::RET_VOID: case Op::RET_VALUE: case Op::PRINT:
+            case Op::READ_INT: case Op::READ_FLOAT: case Op::READ_BOOL:
+            case Op::READ_CHAR: case Op::READ_STRING:
+            case Op::NOP: case Op::HALT:
+                needsArg1 = false;
+                break;
+            default:
+                break;
+        }
+        if (needsArg1 && !ins.arg1)
+            return fail(ip, "missing operand");
+
+        std::vector<int> succ;
+        bool fallsThrough = true;
+
+        switch (ins.op) {
+            case Op::PUSH_INT:   stk.push_back(KInt); break;
+            case Op::PUSH_FLOAT: stk.push_back(KFloat); break;
+            case Op::PUSH_CHAR:  stk.push_back(KChar); break;
+            case Op::PUSH_BOOL:  stk.push_back(KBool); break;
+
+            case Op::PUSH_STRING:
+                if (*ins.arg1 < 0 || *ins.arg1 >= static_cast<int>(poliz.stringCount()))
+                    return fail(ip, "string index out of range");
+                stk.push_back(KString);
+                break;
+
+            case Op::LOAD_VAR:
+                if (!slotInRange(*ins.arg1))
+                    return fail(ip, "slot out of range");
+                stk.push_back(st.slots[*ins.arg1]);
+                break;
+
+            case Op::STORE_VAR:
+                if (!slotInRange(*ins.arg1))
+                    return fail(ip, "slot out of range");
+                if (!need(1))
+                    return fail(ip, "stack underflow");
+                st.slots[*ins.arg1] = pop();
+                break;
+
+            case Op::NEW_ARRAY:
+                if (!slotInRange(*ins.arg1))
+                    return fail(ip, "slot out of range");
+                if (!arrayTypeInRange(ins.arg2))
+                    return fail(ip, "invalid array type");
+                st.slots[*ins.arg1] = KArray;
+                break;
+
+            case Op::LOAD_ELEM: {
+                if (!slotInRange(*ins.arg1) || !arrayTypeInRange(ins.arg2))
+                    return fail(ip, "invalid array operand");
+                if (st.slots[*ins.arg1] != KArray)
+                    return fail(ip, "slot is not provably an array");
+                if (!need(1))
+                    return fail(ip, "stack underflow");
+                if (pop() & ~(KInt | KChar | KBool))
+                    return fail(ip, "index is not provably integral");
+                stk.push_back(elementKind(poliz.getArrayType(*ins.arg2)));
+                break;
+            }
+
+            case Op::STORE_ELEM: {
+                if (!slotInRange(*ins.arg1) || !arrayTypeInRange(ins.arg2))
+                    return fail(ip, "invalid array operand");
+                if (st.slots[*ins.arg1] != KArray)
+                    return fail(ip, "slot is not provably an array");
+                if (!need(2))
+                    return fail(ip, "stack underflow");
+                if (pop() & KArray)
+                    return fail(ip, "array stored as element");
+                if (pop() & ~(KInt | KChar | KBool))
+                    return fail(ip, "index is not provably integral");
+                break;
+            }
+
+            case Op::LOAD_ELEM_N:
+            case Op::STORE_ELEM_N: {
+                if (!slotInRange(*ins.arg1) || !arrayTypeInRange(ins.arg2))
+                    return fail(ip, "invalid array operand");
+                if (st.slots[*ins.arg1] != KArray)
+                    return fail(ip, "slot is not provably an array");
+                const TypeInfo &type = poliz.getArrayType(*ins.arg2);
+                bool store = ins.op == Op::STORE_ELEM_N;
+                if (!need(type.rank() + (store ? 1 : 0)))
+                    return fail(ip, "stack underflow");
+                if (store && (pop() & KArray))
+                    return fail(ip, "array stored as element");
+                for (int k = 0; k < type.rank(); ++k)
+                    if (pop() & ~(KInt | KChar | KBool))
+                        return fail(ip, "index is not provably integral");
+                if (!store)
+                    stk.push_back(elementKind(type));
+                break;
+            }
+
+            case Op::ADD: case Op::SUB: case Op::MUL: case Op::DIV: {
+                if (!need(2))
+                    return fail(ip, "stack underflow");
+                KindMask b = pop();
+                KindMask a = pop();
+                stk.push_back(numericResult(a, b));
+                break;
+            }
+
+            case Op::MOD:
+            case Op::AND: case Op::OR: case Op::XOR:
+            case Op::SHL: case Op::SHR: {
+                if (!need(2))
+                    return fail(ip, "stack underflow");
+                KindMask b = pop();
+                KindMask a = pop();
+                if (a != KInt || b != KInt)
+                    return fail(ip, "operands are not provably int");
+                stk.push_back(KInt);
+                break;
+            }
+
+            case Op::NEG: {
+                if (!need(1))
+                    return fail(ip, "stack underflow");
+                KindMask a = pop();
+                if (a & ~(KInt | KFloat))
+                    return fail(ip, "operand is not provably numeric");
+                stk.push_back(a);
+                break;
+            }
+
+            case Op::NOT:
+                if (!need(1))
+                    return fail(ip, "stack underflow");
+                if (pop() != KBool)
+                    return fail(ip, "operand is not provably bool");
+                stk.push_back(KBool);
+                break;
+
+            case Op::BNOT:
+                if (!need(1))
+                    return fail(ip, "stack underflow");
+                if (pop() != KInt)
+                    return fail(ip, "operand is not provably int");
+                stk.push_back(KInt);
+                break;
+
+            case Op::CMP_EQ: case Op::CMP_NE: case Op::CMP_LT:
+            case Op::CMP_LE: case Op::CMP_GT: case Op::CMP_GE:
+            case Op::LOG_AND: case Op::LOG_OR:
+                if (!need(2))
+                    return fail(ip, "stack underflow");
+                pop();
+                pop();
+                stk.push_back(KBool);
+                break;
+
+            case Op::JUMP:
+                if (!jumpInRange(*ins.arg1))
+                    return fail(ip, "jump target out of range");
+                succ.push_back(*ins.arg1);
+                fallsThrough = false;
+                break;
+
+            case Op::JUMP_IF_FALSE:
+                if (!jumpInRange(*ins.arg1))
+                    return fail(ip, "jump target out of range");
+                if (!need(1))
+                    return fail(ip, "stack underflow");
+                pop();
+                succ.push_back(*ins.arg1);
+                break;
+
+            case Op::CALL: {
+                int idx = *ins.arg1;
+                if (idx < 0 || idx >= static_cast<int>(poliz.functionCount()))
+                    return fail(ip, "invalid function index");
+                const auto &callee = poliz.getFunction(idx);
+                if (callee.entryIp < 0)
+                    return fail(ip, "call to function without body: " + callee.name);
+                if (callee.frameSize < callee.paramCount)
+                    return fail(ip, "callee frame smaller than parameter list");
+                if (!need(callee.paramCount))
+                    return fail(ip, "not enough arguments on stack");
+                for (int i = callee.paramCount - 1; i >= 0; --i)
+                    if (pop() & ~kindsOf(callee.paramTypes[i]))
+                        return fail(ip, "argument kind mismatch for " + callee.name);
+                if (!callee.returnType.isVoid())
+                    stk.push_back(kindsOf(callee.returnType));
+                break;
+            }
+
+            case Op::VEC_LOOP: {
+                if (*ins.arg1 < 0 || *ins.arg1 >= static_cast<int>(poliz.vectorLoopCount()))
+                    return fail(ip, "invalid vector loop");
+                if (!ins.arg2 || !jumpInRange(*ins.arg2))
+                    return fail(ip, "jump target out of range");
+                const auto &v = poliz.getVectorLoop(*ins.arg1);
+                if (!slotInRange(v.indexSlot) || !slotInRange(v.target))
+                    return fail(ip, "slot out of range");
+                // Either falls through untouched or leaves an int index and,
+                // for reductions, a numeric accumulator at the loop exit.
+                State taken = st;
+                taken.slots[v.indexSlot] |= KInt;
+                if (v.kind != Poliz::VectorLoop::Kind::Map)
+                    taken.slots[v.target] |= v.isFloat ? KFloat : KInt;
+                if (!propagate(*ins.arg2, taken))
+                    return fail(ip, "stack depth mismatch at ip " + std::to_string(*ins.arg2));
+                break;
+            }
+
+            case Op::CALL_BUILTIN: {
+                if (*ins.arg1 < 0 || *ins.arg1 >= static_cast<int>(builtinTable.size()))
+                    return fail(ip, "invalid builtin");
+                if (!arrayTypeInRange(ins.arg2))
+                    return fail(ip, "invalid array operand");
+                const BuiltinInfo &b = builtinTable[*ins.arg1];
+                KindMask elem = elementKind(poliz.getArrayType(*ins.arg2));
+                if (elem != KInt && elem != KFloat)
+                    return fail(ip, "unsupported builtin element type");
+                if (!need(b.paramCount))
+                    return fail(ip, "not enough arguments on stack");
+                if (b.paramCount == 2) {
+                    KindMask second = pop();
+                    KindMask expected = b.secondIsArray ? KindMask(KArray)
+                                      : b.secondIsCount ? KindMask(KInt | KChar | KBool)
+                                      : elem == KInt ? KindMask(KInt | KChar) : KindMask(KFloat);
+                    if (second & ~expected)
+                        return fail(ip, "argument kind mismatch for " + std::string(b.name));
+                }
+                if (pop() != KArray)
+                    return fail(ip, "argument is not provably an array");
+                if (b.returnsValue)
+                    stk.push_back(elem);
+                break;
+            }
+
+            case Op::RET_VALUE:
+                if (fn.returnType.isVoid())
+                    return fail(ip, "value returned from void function");
+                if (!need(1))
+                    return fail(ip, "stack underflow");
+                if (pop() & ~kindsOf(fn.returnType))
+                    return fail(ip, "return kind mismatch");
+                fallsThrough = false;
+                break;
+
+            case Op::RET_VOID:
+                if (!fn.returnType.isVoid())
+                    return fail(ip, "function may end without returning a value");
+                fallsThrough = false;
+                break;
+
+            case Op::HALT:
+                fallsThrough = false;
+                break;
+
+            case Op::PRINT:
+                if (!need(1))
+                    return fail(ip, "stack underflow");
+                pop();
+                break;
+
+            case Op::READ_INT:    stk.push_back(KInt); break;
+            case Op::READ_FLOAT:  stk.push_back(KFloat); break;
+            case Op::READ_BOOL:   stk.push_back(KBool); break;
+            case Op::READ_CHAR:   stk.push_back(KChar); break;
+            case Op::READ_STRING: stk.push_back(KString); break;
+
+            case Op::NOP:
+                break;
+
+            default:
+                return fail(ip, "unknown opcode");
+        }
+
+        res.maxDepth = std::max(res.maxDepth, static_cast<int>(stk.size()));
+
+        if (fallsThrough)
+            succ.push_back(ip + 1);
+
+        for (int target : succ)
+            if (!propagate(target, st))
+                return fail(ip, "stack depth mismatch at ip " + std::to_string(target));
+    }
+
+    res.ok = true;
+    return res;
+}
+
+bool Verifier::run() {
+    poliz.setVerified(false);
+
+    std::vector<int> maxDepths(poliz.functionCount(), -1);
+
+    for (int i = 0; i < static_cast<int>(poliz.functionCount()); ++i) {
+        const auto &fn = poliz.getFunction(i);
+        if (fn.entryIp < 0)
+            continue;
+
+        FunctionAnalysis a = analyze(poliz, i);
+        if (!a.ok) {
+            lastError = fn.name + ": " + a.error;
+            return false;
+        }
+        maxDepths[i] = a.maxDepth;
+    }
+
+    for (int i = 0; i < static_cast<int>(maxDepths.size()); ++i)
+        poliz.setFunctionMaxStack(i, maxDepths[i]);
+
+    poliz.setVerified(true);
+    return true;
+}
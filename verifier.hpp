@@ -0,0 +1,51 @@
+#pragma once
+#include "poliz.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+class Verifier {
+public:
+    enum Kind : uint8_t {
+        KInt    = 1 << 0,
+        KFloat  = 1 << 1,
+        KBool   = 1 << 2,
+        KChar   = 1 << 3,
+        KString = 1 << 4,
+        KArray  = 1 << 5,
+    };
+
+    using KindMask = uint8_t;
+
+    struct State {
+        std::vector<KindMask> stack;
+        std::vector<KindMask> slots;
+
+        bool operator==(const State &o) const {
+            return stack == o.stack && slots == o.slots;
+        }
+    };
+
+    struct FunctionAnalysis {
+        bool ok = false;
+        std::string error;
+        int maxDepth = 0;
+        std::unordered_map<int, State> states;
+    };
+
+    explicit Verifier(Poliz &poliz);
+
+    bool run();
+
+    const std::string &error() const { return lastError; }
+
+    static FunctionAnalysis analyze(const Poliz &poliz, int functionIndex);
+
+    static KindMask kindsOf(const TypeInfo &t);
+
+private:
+    Poliz &poliz;
+    std::string lastError;
+};
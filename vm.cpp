@@ -1,35 +1,424 @@
 #include "vm.hpp"
+#include "closures.hpp"
+#include "regengine.hpp"
+#include "kernels.hpp"
+#include <cstring>
 #include <sstream>
 
 
 
-VM::VM(const Poliz &code, InputBuffer &in)
-    : poliz(code), input(in) {
+VM::VM(const Poliz &code, InputBuffer &in, OutputSink &out)
+    : poliz(code), input(in), output(out), profile(code.functionCount()) {
+    for (std::size_t i = 0; i < poliz.stringCount(); ++i)
+        strings.push_back(poliz.getString(static_cast<int>(i)));
+    poolStrings = strings.size();
+
+    for (std::size_t i = 0; i < poliz.functionCount(); ++i) {
+        const auto &f = poliz.getFunction(static_cast<int>(i));
+        callTargets.push_back({
+            f.entryIp,
+            f.paramCount,
+            f.frameSize,
+            f.frameSize + std::max(f.maxStack, 0),
+            !f.returnType.isVoid()
+        });
+    }
+}
+
+VM::~VM() = default;
+
+
+VM::ArrayObject::ArrayObject(Value::Kind kind, int len, int desc)
+    : elemKind(kind), length(len), descriptor(desc) {
+    switch (elemKind) {
+        case Value::Kind::Float: floats.assign(length, 0.0f); break;
+        case Value::Kind::Char:
+        case Value::Kind::Bool:  chars.assign(length, 0); break;
+        default:                 ints.assign(length, 0); break;
+    }
+}
+
+void VM::ArrayObject::reset() {
+    std::fill(ints.begin(), ints.end(), 0);
+    std::fill(floats.begin(), floats.end(), 0.0f);
+    std::fill(chars.begin(), chars.end(), 0);
 }
 
+VM::Value VM::ArrayObject::load(int idx) const {
+    switch (elemKind) {
+        case Value::Kind::Float: return Value::makeFloat(floats[idx]);
+        case Value::Kind::Char:  return Value::makeChar(chars[idx]);
+        case Value::Kind::Bool:  return Value::makeBool(chars[idx] != 0);
+        default:                 return Value::makeInt(ints[idx]);
+    }
+}
 
+void VM::ArrayObject::store(int idx, const Value &v) {
+    switch (elemKind) {
+        case Value::Kind::Float:
+            floats[idx] = v.kind == Value::Kind::Float ? v.f : static_cast<float>(v.i);
+            break;
+        case Value::Kind::Char:
+            chars[idx] = static_cast<char>(v.kind == Value::Kind::Float ? static_cast<int>(v.f) : v.i);
+            break;
+        case Value::Kind::Bool:
+            chars[idx] = (v.kind == Value::Kind::Float ? v.f != 0.0f : v.i != 0) ? 1 : 0;
+            break;
+        default:
+            ints[idx] = v.kind == Value::Kind::Float ? static_cast<int32_t>(v.f) : v.i;
+            break;
+    }
+}
+
+
+
+template<bool Checked>
 VM::Value VM::pop() {
-    if (stack.empty())
-        throw std::runtime_error("VM: stack underflow");
-    Value v = stack.back();
-    stack.pop_back();
-    return v;
+    if constexpr (Checked) {
+        if (sp == 0)
+            throw std::runtime_error("VM: stack underflow");
+    }
+    return stack[--sp];
+}
+
+template<bool Checked>
+void VM::push(Value v) {
+    if constexpr (Checked) {
+        if (sp == (int) stack.size())
+            stack.resize(stack.size() * 2 + 16);
+    }
+    stack[sp++] = v;
+}
+
+void VM::growStack(std::size_t need) {
+    stack.resize(std::max(need, stack.size() * 2));
 }
 
-void VM::push(const Value &v) {
-    stack.push_back(v);
+void VM::callStackOverflow() {
+    throw std::runtime_error("VM: call stack overflow");
 }
 
+VM::Value VM::readInput(Poliz::Op op) {
+    switch (op) {
+        case Poliz::Op::READ_INT:
+            return Value::makeInt(input.nextInt());
+
+        case Poliz::Op::READ_FLOAT:
+            return Value::makeFloat(input.nextFloat());
+
+        default:
+            break;
+    }
+
+    std::string_view s = input.next();
+    switch (op) {
+        case Poliz::Op::READ_BOOL:
+            if (s == "true")
+                return Value::makeBool(true);
+            if (s == "false")
+                return Value::makeBool(false);
+            throw std::runtime_error("Invalid bool input: " + std::string(s));
+
+        case Poliz::Op::READ_CHAR:
+            if (s.size() != 1)
+                throw std::runtime_error("Invalid char input: " + std::string(s));
+            return Value::makeChar(s[0]);
+
+        default:
+            strings.emplace_back(s);
+            return Value::makeString(static_cast<int>(strings.size()) - 1);
+    }
+}
 
+template<bool Checked>
+VM::ArrayObject &VM::arrayAt(int slot, const char *what) {
+    const Value &cell = stack[base + slot];
+    if constexpr (Checked) {
+        if (cell.kind != Value::Kind::Array)
+            throw std::runtime_error(std::string(what) + ": not an array");
+    }
+    return heap[cell.i];
+}
+
+template<bool Checked>
+int VM::flatIndex(const ArrayObject &arr, const TypeInfo &type, const char *what) {
+    const int n = type.rank();
+    const int first = sp - n;
+    if constexpr (Checked) {
+        if (first < 0)
+            throw std::runtime_error("VM: stack underflow");
+    }
+
+    int flat = 0;
+    bool outOfRange = false;
+    for (int k = 0; k < n; ++k) {
+        const Value &idx = stack[first + k];
+        if constexpr (Checked) {
+            if (idx.kind != Value::Kind::Int &&
+                idx.kind != Value::Kind::Char &&
+                idx.kind != Value::Kind::Bool)
+                throw std::runtime_error(std::string(what) + ": index must be int");
+        }
+        int dim = type.dims[k] >= 0 ? type.dims[k] : arr.length / type.strides[k];
+        outOfRange |= static_cast<unsigned>(idx.i) >= static_cast<unsigned>(dim);
+        flat += idx.i * type.strides[k];
+    }
+    sp = first;
+
+    if (outOfRange || flat >= arr.length)
+        throw std::runtime_error(std::string(what) + ": out of range");
+    return flat;
+}
+
+template<bool Checked>
+void VM::callBuiltin(Builtin id) {
+    const BuiltinInfo &info = builtinInfo(id);
+    const int first = sp - info.paramCount;
+    const std::string name(info.name);
+
+    if constexpr (Checked) {
+        if (first < 0)
+            throw std::runtime_error("VM: stack underflow");
+        if (stack[first].kind != Value::Kind::Array ||
+            (info.secondIsArray && stack[first + 1].kind != Value::Kind::Array))
+            throw std::runtime_error("VM: " + name + ": argument is not an array");
+    }
+
+    ArrayObject &a = heap[stack[first].i];
+    const Value arg = info.paramCount == 2 ? stack[first + 1] : Value();
+    ArrayObject *b = info.secondIsArray ? &heap[arg.i] : nullptr;
+    const std::size_t n = a.length;
+    const bool isFloat = a.elemKind == Value::Kind::Float;
+
+    if constexpr (Checked) {
+        if (a.elemKind != Value::Kind::Int && !isFloat)
+            throw std::runtime_error("VM: " + name + ": unsupported element type");
+        if (b && b->elemKind != a.elemKind)
+            throw std::runtime_error("VM: " + name + ": element type mismatch");
+    }
+    if (b && b->length != a.length)
+        throw std::runtime_error("VM: " + name + ": length mismatch");
 
+    const auto &k = kernels::active();
+    const float argF = arg.kind == Value::Kind::Float ? arg.f : static_cast<float>(arg.i);
+    Value result;
+
+    switch (id) {
+        case Builtin::Sum:
+            result = isFloat ? Value::makeFloat(k.sumFloat(a.floats.data(), n))
+                             : Value::makeInt(k.sumInt(a.ints.data(), n));
+            break;
+        case Builtin::Dot:
+            result = isFloat ? Value::makeFloat(k.dotFloat(a.floats.data(), b->floats.data(), n))
+                             : Value::makeInt(k.dotInt(a.ints.data(), b->ints.data(), n));
+            break;
+        case Builtin::MinOf:
+            result = isFloat ? Value::makeFloat(k.minFloat(a.floats.data(), n))
+                             : Value::makeInt(k.minInt(a.ints.data(), n));
+            break;
+        case Builtin::MaxOf:
+            result = isFloat ? Value::makeFloat(k.maxFloat(a.floats.data(), n))
+                             : Value::makeInt(k.maxInt(a.ints.data(), n));
+            break;
+        case Builtin::Fill:
+            if (isFloat) k.fillFloat(a.floats.data(), n, argF);
+            else k.fillInt(a.ints.data(), n, arg.i);
+            break;
+        case Builtin::Scale:
+            if (isFloat) k.scaleFloat(a.floats.data(), n, argF);
+            else k.scaleInt(a.ints.data(), n, arg.i);
+            break;
+        case Builtin::Copy:
+            if (isFloat) std::memmove(a.floats.data(), b->floats.data(), n * sizeof(float));
+            else std::memmove(a.ints.data(), b->ints.data(), n * sizeof(int32_t));
+            break;
+        case Builtin::Read:
+            if (arg.i < 0 || arg.i > a.length)
+                throw std::runtime_error("VM: read: count out of range");
+            if (isFloat) {
+                for (float *p = a.floats.data(), *e = p + arg.i; p != e; ++p)
+                    *p = input.nextFloat();
+            } else {
+                for (int32_t *p = a.ints.data(), *e = p + arg.i; p != e; ++p)
+                    *p = input.nextInt();
+            }
+            break;
+        case Builtin::Print:
+            for (std::size_t k = 0; k < n; ++k) {
+                if (isFloat) output.writeFloat(a.floats[k]);
+                else output.writeInt(a.ints[k]);
+                output.endLine();
+            }
+            break;
+    }
+
+    sp = first;
+    if (info.returnsValue)
+        push<Checked>(result);
+}
+
+// Reads a loop-invariant scalar the way binaryNumOp would see it. Int and
+// char values feed int loops; float loops also accept them, promoted.
+bool VM::vectorScalar(const Poliz::VectorOperand &o, bool isFloat, int32_t &i, float &f) const {
+    using K = Poliz::VectorOperand::Kind;
+    Value v;
+    switch (o.kind) {
+        case K::Int:   v = Value::makeInt(o.value); break;
+        case K::Float: std::memcpy(&f, &o.value, sizeof(float)); v = Value::makeFloat(f); break;
+        case K::Var:   v = stack[base + o.value]; break;
+        default: return false;
+    }
+
+    if (v.kind == Value::Kind::Int || v.kind == Value::Kind::Char) {
+        i = v.i;
+        f = static_cast<float>(v.i);
+        return true;
+    }
+    if (v.kind == Value::Kind::Float && isFloat) {
+        f = v.f;
+        return true;
+    }
+    return false;
+}
+
+VM::ArrayObject *VM::vectorArray(int slot, bool isFloat, int lo, int hi) {
+    const Value &cell = stack[base + slot];
+    if (cell.kind != Value::Kind::Array)
+        return nullptr;
+    ArrayObject &arr = heap[cell.i];
+    if (arr.elemKind != (isFloat ? Value::Kind::Float : Value::Kind::Int))
+        return nullptr;
+    if (lo < 0 || hi > arr.length)
+        return nullptr;
+    return &arr;
+}
+
+// Executes a loop recognised by the Vectorizer in one go. Returns false,
+// leaving every slot and element untouched, whenever the scalar loop could
+// behave differently: unexpected value kinds, an index range that would
+// fault part-way, or bounds beyond 2^24 where CMP_LT's float compare is
+// no longer exact.
+bool VM::runVectorLoop(const Poliz::VectorLoop &loop) {
+    using K = Poliz::VectorOperand::Kind;
+    constexpr int exactLimit = 1 << 24;
+
+    const Value &iv = stack[base + loop.indexSlot];
+    if (iv.kind != Value::Kind::Int && iv.kind != Value::Kind::Char)
+        return false;
+    int32_t hi;
+    float unused;
+    if (!vectorScalar(loop.bound, false, hi, unused))
+        return false;
+    const int lo = iv.i;
+    if (lo >= hi || lo < -exactLimit || hi > exactLimit)
+        return false;
+    const std::size_t n = static_cast<std::size_t>(hi - lo);
+
+    const auto &k = kernels::active();
+    const bool isFloat = loop.isFloat;
+
+    if (loop.kind == Poliz::VectorLoop::Kind::Map) {
+        ArrayObject *dst = vectorArray(loop.target, isFloat, lo, hi);
+        ArrayObject *a = nullptr, *b = nullptr;
+        int32_t ki = 0;
+        float kf = 0.0f;
+        bool kFirst = false;
+
+        if (!dst)
+            return false;
+        for (const auto *o : {&loop.lhs, &loop.rhs}) {
+            if (o->kind == K::None)
+                continue;
+            if (o->kind == K::Array) {
+                ArrayObject *arr = vectorArray(o->value, isFloat, lo, hi);
+                if (!arr)
+                    return false;
+                (a ? b : a) = arr;
+            } else {
+                if (!vectorScalar(*o, isFloat, ki, kf))
+                    return false;
+                kFirst = (o == &loop.lhs);
+            }
+        }
+
+        if (loop.op == Poliz::Op::NOP) {
+            if (a) {
+                if (isFloat) std::memmove(dst->floats.data() + lo, a->floats.data() + lo, n * sizeof(float));
+                else std::memmove(dst->ints.data() + lo, a->ints.data() + lo, n * sizeof(int32_t));
+            } else {
+                if (isFloat) k.fillFloat(dst->floats.data() + lo, n, kf);
+                else k.fillInt(dst->ints.data() + lo, n, ki);
+            }
+        } else {
+            kernels::MapOp op = loop.op == Poliz::Op::ADD ? kernels::MapOp::Add
+                              : loop.op == Poliz::Op::SUB ? kernels::MapOp::Sub
+                              : kernels::MapOp::Mul;
+            if (b) {
+                if (isFloat) k.mapFloat(op, dst->floats.data() + lo, a->floats.data() + lo, b->floats.data() + lo, n);
+                else k.mapInt(op, dst->ints.data() + lo, a->ints.data() + lo, b->ints.data() + lo, n);
+            } else {
+                if (isFloat) k.mapFloatBroadcast(op, dst->floats.data() + lo, a->floats.data() + lo, kf, kFirst, n);
+                else k.mapIntBroadcast(op, dst->ints.data() + lo, a->ints.data() + lo, ki, kFirst, n);
+            }
+        }
+    } else {
+        Value &acc = stack[base + loop.target];
+        ArrayObject *a = vectorArray(loop.lhs.value, isFloat, lo, hi);
+        ArrayObject *b = loop.kind == Poliz::VectorLoop::Kind::Dot
+                             ? vectorArray(loop.rhs.value, isFloat, lo, hi) : a;
+        int32_t si;
+        float sf;
+        if (!a || !b || !vectorScalar({K::Var, loop.target}, isFloat, si, sf))
+            return false;
+
+        const bool dot = loop.kind == Poliz::VectorLoop::Kind::Dot;
+        if (isFloat) {
+            float r = dot ? k.dotFloat(a->floats.data() + lo, b->floats.data() + lo, n)
+                          : k.sumFloat(a->floats.data() + lo, n);
+            acc = Value::makeFloat(sf + r);
+        } else {
+            int32_t r = dot ? k.dotInt(a->ints.data() + lo, b->ints.data() + lo, n)
+                            : k.sumInt(a->ints.data() + lo, n);
+            acc = Value::makeInt(static_cast<int32_t>(static_cast<uint32_t>(si) + static_cast<uint32_t>(r)));
+        }
+    }
+
+    stack[base + loop.indexSlot] = Value::makeInt(hi);
+    return true;
+}
+
+void VM::newArray(int slot, int descriptor) {
+    Value &cell = stack[base + slot];
+    if (cell.kind == Value::Kind::Array &&
+        cell.i >= heapBase && cell.i < (int) heap.size() &&
+        heap[cell.i].descriptor == descriptor) {
+        heap[cell.i].reset();
+        return;
+    }
+
+    const TypeInfo &t = poliz.getArrayType(descriptor);
+    Value::Kind kind;
+    switch (t.baseType) {
+        case Token::Type::KwFloat: kind = Value::Kind::Float; break;
+        case Token::Type::KwChar:  kind = Value::Kind::Char; break;
+        case Token::Type::KwBool:  kind = Value::Kind::Bool; break;
+        default:                   kind = Value::Kind::Int; break;
+    }
+
+    heap.emplace_back(kind, t.arraySize, descriptor);
+    cell = Value::makeArray(static_cast<int>(heap.size()) - 1);
+}
+
+
+template<bool Checked>
 VM::Value VM::binaryNumOp(
     const std::function<int(int, int)> &intOp,
     const std::function<float(float, float)> &floatOp
 ) {
-    Value b = pop();
-    Value a = pop();
+    Value b = pop<Checked>();
+    Value a = pop<Checked>();
 
-    if (a.kind == Value::Kind::Int && b.kind == Value::Kind::Int)
+    if (a.kind != Value::Kind::Float && b.kind != Value::Kind::Float)
         return Value::makeInt(intOp(a.i, b.i));
 
     float af = (a.kind == Value::Kind::Float) ? a.f : a.i;
@@ -38,9 +427,10 @@ VM::Value VM::binaryNumOp(
     return Value::makeFloat(floatOp(af, bf));
 }
 
+template<bool Checked>
 VM::Value VM::binaryCmpOp(const std::function<bool(float, float)> &f) {
-    Value b = pop();
-    Value a = pop();
+    Value b = pop<Checked>();
+    Value a = pop<Checked>();
 
     float af = (a.kind == Value::Kind::Float) ? a.f : a.i;
     float bf = (b.kind == Value::Kind::Float) ? b.f : b.i;
@@ -51,75 +441,230 @@ VM::Value VM::binaryCmpOp(const std::function<bool(float, float)> &f) {
 
 void VM::printValue(const Value &v) {
     switch (v.kind) {
-        case Value::Kind::Int: std::cout << v.i;
+        case Value::Kind::Int: output.writeInt(v.i);
+            break;
+        case Value::Kind::Float: output.writeFloat(v.f);
             break;
-        case Value::Kind::Float: std::cout << v.f;
+        case Value::Kind::Bool: output.write(v.i ? "true" : "false");
             break;
-        case Value::Kind::Bool: std::cout << (v.i ? "true" : "false");
+        case Value::Kind::Char: output.put(static_cast<char>(v.i));
             break;
-        case Value::Kind::Char: std::cout << static_cast<char>(v.i);
+        case Value::Kind::String: output.write(strings[v.i]);
             break;
-        case Value::Kind::String: std::cout << v.s;
+        case Value::Kind::Array: output.write("<array>");
             break;
     }
+    output.endLine();
+}
+
+
+void VM::enableJit(int threshold) {
+    if (Jit::available())
+        jit = std::make_unique<Jit>(poliz, threshold);
+}
+
+// Runs a compiled function on the arguments at stack[argBase..sp). Native
+// code only handles Int values, so a call with any other argument kind
+// (e.g. a char passed for an int parameter) stays in the interpreter, as
+// does a call whose recursion outgrew the machine stack; native calls are
+// then held off until the interpreter unwinds above that depth.
+bool VM::callNative(Jit::Entry entry, const CallTarget &f, int argBase) {
+    int32_t args[Jit::maxParams];
+    for (int k = 0; k < f.paramCount; ++k) {
+        const Value &v = stack[argBase + k];
+        if (v.kind != Value::Kind::Int)
+            return false;
+        args[k] = v.i;
+    }
+
+    Jit::Context &ctx = jit->context();
+    ctx.error = nullptr;
+    int32_t result = entry(&ctx, args);
+    if (ctx.error == Jit::stackExhausted) {
+        nativeFloor = callStack.size();
+        return false;
+    }
+    if (ctx.error)
+        throw std::runtime_error(ctx.error);
+
+    sp = argBase;
+    if (f.returnsValue)
+        push<false>(Value::makeInt(result));
+    return true;
+}
+
+void VM::enableClosures() {
+    if (poliz.isVerified())
+        closures = std::make_unique<ClosureEngine>(*this, poliz);
+}
+
+void VM::enableRegisters(const RegisterCode &code) {
+    if (poliz.isVerified())
+        registers = std::make_unique<RegisterEngine>(*this, poliz, code);
+}
+
+void VM::enableTiering(int threshold) {
+    if (!poliz.isVerified() || threshold <= 0)
+        return;
+    enableClosures();
+    enableStackCache();
+    tierThreshold = static_cast<uint32_t>(threshold);
+    backEdges.assign(poliz.size(), 0);
+}
+
+bool VM::tryNative(int fnIdx, int argBase) {
+    if (!jit || callStack.size() >= nativeFloor)
+        return false;
+    Jit::Entry native = jit->onCall(fnIdx);
+    if (!native || !callNative(native, callTargets[fnIdx], argBase))
+        return false;
+    promote(fnIdx, Tier::Native, -1, profile[fnIdx].calls);
+    return true;
+}
+
+// Also called on every entry that reaches the ClosureEngine, so it must
+// stay cheap once the function is compiled.
+void VM::promote(int fnIdx, Tier tier, int ip, uint64_t count) {
+    if (tier == Tier::Closure)
+        closures->compile(fnIdx);
+    if (profile[fnIdx].tier >= tier)
+        return;
+    profile[fnIdx].tier = tier;
+    tierEvents.push_back({fnIdx, tier, ip, count});
+}
+
+// Function bodies are emitted one after another, so the owner of ip is
+// the function with the closest entry at or before it.
+int VM::functionAt(int ip) const {
+    int owner = -1;
+    for (std::size_t f = 0; f < poliz.functionCount(); ++f) {
+        int entry = poliz.getFunction(static_cast<int>(f)).entryIp;
+        if (entry >= 0 && entry <= ip &&
+            (owner < 0 || entry > poliz.getFunction(owner).entryIp))
+            owner = static_cast<int>(f);
+    }
+    return owner;
+}
+
+void VM::dumpStats(std::ostream &os) const {
+    static const char *const tierNames[] = {"interpreter", "closure", "native"};
+
+    os << "--- Tiering ---\n";
+    os << "dispatches: " << dispatched << "\n";
+    for (std::size_t f = 0; f < profile.size(); ++f) {
+        if (!profile[f].calls)
+            continue;
+        os << poliz.getFunction(static_cast<int>(f)).name << ": "
+           << profile[f].calls << " calls, "
+           << tierNames[static_cast<int>(profile[f].tier)] << "\n";
+    }
+    for (const TierEvent &e : tierEvents) {
+        os << "promoted " << poliz.getFunction(e.fnIdx).name << " to "
+           << tierNames[static_cast<int>(e.tier)];
+        if (e.ip >= 0)
+            os << " at back-edge " << e.ip << " after " << e.count << " iterations\n";
+        else
+            os << " after " << e.count << " calls\n";
+    }
 }
 
 
 void VM::run() {
-    int ip = 0;
+    const CallTarget &mainFn = callTargets[poliz.getFunctionIndex("main")];
+
+    stack.clear();
+    heap.clear();
+    strings.resize(poolStrings);
+    callStack.clear();
+    base = 0;
+    heapBase = 0;
+    nativeFloor = SIZE_MAX;
+    enterFrame(mainFn);
+    profile[poliz.getFunctionIndex("main")].calls = 1;
+
+    // What the driver printed comes out before the program's output, and
+    // the program's output before any error that stops it.
+    std::cout.flush();
+    try {
+        if (registers) {
+            registers->run(poliz.getFunctionIndex("main"));
+        } else if (closures && !tierThreshold) {
+            promote(poliz.getFunctionIndex("main"), Tier::Closure, -1, 1);
+            closures->run(mainFn.entryIp);
+        } else if (!cachedCode.empty())
+            executeCached(mainFn.entryIp);
+        else if (poliz.isVerified())
+            execute<false>(mainFn.entryIp);
+        else
+            execute<true>(mainFn.entryIp);
+    } catch (...) {
+        output.flush();
+        throw;
+    }
+    output.flush();
+}
+
+
+template<bool Checked>
+void VM::execute(int ip) {
+    uint64_t executed = 0;
 
     while (ip < (int) poliz.size()) {
         const auto &ins = poliz[ip];
+        ++executed;
 
         switch (ins.op) {
             case Poliz::Op::PUSH_INT:
-                push(Value::makeInt(*ins.arg1));
+                push<Checked>(Value::makeInt(*ins.arg1));
                 ++ip;
                 break;
 
             case Poliz::Op::PUSH_FLOAT: {
+                int bits = *ins.arg1;
                 float v;
-                std::memcpy(&v, &ins.arg1, sizeof(float));
-                push(Value::makeFloat(v));
+                std::memcpy(&v, &bits, sizeof(float));
+                push<Checked>(Value::makeFloat(v));
                 ++ip;
                 break;
             }
 
             case Poliz::Op::PUSH_BOOL:
-                push(Value::makeBool(ins.arg1 != 0));
+                push<Checked>(Value::makeBool(*ins.arg1 != 0));
                 ++ip;
                 break;
 
             case Poliz::Op::PUSH_CHAR:
-                push(Value::makeChar(static_cast<char>(*ins.arg1)));
+                push<Checked>(Value::makeChar(static_cast<char>(*ins.arg1)));
                 ++ip;
                 break;
 
             case Poliz::Op::PUSH_STRING:
-                push(Value::makeString(poliz.getString(*ins.arg1)));
+                push<Checked>(Value::makeString(*ins.arg1));
                 ++ip;
                 break;
 
 
 
             case Poliz::Op::NOT: {
-                Value a = pop();
+                Value a = pop<Checked>();
 
-                if (a.kind != Value::Kind::Bool)
-                    throw std::runtime_error("VM: NOT only for Bool");
+                if constexpr (Checked) {
+                    if (a.kind != Value::Kind::Bool)
+                        throw std::runtime_error("VM: NOT only for Bool");
+                }
 
-                push(Value::makeBool(!a.i));
+                push<Checked>(Value::makeBool(!a.i));
                 ++ip;
                 break;
             }
 
             case Poliz::Op::NEG: {
-                Value a = pop();
+                Value a = pop<Checked>();
 
                 if (a.kind == Value::Kind::Int)
-                    push(Value::makeInt(-a.i));
-                else if (a.kind == Value::Kind::Float)
-                    push(Value::makeFloat(-a.f));
+                    push<Checked>(Value::makeInt(-a.i));
+                else if (!Checked || a.kind == Value::Kind::Float)
+                    push<Checked>(Value::makeFloat(-a.f));
                 else
                     throw std::runtime_error("VM: NEG only for numeric types");
 
@@ -128,21 +673,25 @@ void VM::run() {
             }
 
             case Poliz::Op::BNOT: {
-                Value a = pop();
+                Value a = pop<Checked>();
 
-                if (a.kind != Value::Kind::Int)
-                    throw std::runtime_error("VM: BNOT only for Int");
+                if constexpr (Checked) {
+                    if (a.kind != Value::Kind::Int)
+                        throw std::runtime_error("VM: BNOT only for Int");
+                }
 
-                push(Value::makeInt(~a.i));
+                push<Checked>(Value::makeInt(~a.i));
                 ++ip;
                 break;
             }
 
             case Poliz::Op::STORE_VAR: {
-                Value v = pop();
+                Value v = pop<Checked>();
                 int idx = base + *ins.arg1;
-                if (idx >= (int) stack.size())
-                    stack.resize(idx + 1);
+                if constexpr (Checked) {
+                    if (idx < 0 || idx >= sp)
+                        throw std::runtime_error("STORE_VAR out of range");
+                }
                 stack[idx] = v;
                 ++ip;
                 break;
@@ -150,83 +699,132 @@ void VM::run() {
 
             case Poliz::Op::LOAD_VAR: {
                 int idx = base + *ins.arg1;
-                if (idx < 0 || idx >= (int) stack.size())
-                    throw std::runtime_error("LOAD_VAR out of range");
-                push(stack[idx]);
+                if constexpr (Checked) {
+                    if (idx < 0 || idx >= sp)
+                        throw std::runtime_error("LOAD_VAR out of range");
+                }
+                push<Checked>(stack[idx]);
                 ++ip;
                 break;
             }
 
-            case Poliz::Op::LOAD_ELEM: {
-                Value idx = pop();
-                int baseSlot = base + *ins.arg1;
+            case Poliz::Op::NEW_ARRAY:
+                newArray(*ins.arg1, *ins.arg2);
+                ++ip;
+                break;
 
-                if (idx.kind != Value::Kind::Int)
-                    throw std::runtime_error("LOAD_ELEM: index must be int");
+            case Poliz::Op::LOAD_ELEM: {
+                Value idx = pop<Checked>();
 
-                int addr = baseSlot + idx.i;
+                if constexpr (Checked) {
+                    if (idx.kind != Value::Kind::Int &&
+                        idx.kind != Value::Kind::Char &&
+                        idx.kind != Value::Kind::Bool)
+                        throw std::runtime_error("LOAD_ELEM: index must be int");
+                }
 
-                if (addr < 0 || addr >= stack.size())
+                const ArrayObject &arr = arrayAt<Checked>(*ins.arg1, "LOAD_ELEM");
+                if (idx.i < 0 || idx.i >= arr.length)
                     throw std::runtime_error("LOAD_ELEM: out of range");
 
-                push(stack[addr]);
+                push<Checked>(arr.load(idx.i));
                 ++ip;
                 break;
             }
 
             case Poliz::Op::STORE_ELEM: {
-                Value value = pop();
-                Value idx   = pop();
-
-                if (idx.kind != Value::Kind::Int)
-                    throw std::runtime_error("STORE_ELEM: index must be int");
+                Value value = pop<Checked>();
+                Value idx   = pop<Checked>();
+
+                if constexpr (Checked) {
+                    if (idx.kind != Value::Kind::Int &&
+                        idx.kind != Value::Kind::Char &&
+                        idx.kind != Value::Kind::Bool)
+                        throw std::runtime_error("STORE_ELEM: index must be int");
+                }
 
-                int baseSlot = base + *ins.arg1;
-                int addr = baseSlot + idx.i;
+                ArrayObject &arr = arrayAt<Checked>(*ins.arg1, "STORE_ELEM");
+                if (idx.i < 0 || idx.i >= arr.length)
+                    throw std::runtime_error("STORE_ELEM: out of range");
 
-                if (addr < 0)
-                    throw std::runtime_error("STORE_ELEM: negative index");
+                arr.store(idx.i, value);
+                ++ip;
+                break;
+            }
 
-                if (addr >= stack.size())
-                    stack.resize(addr + 1);
+            case Poliz::Op::LOAD_ELEM_N: {
+                const ArrayObject &arr = arrayAt<Checked>(*ins.arg1, "LOAD_ELEM_N");
+                int flat = flatIndex<Checked>(arr, poliz.getArrayType(*ins.arg2), "LOAD_ELEM_N");
+                push<Checked>(arr.load(flat));
+                ++ip;
+                break;
+            }
 
-                stack[addr] = value;
+            case Poliz::Op::STORE_ELEM_N: {
+                Value value = pop<Checked>();
+                ArrayObject &arr = arrayAt<Checked>(*ins.arg1, "STORE_ELEM_N");
+                int flat = flatIndex<Checked>(arr, poliz.getArrayType(*ins.arg2), "STORE_ELEM_N");
+                arr.store(flat, value);
                 ++ip;
                 break;
             }
 
-            case Poliz::Op::CALL: {
-                const auto& f = poliz.getFunction(*ins.arg1);
+            case Poliz::Op::VEC_LOOP:
+                if (runVectorLoop(poliz.getVectorLoop(*ins.arg1)))
+                    ip = *ins.arg2;
+                else
+                    ++ip;
+                break;
+
+            case Poliz::Op::CALL_BUILTIN:
+                callBuiltin<Checked>(static_cast<Builtin>(*ins.arg1));
+                ++ip;
+                break;
 
-                int argBase = stack.size() - f.paramCount;
-                if (argBase < 0)
-                    throw std::runtime_error("CALL: not enough args");
+            case Poliz::Op::CALL: {
+                if constexpr (Checked) {
+                    if (*ins.arg1 < 0 || *ins.arg1 >= (int) callTargets.size())
+                        throw std::runtime_error("Invalid function index");
+                }
+                const CallTarget &f = callTargets[*ins.arg1];
+
+                int argBase = sp - f.paramCount;
+                if constexpr (Checked) {
+                    if (argBase < 0)
+                        throw std::runtime_error("CALL: not enough args");
+                    if (f.entryIp < 0)
+                        throw std::runtime_error("CALL: function has no body: " + poliz.getFunction(*ins.arg1).name);
+                }
 
-                callStack.push_back({
-                    ip + 1,
-                    base,
-                    argBase
-                });
+                uint64_t calls = ++profile[*ins.arg1].calls;
+                if (tryNative(*ins.arg1, argBase)) {
+                    ++ip;
+                    break;
+                }
 
-                base = argBase;
+                pushFrame(f, argBase, ip + 1);
+                if constexpr (!Checked) {
+                    if (tierThreshold && calls >= tierThreshold) {
+                        promote(*ins.arg1, Tier::Closure, -1, calls);
+                        ip = closures->run(f.entryIp);
+                        break;
+                    }
+                }
                 ip = f.entryIp;
                 break;
             }
 
             case Poliz::Op::RET_VALUE: {
-                Value ret = pop();
-
-                if (callStack.empty())
-                    throw std::runtime_error("RET_VALUE with empty call stack");
+                Value ret = pop<Checked>();
 
-                Frame fr = callStack.back();
-                callStack.pop_back();
+                if constexpr (Checked) {
+                    if (callStack.empty())
+                        throw std::runtime_error("RET_VALUE with empty call stack");
+                }
 
-                stack.resize(fr.savedStackSize);
-                base = fr.savedBase;
-                ip = fr.returnIp;
+                ip = popFrame();
 
-                push(ret);
+                push<Checked>(ret);
                 break;
             }
 
@@ -236,17 +834,12 @@ void VM::run() {
                     break;
                 }
 
-                Frame fr = callStack.back();
-                callStack.pop_back();
-
-                stack.resize(fr.savedStackSize);
-                base = fr.savedBase;
-                ip = fr.returnIp;
+                ip = popFrame();
                 break;
             }
 
             case Poliz::Op::ADD:
-                push(binaryNumOp(
+                push<Checked>(binaryNumOp<Checked>(
                     [](int a, int b) { return a + b; },
                     [](float a, float b) { return a + b; }
                 ));
@@ -254,7 +847,7 @@ void VM::run() {
                 break;
 
             case Poliz::Op::SUB:
-                push(binaryNumOp(
+                push<Checked>(binaryNumOp<Checked>(
                     [](int a, int b) { return a - b; },
                     [](float a, float b) { return a - b; }
                 ));
@@ -262,7 +855,7 @@ void VM::run() {
                 break;
 
             case Poliz::Op::MUL:
-                push(binaryNumOp(
+                push<Checked>(binaryNumOp<Checked>(
                     [](int a, int b) { return a * b; },
                     [](float a, float b) { return a * b; }
                 ));
@@ -270,13 +863,13 @@ void VM::run() {
                 break;
 
             case Poliz::Op::DIV:
-                push(binaryNumOp(
+                push<Checked>(binaryNumOp<Checked>(
                     [](int a, int b) {
-                        if (b == 0) throw;
+                        if (b == 0) throw std::runtime_error("VM: division by zero");
                         return a / b;
                     },
                     [](float a, float b) {
-                        if (b == 0) throw;
+                        if (b == 0) throw std::runtime_error("VM: division by zero");
                         return a / b;
                     }
                 ));
@@ -284,180 +877,157 @@ void VM::run() {
                 break;
 
             case Poliz::Op::AND: {
-                Value b = pop();
-                Value a = pop();
-                if (a.kind != Value::Kind::Int || b.kind != Value::Kind::Int)
-                    throw std::runtime_error("VM: AND only for Int");
-                push(Value::makeInt(a.i & b.i));
+                Value b = pop<Checked>();
+                Value a = pop<Checked>();
+                if constexpr (Checked) {
+                    if (a.kind != Value::Kind::Int || b.kind != Value::Kind::Int)
+                        throw std::runtime_error("VM: AND only for Int");
+                }
+                push<Checked>(Value::makeInt(a.i & b.i));
                 ++ip;
                 break;
             }
 
             case Poliz::Op::OR: {
-                Value b = pop();
-                Value a = pop();
-                if (a.kind != Value::Kind::Int || b.kind != Value::Kind::Int)
-                    throw std::runtime_error("VM: OR only for Int");
-                push(Value::makeInt(a.i | b.i));
+                Value b = pop<Checked>();
+                Value a = pop<Checked>();
+                if constexpr (Checked) {
+                    if (a.kind != Value::Kind::Int || b.kind != Value::Kind::Int)
+                        throw std::runtime_error("VM: OR only for Int");
+                }
+                push<Checked>(Value::makeInt(a.i | b.i));
                 ++ip;
                 break;
             }
 
             case Poliz::Op::XOR: {
-                Value b = pop();
-                Value a = pop();
-                if (a.kind != Value::Kind::Int || b.kind != Value::Kind::Int)
-                    throw std::runtime_error("VM: XOR only for Int");
-                push(Value::makeInt(a.i ^ b.i));
+                Value b = pop<Checked>();
+                Value a = pop<Checked>();
+                if constexpr (Checked) {
+                    if (a.kind != Value::Kind::Int || b.kind != Value::Kind::Int)
+                        throw std::runtime_error("VM: XOR only for Int");
+                }
+                push<Checked>(Value::makeInt(a.i ^ b.i));
                 ++ip;
                 break;
             }
 
 
             case Poliz::Op::SHL: {
-                Value b = pop();
-                Value a = pop();
-                if (a.kind != Value::Kind::Int || b.kind != Value::Kind::Int)
-                    throw std::runtime_error("VM: SHL only for Int");
-                push(Value::makeInt(a.i << b.i));
+                Value b = pop<Checked>();
+                Value a = pop<Checked>();
+                if constexpr (Checked) {
+                    if (a.kind != Value::Kind::Int || b.kind != Value::Kind::Int)
+                        throw std::runtime_error("VM: SHL only for Int");
+                }
+                push<Checked>(Value::makeInt(a.i << b.i));
                 ++ip;
                 break;
             }
 
             case Poliz::Op::SHR: {
-                Value b = pop();
-                Value a = pop();
-                if (a.kind != Value::Kind::Int || b.kind != Value::Kind::Int)
-                    throw std::runtime_error("VM: SHR only for Int");
-                push(Value::makeInt(a.i >> b.i));
+                Value b = pop<Checked>();
+                Value a = pop<Checked>();
+                if constexpr (Checked) {
+                    if (a.kind != Value::Kind::Int || b.kind != Value::Kind::Int)
+                        throw std::runtime_error("VM: SHR only for Int");
+                }
+                push<Checked>(Value::makeInt(a.i >> b.i));
                 ++ip;
                 break;
             }
 
 
             case Poliz::Op::CMP_EQ:
-                push(binaryCmpOp([](float a, float b) { return a == b; }));
+                push<Checked>(binaryCmpOp<Checked>([](float a, float b) { return a == b; }));
                 ++ip;
                 break;
             case Poliz::Op::CMP_NE:
-                push(binaryCmpOp([](float a, float b) { return a != b; }));
+                push<Checked>(binaryCmpOp<Checked>([](float a, float b) { return a != b; }));
                 ++ip;
                 break;
             case Poliz::Op::CMP_LT:
-                push(binaryCmpOp([](float a, float b) { return a < b; }));
+                push<Checked>(binaryCmpOp<Checked>([](float a, float b) { return a < b; }));
                 ++ip;
                 break;
             case Poliz::Op::CMP_LE:
-                push(binaryCmpOp([](float a, float b) { return a <= b; }));
+                push<Checked>(binaryCmpOp<Checked>([](float a, float b) { return a <= b; }));
                 ++ip;
                 break;
             case Poliz::Op::CMP_GT:
-                push(binaryCmpOp([](float a, float b) { return a > b; }));
+                push<Checked>(binaryCmpOp<Checked>([](float a, float b) { return a > b; }));
                 ++ip;
                 break;
             case Poliz::Op::CMP_GE:
-                push(binaryCmpOp([](float a, float b) { return a >= b; }));
+                push<Checked>(binaryCmpOp<Checked>([](float a, float b) { return a >= b; }));
                 ++ip;
                 break;
 
             case Poliz::Op::LOG_AND: {
-                Value b = pop();
-                Value a = pop();
-                push(Value::makeBool(a.i && b.i));
+                Value b = pop<Checked>();
+                Value a = pop<Checked>();
+                push<Checked>(Value::makeBool(a.i && b.i));
                 ++ip;
                 break;
             }
 
             case Poliz::Op::LOG_OR: {
-                Value b = pop();
-                Value a = pop();
-                push(Value::makeBool(a.i || b.i));
+                Value b = pop<Checked>();
+                Value a = pop<Checked>();
+                push<Checked>(Value::makeBool(a.i || b.i));
                 ++ip;
                 break;
             }
 
             case Poliz::Op::JUMP:
+                if constexpr (!Checked) {
+                    if (tierThreshold && *ins.arg1 <= ip && ++backEdges[ip] >= tierThreshold) {
+                        promote(functionAt(ip), Tier::Closure, ip, backEdges[ip]);
+                        ip = closures->run(*ins.arg1);
+                        break;
+                    }
+                }
                 ip = *ins.arg1;
                 break;
 
             case Poliz::Op::JUMP_IF_FALSE:
-                if (pop().i == 0) ip = *ins.arg1;
+                if (pop<Checked>().i == 0) ip = *ins.arg1;
                 else ++ip;
                 break;
 
-            case Poliz::Op::READ_INT: {
-                std::string s = input.next();
-                try {
-                    int v = std::stoi(s);
-                    push(Value::makeInt(v));
-                } catch (...) {
-                    throw std::runtime_error("Invalid int input: " + s);
-                }
-                ++ip;
-                break;
-            }
-
-            case Poliz::Op::READ_FLOAT: {
-                std::string s = input.next();
-                try {
-                    float v = std::stof(s);
-                    push(Value::makeFloat(v));
-                } catch (...) {
-                    throw std::runtime_error("Invalid float input: " + s);
-                }
-                ++ip;
-                break;
-            }
-
-            case Poliz::Op::READ_BOOL: {
-                std::string s = input.next();
-                if (s == "true")
-                    push(Value::makeBool(true));
-                else if (s == "false")
-                    push(Value::makeBool(false));
-                else
-                    throw std::runtime_error("Invalid bool input: " + s);
+            case Poliz::Op::READ_INT:
+            case Poliz::Op::READ_FLOAT:
+            case Poliz::Op::READ_BOOL:
+            case Poliz::Op::READ_CHAR:
+            case Poliz::Op::READ_STRING:
+                push<Checked>(readInput(ins.op));
                 ++ip;
                 break;
-            }
-
-            case Poliz::Op::READ_CHAR: {
-                std::string s = input.next();
-                if (s.size() != 1)
-                    throw std::runtime_error("Invalid char input: " + s);
-                push(Value::makeChar(s[0]));
-                ++ip;
-                break;
-            }
-
-            case Poliz::Op::READ_STRING: {
-                push(Value::makeString(input.next()));
-                ++ip;
-                break;
-            }
 
             case Poliz::Op::PRINT:
-                printValue(pop());
-                std::cout << "\n";
+                printValue(pop<Checked>());
                 ++ip;
                 break;
 
             case Poliz::Op::MOD: {
-                Value b = pop();
-                Value a = pop();
+                Value b = pop<Checked>();
+                Value a = pop<Checked>();
 
-                if (a.kind != Value::Kind::Int || b.kind != Value::Kind::Int)
-                    throw std::runtime_error("VM: MOD only for Int");
+                if constexpr (Checked) {
+                    if (a.kind != Value::Kind::Int || b.kind != Value::Kind::Int)
+                        throw std::runtime_error("VM: MOD only for Int");
+                }
 
                 if (b.i == 0)
                     throw std::runtime_error("VM: modulo by zero");
 
-                push(Value::makeInt(a.i % b.i));
+                push<Checked>(Value::makeInt(a.i % b.i));
                 ++ip;
                 break;
             }
 
             case Poliz::Op::HALT:
+                dispatched += executed;
                 return;
 
             default: {
@@ -468,4 +1038,10 @@ void VM::run() {
             }
         }
     }
+    dispatched += executed;
 }
+
+// Shared with ClosureEngine and RegisterEngine, which only run verified code.
+template VM::ArrayObject &VM::arrayAt<false>(int, const char *);
+template int VM::flatIndex<false>(const ArrayObject &, const TypeInfo &, const char *);
+template void VM::callBuiltin<false>(Builtin);
@@ -1,50 +1,144 @@
 #pragma once
 #include "poliz.hpp"
+#include "builtins.hpp"
+#include "input.hpp"
+#include "jit.hpp"
+#include "output.hpp"
+#include <cstdint>
 #include <vector>
 #include <functional>
+#include <memory>
 #include <iostream>
 #include <stdexcept>
 #include <cstring>
 #include <string>
 
 
-class InputBuffer {
+class ClosureEngine;
+class RegisterCode;
+class RegisterEngine;
+
+class VM {
 public:
-    explicit InputBuffer(std::istream& in) : in(in) {}
+    VM(const Poliz& code, InputBuffer& input, OutputSink& output);
+    ~VM();
+    void run();
 
-    std::string next() {
-        std::string s;
-        if (!(in >> s))
-            throw std::runtime_error("Input exhausted");
-        return s;
-    }
+    // Compiles functions to native code after `threshold` calls. Only
+    // takes effect for verified code on x86-64 Linux.
+    void enableJit(int threshold);
 
-private:
-    std::istream& in;
-};
+    // Runs verified code on the ClosureEngine instead of the switch loop.
+    void enableClosures();
 
+    // Runs verified code on executeCached, which keeps the top operands in
+    // locals instead of on the stack.
+    void enableStackCache();
 
+    // Runs the program from its register form; `code` must outlive the VM.
+    void enableRegisters(const RegisterCode& code);
 
-class VM {
-public:
-    explicit VM(const Poliz& code, InputBuffer& input);
-    void run();
+    // Starts verified code in executeCached and moves a function onto
+    // the ClosureEngine once it has been called `threshold` times, or once
+    // one of its loop back-edges has been taken `threshold` times (the
+    // running frame then continues there at the loop head).
+    void enableTiering(int threshold);
+
+    void dumpStats(std::ostream& os) const;
+
+    enum class Tier : uint8_t { Interpreter, Closure, Native };
 
 private:
+    friend class ClosureEngine;
+    friend class RegisterEngine;
+
     const Poliz& poliz;
     InputBuffer& input;
+    OutputSink& output;
 
 
     struct Frame {
         int returnIp;
         int savedBase;
         int savedStackSize;
+        int savedHeapBase;
+    };
+
+    // Frames live in one allocation made up front, so a call is a store
+    // and a bounds check; recursing past the capacity is a runtime error
+    // instead of a reallocation.
+    class FrameStack {
+    public:
+        explicit FrameStack(std::size_t capacity)
+            : frames(new Frame[capacity]), capacity(capacity) {}
+
+        bool full() const { return depth == capacity; }
+        bool empty() const { return depth == 0; }
+        std::size_t size() const { return depth; }
+        void clear() { depth = 0; }
 
+        void push(const Frame &f) { frames[depth++] = f; }
+        Frame pop() { return frames[--depth]; }
+
+    private:
+        std::unique_ptr<Frame[]> frames;
+        std::size_t capacity;
+        std::size_t depth = 0;
+    };
+
+    static constexpr std::size_t maxCallDepth = 1 << 20;
+
+    // The parts of a FunctionInfo a call needs, resolved once per function
+    // when the VM is built. CALL operands index this table directly, so
+    // the call path never goes through Poliz::getFunction.
+    struct CallTarget {
+        int entryIp;
+        int paramCount;
+        int frameSize;
+        int stackNeed;      // frameSize + maxStack, the cells enterFrame reserves
+        bool returnsValue;
     };
 
     int base = 0;
+    int sp = 0;
+    int heapBase = 0;
+
+    FrameStack callStack{maxCallDepth};
+    std::vector<CallTarget> callTargets;
+
+    std::unique_ptr<Jit> jit;
+    std::unique_ptr<ClosureEngine> closures;
+    std::unique_ptr<RegisterEngine> registers;
+
+    struct FunctionProfile {
+        uint64_t calls = 0;
+        Tier tier = Tier::Interpreter;
+    };
+
+    // ip is the back-edge that triggered an on-stack switch, -1 for a
+    // promotion on entry.
+    struct TierEvent {
+        int fnIdx;
+        Tier tier;
+        int ip;
+        uint64_t count;
+    };
+
+    // Instructions dispatched by the switch loop, Steps run by the
+    // ClosureEngine and register instructions run by the RegisterEngine.
+    uint64_t dispatched = 0;
+
+    uint32_t tierThreshold = 0;
+    std::vector<FunctionProfile> profile;
+    std::vector<uint32_t> backEdges;
+    std::vector<TierEvent> tierEvents;
+
+    void promote(int fnIdx, Tier tier, int ip, uint64_t count);
+    int  functionAt(int ip) const;
+    std::size_t nativeFloor = SIZE_MAX;
 
-    std::vector<Frame> callStack;
+    bool callNative(Jit::Entry entry, const CallTarget &f, int argBase);
+    bool tryNative(int fnIdx, int argBase);
 
     struct Value {
         enum class Kind {
@@ -52,12 +146,12 @@ private:
             Float,
             Bool,
             Char,
-            String
-        } kind;
+            String,
+            Array
+        } kind = Kind::Int;
 
         int   i = 0;
         float f = 0.0f;
-        std::string s;
 
         static Value makeInt(int v) {
             Value x; x.kind = Kind::Int; x.i = v; return x;
@@ -71,23 +165,135 @@ private:
         static Value makeChar(char c) {
             Value x; x.kind = Kind::Char; x.i = c; return x;
         }
-        static Value makeString(const std::string& str) {
-            Value x; x.kind = Kind::String; x.s = str; return x;
+        static Value makeString(int idx) {
+            Value x; x.kind = Kind::String; x.i = idx; return x;
+        }
+        static Value makeArray(int handle) {
+            Value x; x.kind = Kind::Array; x.i = handle; return x;
         }
     };
 
-    std::vector<Value> stack;
+    struct ArrayObject {
+        Value::Kind elemKind;
+        int length;
+        int descriptor;
+
+        std::vector<int32_t> ints;
+        std::vector<float>   floats;
+        std::vector<char>    chars;
+
+        ArrayObject(Value::Kind kind, int len, int desc);
 
+        void  reset();
+        Value load(int idx) const;
+        void  store(int idx, const Value& v);
+    };
+
+    std::vector<Value> stack;
+    std::vector<ArrayObject> heap;
+    // The Poliz string pool, then each string read by this run.
+    std::vector<std::string> strings;
+    std::size_t poolStrings = 0;
 
+    template<bool Checked = true>
     Value pop();
-    void  push(const Value& v);
+    template<bool Checked = true>
+    void  push(Value v);
+
+    // Every engine's CALL and RET go through these, so they are inline
+    // below and keep their rare cases out of line.
+    void enterFrame(const CallTarget& f);
+    void pushFrame(const CallTarget& f, int argBase, int returnIp);
+    int  popFrame();
+    void growStack(std::size_t need);
+    [[noreturn]] void callStackOverflow();
+
+    Value readInput(Poliz::Op op);
+
+    template<bool Checked>
+    ArrayObject& arrayAt(int slot, const char* what);
+
+    void newArray(int slot, int descriptor);
+
+    template<bool Checked>
+    void callBuiltin(Builtin id);
+
+    bool runVectorLoop(const Poliz::VectorLoop &loop);
+    bool vectorScalar(const Poliz::VectorOperand &o, bool isFloat, int32_t &i, float &f) const;
+    ArrayObject *vectorArray(int slot, bool isFloat, int lo, int hi);
+
+    template<bool Checked>
+    int flatIndex(const ArrayObject& arr, const TypeInfo& type, const char* what);
 
+    template<bool Checked>
+    void execute(int ip);
+
+    template<bool Checked>
     Value binaryNumOp(
         const std::function<int(int,int)>&,
         const std::function<float(float,float)>&
     );
 
+    template<bool Checked>
     Value binaryCmpOp(const std::function<bool(float,float)>&);
 
+    // PRINT: the value and a newline, written to `output`.
     void printValue(const Value& v);
-};
\ No newline at end of file
+
+    // A Poliz instruction specialised for the operand-stack depth d it runs
+    // at, which the verifier fixes per ip. executeCached keeps the top
+    // min(d, 2) cells in two locals and the rest on the stack; `depth` is
+    // min(d, 4), since STORE_ELEM pops two cells and must know whether any
+    // are left below to refill from, and `code` is op * 5 + depth.
+    struct CachedInstr {
+        int code = 0;
+        int depth = 0;
+        int a = 0;
+        int b = 0;
+        Value imm;
+    };
+
+    std::vector<CachedInstr> cachedCode;
+
+    void executeCached(int ip);
+};
+
+
+inline void VM::enterFrame(const CallTarget &f) {
+    int top = base + f.frameSize;
+    std::size_t need = base + f.stackNeed;
+    if (stack.size() < need)
+        growStack(need);
+
+    for (int i = base + f.paramCount; i < top; ++i)
+        stack[i] = Value();
+    sp = top;
+}
+
+inline void VM::pushFrame(const CallTarget &f, int argBase, int returnIp) {
+    if (callStack.full())
+        callStackOverflow();
+    callStack.push({
+        returnIp,
+        base,
+        argBase,
+        heapBase
+    });
+
+    base = argBase;
+    heapBase = static_cast<int>(heap.size());
+    enterFrame(f);
+}
+
+// Leaves the current frame, dropping the arrays it allocated, and returns
+// the caller's ip.
+inline int VM::popFrame() {
+    Frame fr = callStack.pop();
+
+    if (heap.size() > static_cast<std::size_t>(heapBase))
+        heap.erase(heap.begin() + heapBase, heap.end());
+    sp = fr.savedStackSize;
+    base = fr.savedBase;
+    heapBase = fr.savedHeapBase;
+    return fr.returnIp;
+}
\ No newline at end of file